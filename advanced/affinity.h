@@ -0,0 +1,166 @@
+#pragma once
+
+// Pin pipeline stages to CPU cores, and report how much CPU time each stage's threads used.
+//
+// A stage map is a string such as "submit=1,callback=2,postprocess=3,decode=0-1".
+// Each thread calls StageAffinity::Enter("callback") once, and it will be pinned to the cores
+// listed for that stage (or left alone if the stage isn't listed). Every thread that enters a
+// stage is remembered, so that PrintCpuTimes() can report per-thread CPU time at the end.
+
+#include <errno.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Parse a core list such as "0-2,3" into {0,1,2,3}. Returns false on a syntax error, including
+// anything after a number, such as "1-" or "1abc".
+inline bool ParseCoreList(const std::string& s, std::vector<int>& cores) {
+	size_t i = 0;
+	while (i < s.size()) {
+		size_t end  = s.find_first_of(",", i);
+		end         = end == std::string::npos ? s.size() : end;
+		std::string part = s.substr(i, end - i);
+		const char* p    = part.c_str();
+		char*       next = nullptr;
+		if (!isdigit((unsigned char) *p))
+			return false;
+		long lo = strtol(p, &next, 10);
+		long hi = lo;
+		if (*next == '-') {
+			p = next + 1;
+			if (!isdigit((unsigned char) *p))
+				return false;
+			hi = strtol(p, &next, 10);
+		}
+		if (*next != 0)
+			return false;
+		if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+			return false;
+		for (int c = lo; c <= hi; c++)
+			cores.push_back(c);
+		i = end + 1;
+	}
+	return true;
+}
+
+// Pin the calling thread to the given cores
+inline int PinThreadToCores(const std::vector<int>& cores) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int c : cores)
+		CPU_SET(c, &set);
+	return sched_setaffinity(0, sizeof(set), &set);
+}
+
+// Switch the calling thread to SCHED_FIFO. This usually needs root, or CAP_SYS_NICE.
+// Be careful with a priority above 50, because that will outrank kernel IRQ threads.
+inline int SetRealtimePriority(int priority) {
+	sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+// CPU time consumed by the calling thread, in seconds
+inline double ThreadCpuSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+class StageAffinity {
+public:
+	struct Stage {
+		std::string      Name;
+		std::vector<int> Cores;
+	};
+
+	struct Thread {
+		std::string Stage;
+		clockid_t   Clock;
+		double      CpuSecondsAtStart; // When it entered its stage, or at the last StartMeasurement()
+	};
+
+	// Returns false if the map string is malformed
+	bool Parse(const std::string& map) {
+		Stages.clear();
+		size_t i = 0;
+		while (i < map.size()) {
+			size_t eq = map.find('=', i);
+			if (eq == std::string::npos)
+				return false;
+			// The core list ends where the next "name=" begins
+			size_t end  = map.find('=', eq + 1);
+			end         = end == std::string::npos ? map.size() : map.rfind(',', end);
+			Stage stage;
+			stage.Name = map.substr(i, eq - i);
+			if (!ParseCoreList(map.substr(eq + 1, end - eq - 1), stage.Cores) || stage.Cores.empty())
+				return false;
+			Stages.push_back(stage);
+			i = end + 1;
+		}
+		return true;
+	}
+
+	// Pin the calling thread according to its stage, and remember it for PrintCpuTimes()
+	void Enter(const std::string& stage) {
+		for (const auto& s : Stages) {
+			if (s.Name == stage && PinThreadToCores(s.Cores) != 0)
+				printf("Failed to set CPU affinity for stage %s: %s\n", stage.c_str(), strerror(errno));
+		}
+		Thread t;
+		t.Stage = stage;
+		pthread_getcpuclockid(pthread_self(), &t.Clock);
+		t.CpuSecondsAtStart = ThreadCpuSeconds();
+		std::lock_guard<std::mutex> lock(Lock);
+		Threads.push_back(t);
+	}
+
+	// Like Enter(), but only does anything the first time it's called on a given thread.
+	// Use this inside callbacks that run on threads you don't own, such as HailoRT's.
+	void EnterOnce(const std::string& stage) {
+		thread_local const StageAffinity* entered = nullptr;
+		if (entered == this)
+			return;
+		entered = this;
+		Enter(stage);
+	}
+
+	// Start measuring CPU time from now, eg after warmup, so that PrintCpuTimes() covers the same
+	// time as wallSeconds. Threads that enter a stage later are measured from when they enter.
+	// The threads must still be alive.
+	void StartMeasurement() {
+		std::lock_guard<std::mutex> lock(Lock);
+		for (auto& t : Threads) {
+			timespec ts;
+			if (clock_gettime(t.Clock, &ts) == 0)
+				t.CpuSecondsAtStart = ts.tv_sec + ts.tv_nsec * 1e-9;
+		}
+	}
+
+	// Print the CPU time used by each registered thread since StartMeasurement() (or since it
+	// entered its stage, if that was later). The threads must still be alive.
+	void PrintCpuTimes(double wallSeconds) {
+		std::lock_guard<std::mutex> lock(Lock);
+		for (const auto& t : Threads) {
+			timespec ts;
+			if (clock_gettime(t.Clock, &ts) != 0)
+				continue;
+			double cpu = ts.tv_sec + ts.tv_nsec * 1e-9 - t.CpuSecondsAtStart;
+			printf("%-16s %.3fs CPU (%.1f%% of wall time)\n", t.Stage.c_str(), cpu, wallSeconds > 0 ? 100 * cpu / wallSeconds : 0.0);
+		}
+	}
+
+	std::vector<Stage> Stages;
+
+private:
+	std::mutex          Lock;
+	std::vector<Thread> Threads;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+// An inference backend is the thing that runs the neural network: either a real Hailo device
+// (see hailo_backend.h), or a software stand-in that behaves like one (see sim_backend.h).
+//
+// This header has no dependency on HailoRT, so that the host side of a pipeline can be built,
+// measured and optimized on any Linux machine.
+//
+// The interface mirrors the subset of ConfiguredInferModel that our pipelines use:
+// configure for a batch size, wait for space in the async queue, submit a batch, and get a
+// callback when it's done.
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class TensorType {
+	UInt8,
+	UInt16,
+	Float32,
+};
+
+// Description of an input or output tensor
+struct TensorInfo {
+	std::string Name;
+	uint32_t    Height    = 0;
+	uint32_t    Width     = 0;
+	uint32_t    Features  = 0;
+	TensorType  Type      = TensorType::UInt8;
+	bool        IsNMS     = false; // HAILO NMS layout. Height is the number of classes, and Width the max boxes per class.
+	float       QpZp      = 0;     // Quantization: float = (raw - QpZp) * QpScale
+	float       QpScale   = 1;
+	size_t      FrameSize = 0;     // Bytes per frame
+};
+
+// The buffers of one frame in a batch.
+// Outputs holds one buffer per output tensor, in the same order as InferBackend::Outputs().
+struct BackendFrame {
+	const void*        Input = nullptr;
+	std::vector<void*> Outputs;
+};
+
+// Called when a batch is complete. status is 0 on success.
+using BackendCallback = std::function<void(int status)>;
+
+// All functions return 0 on success, otherwise a backend-specific error code (for HailoBackend,
+// this is a hailo_status).
+class InferBackend {
+public:
+	virtual ~InferBackend() {}
+
+	virtual const char* Name() const = 0;
+
+	// (Re)configure the network for the given batch size. Any previous configuration must be idle.
+	virtual int Configure(int batchSize) = 0;
+
+	// Valid after Configure()
+	virtual const TensorInfo&              Input() const   = 0;
+	virtual const std::vector<TensorInfo>& Outputs() const = 0;
+
+	// Number of frames that can be in flight at the same time
+	virtual uint32_t QueueSize() const = 0;
+
+	// Block until there is space in the async queue for nFrames more frames
+	virtual int WaitForAsyncReady(std::chrono::milliseconds timeout, uint32_t nFrames) = 0;
+
+	// Submit a batch of frames. The buffers must remain valid until 'done' is called, which happens
+	// on a backend thread, so it must return quickly.
+	virtual int RunAsync(const std::vector<BackendFrame>& frames, BackendCallback done) = 0;
+
+	// Block until every submitted batch has completed
+	virtual void WaitIdle() = 0;
+
+	// The running average of on-device latency per frame, or 0 if it isn't known. This is what
+	// HailoRT measures. The frames of a batch may overlap on the device, so a batch can take less
+	// than its frames times this.
+	virtual uint64_t DeviceLatencyNs() = 0;
+};
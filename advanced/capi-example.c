@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../yolohailo.h"
+
+// Uses libyolohailo from plain C: keeps a few frames in flight, and polls for the results.
+// This is the pattern to follow from Go or Python, where the library's threads can't call back
+// into the language runtime cheaply.
+// Pass --sim to use the simulated device.
+
+// make lib && gcc -O2 -o capi-example advanced/capi-example.c bin/libyolohailo.a -lhailort -lstdc++ -lpthread && ./capi-example
+
+#define NUM_FRAMES 4
+#define MAX_DETECTIONS 100
+
+static double Seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv) {
+	yh_config config;
+	yh_default_config(&config);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--sim") == 0)
+			config.simulate = 1;
+		else if (strcmp(argv[i], "--hef") == 0 && i + 1 < argc)
+			config.hef_path = argv[++i];
+	}
+
+	int major, minor;
+	yh_version(&major, &minor);
+	printf("libyolohailo %d.%d\n", major, minor);
+
+	yh_detector* det    = NULL;
+	int          status = yh_create(&config, &det);
+	if (status != YH_OK) {
+		printf("Failed to create detector: %s (%d)\n", yh_status_string(status), status);
+		return 0;
+	}
+	int width, height, channels;
+	yh_input_shape(det, &width, &height, &channels);
+	size_t size = yh_input_size(det);
+	printf("Input %d x %d x %d\n", width, height, channels);
+
+	// A real application would decode camera frames into these
+	void* frames[NUM_FRAMES];
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		frames[i] = yh_alloc_frame(det);
+		memset(frames[i], 128, size);
+	}
+
+	yh_detection boxes[MAX_DETECTIONS];
+	yh_result    result;
+	uint64_t     nextID    = 0;
+	int          completed = 0;
+	double       start     = Seconds();
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		status = yh_submit(det, frames[i], size, nextID++, 1000, NULL, NULL);
+		if (status != YH_OK)
+			break;
+	}
+	while (status == YH_OK && yh_pending(det) != 0) {
+		status = yh_poll(det, 1000, &result, boxes, MAX_DETECTIONS);
+		if (status != YH_OK || result.status != YH_OK) {
+			status = status != YH_OK ? status : result.status;
+			break;
+		}
+		if (completed == 0) {
+			for (int i = 0; i < result.num_detections; i++)
+				printf("class: %d, confidence: %.2f, %.3f,%.3f - %.3f,%.3f\n", boxes[i].class_id, boxes[i].confidence, boxes[i].x_min, boxes[i].y_min,
+				       boxes[i].x_max, boxes[i].y_max);
+		}
+		completed++;
+		// Resubmit the same frame buffer, now that the device is done with it
+		if (Seconds() - start < 2)
+			status = yh_submit(det, result.frame, size, nextID++, 1000, NULL, NULL);
+	}
+	double elapsed = Seconds() - start;
+	if (status != YH_OK)
+		printf("Failed: %s (%d)\n", yh_status_string(status), status);
+	printf("%d frames in %.2fs, %.1f FPS\n", completed, elapsed, completed / elapsed);
+
+	for (int i = 0; i < NUM_FRAMES; i++)
+		yh_free_frame(det, frames[i]);
+	yh_destroy(det);
+	return 0;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+// C++20 coroutine wrapper around ConfiguredInferModel::run_async.
+// This lets you write per-stream logic sequentially:
+//
+//   CoTask Stream(CoInferModel& model, ConfiguredInferModel::Bindings& bindings) {
+//       for (int i = 0; i < 100; i++) {
+//           hailo_status status = co_await model.Infer(bindings);
+//           ... consume output buffers ...
+//       }
+//   }
+//
+// Everything runs on the single thread that calls CoExecutor::Run(). The HailoRT completion
+// callback does nothing more than queue the suspended coroutine for that thread, so you can
+// have hundreds of requests in flight without a thread for each of them.
+
+#include <hailo/hailort.h>
+#include <hailo/infer_model.hpp>
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// A single-threaded executor. Coroutines are resumed only from inside Run().
+// Post() may be called from any thread.
+class CoExecutor {
+public:
+	void Post(std::coroutine_handle<> h) {
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			Ready.push_back(h);
+		}
+		Wake.notify_one();
+	}
+
+	// Resume coroutines until every spawned task has finished.
+	void Run() {
+		while (true) {
+			std::coroutine_handle<> h;
+			{
+				std::unique_lock<std::mutex> lock(Lock);
+				Wake.wait(lock, [&] { return !Ready.empty() || LiveTasks == 0; });
+				if (Ready.empty())
+					return;
+				h = Ready.front();
+				Ready.pop_front();
+			}
+			h.resume();
+		}
+	}
+
+	void TaskStarted() {
+		std::lock_guard<std::mutex> lock(Lock);
+		LiveTasks++;
+	}
+
+	void TaskFinished() {
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			LiveTasks--;
+		}
+		Wake.notify_one();
+	}
+
+private:
+	std::mutex                          Lock;
+	std::condition_variable             Wake;
+	std::deque<std::coroutine_handle<>> Ready;
+	int                                 LiveTasks = 0;
+};
+
+// A fire-and-forget coroutine that runs on a CoExecutor.
+// Create it by calling your coroutine function, then hand it to Spawn().
+// The coroutine frame is destroyed automatically when the coroutine returns.
+class CoTask {
+public:
+	struct promise_type {
+		CoExecutor* Executor = nullptr;
+
+		CoTask              get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		void                return_void() {}
+		void                unhandled_exception() { std::terminate(); }
+
+		struct FinalAwaiter {
+			bool await_ready() noexcept { return false; }
+			void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+				CoExecutor* exec = h.promise().Executor;
+				h.destroy();
+				exec->TaskFinished();
+			}
+			void await_resume() noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+	};
+
+	CoTask(CoTask&& t) : Handle(t.Handle) { t.Handle = nullptr; }
+	CoTask(const CoTask&) = delete;
+	~CoTask() {
+		// Never spawned
+		if (Handle)
+			Handle.destroy();
+	}
+
+	void Spawn(CoExecutor& exec) {
+		Handle.promise().Executor = &exec;
+		exec.TaskStarted();
+		exec.Post(Handle);
+		Handle = nullptr;
+	}
+
+private:
+	std::coroutine_handle<promise_type> Handle;
+	explicit CoTask(std::coroutine_handle<promise_type> h) : Handle(h) {}
+};
+
+// Wraps a ConfiguredInferModel so that inference can be co_await'ed.
+// We track the number of frames in flight ourselves, using the model's async queue size as
+// the limit, so that a coroutine which would otherwise block inside wait_for_async_ready()
+// is instead parked until an earlier job completes.
+// All methods except the completion callback must be called from the executor thread.
+class CoInferModel {
+public:
+	class Awaitable {
+	public:
+		bool await_ready() { return false; }
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			Handle = h;
+			if (Model->InFlight != 0 && Model->InFlight + NumFrames > Model->QueueSize) {
+				Model->Waiting.push_back(this);
+				return true;
+			}
+			return Submit();
+		}
+
+		hailo_status await_resume() {
+			if (Submitted)
+				Model->OnComplete(NumFrames);
+			return Status;
+		}
+
+	private:
+		friend class CoInferModel;
+
+		CoInferModel*                                       Model;
+		hailort::ConfiguredInferModel::Bindings*            Single = nullptr;
+		std::vector<hailort::ConfiguredInferModel::Bindings>* Batch  = nullptr;
+		uint32_t                                            NumFrames = 0;
+		std::coroutine_handle<>                             Handle;
+		hailo_status                                        Status    = HAILO_SUCCESS;
+		bool                                                Submitted = false;
+
+		// Returns true if the coroutine remains suspended (ie the job was dispatched)
+		bool Submit() {
+			auto callback = [this](const hailort::AsyncInferCompletionInfo& info) {
+				// This runs on a HailoRT thread, so do the minimum.
+				Status = info.status;
+				Model->Executor->Post(Handle);
+			};
+			hailort::Expected<hailort::AsyncInferJob> job = Single ? Model->Configured->run_async(*Single, callback) : Model->Configured->run_async(*Batch, callback);
+			if (!job) {
+				Status = job.status();
+				return false;
+			}
+			job->detach();
+			Submitted = true;
+			Model->InFlight += NumFrames;
+			return true;
+		}
+	};
+
+	CoInferModel(CoExecutor& executor, std::shared_ptr<hailort::ConfiguredInferModel> configured) : Executor(&executor), Configured(configured) {
+		auto queueSize = configured->get_async_queue_size();
+		QueueSize      = queueSize ? (uint32_t) queueSize.release() : 1;
+	}
+
+	// The bindings must remain valid until the co_await completes.
+	Awaitable Infer(hailort::ConfiguredInferModel::Bindings& bindings) {
+		Awaitable a;
+		a.Model     = this;
+		a.Single    = &bindings;
+		a.NumFrames = 1;
+		return a;
+	}
+
+	// Submit a batch as a single job.
+	Awaitable Infer(std::vector<hailort::ConfiguredInferModel::Bindings>& bindings) {
+		Awaitable a;
+		a.Model     = this;
+		a.Batch     = &bindings;
+		a.NumFrames = (uint32_t) bindings.size();
+		return a;
+	}
+
+	uint32_t FramesInFlight() const { return InFlight; }
+	uint32_t AsyncQueueSize() const { return QueueSize; }
+
+private:
+	CoExecutor*                                    Executor;
+	std::shared_ptr<hailort::ConfiguredInferModel> Configured;
+	uint32_t                                       QueueSize = 1;
+	uint32_t                                       InFlight  = 0;
+	std::deque<Awaitable*>                         Waiting;
+
+	void OnComplete(uint32_t nFrames) {
+		InFlight -= nFrames;
+		while (!Waiting.empty()) {
+			Awaitable* next = Waiting.front();
+			if (InFlight != 0 && InFlight + next->NumFrames > QueueSize)
+				break;
+			Waiting.pop_front();
+			if (!next->Submit())
+				Executor->Post(next->Handle);
+		}
+	}
+};
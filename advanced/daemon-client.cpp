@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "daemon_protocol.h"
+#include "histogram.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+// Sends an image to yolov8-daemon, over and over, and measures the round trip.
+// With --slots n, n requests are kept in flight at once, which is how a client would keep the
+// device busy. Run several of these at the same time to see the daemon share the device.
+// It has no dependency on HailoRT.
+
+// g++ -O2 -o daemon-client advanced/daemon-client.cpp && ./daemon-client --duration 5
+
+std::string socketPath      = "/tmp/yolohailo.sock";
+std::string imgFilename     = "test-image-640x640.jpg";
+int         numSlots        = 2;     // Requests in flight at once
+double      durationSeconds = 5;
+bool        printDetections = false; // Print the detections of the first reply
+
+uint64_t NowNs() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int run() {
+	DaemonClient client;
+	if (!client.Connect(socketPath)) {
+		printf("Failed to connect to yolov8-daemon on %s\n", socketPath.c_str());
+		return 1;
+	}
+	int            imgWidth = 0, imgHeight = 0, imgChan = 0;
+	unsigned char* img = stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3);
+	if (!img) {
+		printf("Failed to load image %s\n", imgFilename.c_str());
+		return 1;
+	}
+	if ((uint32_t) imgWidth != client.Info.Width || (uint32_t) imgHeight != client.Info.Height)
+		printf("Input image resolution %d x %d not equal to NN input resolution %u x %u\n", imgWidth, imgHeight, client.Info.Width, client.Info.Height);
+	size_t copySize = std::min((size_t) client.Info.FrameSize, (size_t) imgWidth * imgHeight * 3);
+
+	// The image goes into each slot once. After that, requests are just a message on the socket.
+	for (int i = 0; i < numSlots; i++) {
+		int slot = client.AddSlot();
+		if (slot == -1) {
+			printf("Failed to create shared memory slot\n");
+			stbi_image_free(img);
+			return 1;
+		}
+		memcpy(client.SlotData(slot), img, copySize);
+	}
+	stbi_image_free(img);
+
+	std::vector<uint64_t> sentAt(numSlots);
+	uint64_t              requestID = 0;
+	for (int i = 0; i < numSlots; i++) {
+		sentAt[i] = NowNs();
+		if (!client.Submit(i, requestID++)) {
+			printf("Failed to send request\n");
+			return 1;
+		}
+	}
+
+	HdrHistogram           roundTripNs;
+	HdrHistogram           queueNs;    // Time waiting in the daemon for the device, behind other requests
+	HdrHistogram           overheadNs; // Round trip, minus the time queued and on the device
+	daemonproto::Reply     reply;
+	std::vector<Detection> dets;
+	int64_t                nFrames  = 0;
+	int                    inFlight = numSlots;
+	auto                   start    = std::chrono::steady_clock::now();
+	double                 elapsed  = 0;
+	while (inFlight != 0) {
+		if (!client.Receive(reply, dets)) {
+			printf("Lost connection to the daemon\n");
+			return 1;
+		}
+		if (reply.Status != daemonproto::StatusOK) {
+			printf("Request %d failed, status = %d\n", (int) reply.RequestID, reply.Status);
+			return 1;
+		}
+		uint64_t now = NowNs();
+		roundTripNs.Record(now - sentAt[reply.Slot]);
+		queueNs.Record(reply.QueueNs);
+		overheadNs.Record(now - sentAt[reply.Slot] - reply.QueueNs - reply.InferNs);
+		if (printDetections && nFrames == 0) {
+			for (const auto& d : dets) {
+				printf("class: %d, confidence: %.2f, %d,%d - %d,%d\n", d.ClassID, d.Confidence, (int) (d.XMin * imgWidth), (int) (d.YMin * imgHeight),
+				       (int) (d.XMax * imgWidth), (int) (d.YMax * imgHeight));
+			}
+		}
+		nFrames++;
+		inFlight--;
+
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed < durationSeconds) {
+			sentAt[reply.Slot] = NowNs();
+			if (!client.Submit(reply.Slot, requestID++)) {
+				printf("Failed to send request\n");
+				return 1;
+			}
+			inFlight++;
+		}
+	}
+
+	auto rt = roundTripNs.GetSnapshot();
+	auto qu = queueNs.GetSnapshot();
+	auto oh = overheadNs.GetSnapshot();
+	printf("%-16s %d in %.1fs\n", "Frames", (int) nFrames, elapsed);
+	printf("%-16s %.2f\n", "FPS", nFrames / elapsed);
+	printf("%-16s p50 %.2fms, p99 %.2fms\n", "Round trip", rt.Percentile(50) / 1e6, rt.Percentile(99) / 1e6);
+	printf("%-16s p50 %.2fms, p99 %.2fms\n", "Queued", qu.Percentile(50) / 1e6, qu.Percentile(99) / 1e6);
+	printf("%-16s p50 %.1fus, p99 %.1fus (round trip, excluding the queue and the device)\n", "Overhead", oh.Percentile(50) / 1e3, oh.Percentile(99) / 1e3);
+	return 123456789;
+}
+
+void PrintHelp() {
+	printf("Usage: daemon-client [options]\n");
+	printf("  --socket <path>       Unix socket of yolov8-daemon (default %s)\n", socketPath.c_str());
+	printf("  --image <file>        Input image (default %s)\n", imgFilename.c_str());
+	printf("  --slots <n>           Requests in flight at once (default %d)\n", numSlots);
+	printf("  --duration <seconds>  How long to keep sending requests (default %.0f)\n", durationSeconds);
+	printf("  --print               Print the detections of the first frame\n");
+}
+
+// Returns false if the arguments are invalid
+bool ParseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--help" || arg == "-h") {
+			return false;
+		} else if (arg == "--print") {
+			printDetections = true;
+			continue;
+		} else if (next == nullptr) {
+			printf("Missing value for %s\n", arg.c_str());
+			return false;
+		} else if (arg == "--socket") {
+			socketPath = next;
+		} else if (arg == "--image") {
+			imgFilename = next;
+		} else if (arg == "--slots") {
+			numSlots = atoi(next);
+		} else if (arg == "--duration") {
+			durationSeconds = atof(next);
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			return false;
+		}
+		i++;
+	}
+	if (numSlots < 1 || numSlots > (int) daemonproto::MaxSlots) {
+		printf("Slots must be between 1 and %u\n", daemonproto::MaxSlots);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (!ParseArgs(argc, argv)) {
+		PrintHelp();
+		return 1;
+	}
+	int status = run();
+	if (status == 123456789)
+		printf("SUCCESS\n");
+	else
+		printf("Failed with error code %d\n", status);
+	return 0;
+}
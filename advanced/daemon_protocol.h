@@ -0,0 +1,269 @@
+#pragma once
+
+// The protocol between yolov8-daemon and its clients, and a client for it.
+//
+// The daemon keeps a configured model warm, and serves any number of local processes over a
+// SOCK_SEQPACKET Unix domain socket, so every message arrives whole. Frame pixels never go
+// through the socket. Instead, a client creates shared memory slots (memfd), each holding one
+// input frame, and hands their file descriptors to the daemon once, with SCM_RIGHTS. After
+// that, a request is a 24 byte message naming a slot, and the reply carries the detections.
+//
+//   daemon -> client  HelloMessage, as soon as the client connects
+//   client -> daemon  Request{RegisterSlot}, with a memfd attached
+//   client -> daemon  Request{Infer}, for a slot that has been filled with a frame
+//   daemon -> client  Reply, followed by Reply.NumDetections x PackedDetection
+//
+// A slot may only have one request in flight, and must not be written to until its reply
+// arrives, because the device reads straight out of it. The memfd must be sealed against
+// shrinking, so that the client can't pull the memory out from under the daemon.
+// All values are little-endian.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "../detection_stream.h"
+#include "../nms.h"
+
+namespace daemonproto {
+
+const uint32_t Magic         = 0x44484c59; // "YLHD"
+const uint32_t Version       = 1;
+const uint32_t MaxSlots      = 64;   // Per client
+const uint32_t MaxDetections = 1024; // Per reply. Any more are dropped.
+
+enum class MessageType : uint32_t {
+	Hello        = 1,
+	RegisterSlot = 2,
+	Infer        = 3,
+	Reply        = 4,
+};
+
+// Reply status codes. Anything else is an error from the inference backend.
+const int32_t StatusOK        = 0;
+const int32_t ErrBadRequest   = -100; // Malformed message, or wrong version
+const int32_t ErrBadSlot      = -101; // No such slot, or the memfd is too small or not sealed
+const int32_t ErrSlotBusy     = -102; // The slot already has a request in flight
+const int32_t ErrTooManySlots = -103; // The client already has MaxSlots slots
+
+// Describes the input that the daemon expects in every slot
+struct HelloMessage {
+	uint32_t Magic;
+	uint32_t Type;
+	uint32_t Version;
+	uint32_t Width; // RGB, 8 bits per channel, at exactly the network resolution
+	uint32_t Height;
+	uint32_t Channels;
+	uint64_t FrameSize; // Minimum size of a slot
+};
+
+struct Request {
+	uint32_t Magic;
+	uint32_t Type;
+	uint32_t Slot; // For RegisterSlot, the number that the client will use for this slot, starting at 0
+	uint32_t Reserved;
+	uint64_t RequestID; // Echoed back in the reply
+};
+
+struct Reply {
+	uint32_t Magic;
+	uint32_t Type;
+	int32_t  Status;
+	uint32_t NumDetections;
+	uint64_t RequestID;
+	uint32_t Slot;
+	uint32_t Reserved;
+	uint64_t QueueNs; // Time from receiving the request to submitting it to the device
+	uint64_t InferNs; // Time from submitting to the device to completion
+};
+
+static_assert(sizeof(HelloMessage) == 32, "HelloMessage layout changed");
+static_assert(sizeof(Request) == 24, "Request layout changed");
+static_assert(sizeof(Reply) == 48, "Reply layout changed");
+
+const size_t MaxReplySize = sizeof(Reply) + MaxDetections * sizeof(detstream::PackedDetection);
+
+// Send one message, optionally passing a file descriptor along with it (fd = -1 for none).
+// MSG_NOSIGNAL, so that a vanished peer is an error instead of SIGPIPE.
+inline bool SendMessage(int sock, const void* msg, size_t size, int fd = -1, int flags = 0) {
+	struct iovec  iov = {(void*) msg, size};
+	struct msghdr m   = {};
+	m.msg_iov         = &iov;
+	m.msg_iovlen      = 1;
+	alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+	if (fd != -1) {
+		m.msg_control       = control;
+		m.msg_controllen    = sizeof(control);
+		struct cmsghdr* c   = CMSG_FIRSTHDR(&m);
+		c->cmsg_level       = SOL_SOCKET;
+		c->cmsg_type        = SCM_RIGHTS;
+		c->cmsg_len         = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(c), &fd, sizeof(int));
+	}
+	ssize_t n;
+	do {
+		n = sendmsg(sock, &m, flags | MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	return n == (ssize_t) size;
+}
+
+// Receive one message. If a file descriptor came with it, it is returned in fd (otherwise fd is -1),
+// and the caller owns it. Returns the size of the message, 0 if the peer has gone, or -1 on error.
+inline ssize_t ReceiveMessage(int sock, void* buf, size_t size, int& fd) {
+	fd                = -1;
+	struct iovec  iov = {buf, size};
+	struct msghdr m   = {};
+	m.msg_iov         = &iov;
+	m.msg_iovlen      = 1;
+	alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 4)];
+	m.msg_control    = control;
+	m.msg_controllen = sizeof(control);
+	ssize_t n;
+	do {
+		n = recvmsg(sock, &m, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0)
+		return -1;
+	for (struct cmsghdr* c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+			continue;
+		// Keep the first descriptor, and close any others that a misbehaving peer sent us
+		size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < count; i++) {
+			int received;
+			memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+			if (fd == -1)
+				fd = received;
+			else
+				close(received);
+		}
+	}
+	if (m.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+		if (fd != -1)
+			close(fd);
+		fd = -1;
+		return -1;
+	}
+	return n;
+}
+
+} // namespace daemonproto
+
+// A connection to yolov8-daemon.
+//
+//   DaemonClient client;
+//   client.Connect("/tmp/yolohailo.sock");
+//   int slot = client.AddSlot();
+//   memcpy(client.SlotData(slot), rgb, client.Info.FrameSize);
+//   client.Submit(slot, 1);
+//   client.Receive(reply, dets);
+class DaemonClient {
+public:
+	daemonproto::HelloMessage Info = {};
+
+	~DaemonClient() {
+		Close();
+	}
+
+	bool Connect(const std::string& socketPath) {
+		using namespace daemonproto;
+		Close();
+		struct sockaddr_un addr = {};
+		if (socketPath.size() >= sizeof(addr.sun_path))
+			return false;
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+		Sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (Sock == -1)
+			return false;
+		int fd = -1;
+		if (connect(Sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || ReceiveMessage(Sock, &Info, sizeof(Info), fd) != (ssize_t) sizeof(Info) ||
+		    Info.Magic != Magic || Info.Version != Version || (MessageType) Info.Type != MessageType::Hello) {
+			if (fd != -1)
+				close(fd);
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	// Create a shared memory slot for one input frame, and register it with the daemon.
+	// Returns the slot number, or -1 on failure.
+	int AddSlot() {
+		using namespace daemonproto;
+		if (Sock == -1 || Slots.size() >= MaxSlots)
+			return -1;
+		int fd = memfd_create("yolohailo-slot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (fd == -1)
+			return -1;
+		void* p = MAP_FAILED;
+		if (ftruncate(fd, Info.FrameSize) == 0 && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+			p = mmap(nullptr, Info.FrameSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		Request req = {Magic, (uint32_t) MessageType::RegisterSlot, (uint32_t) Slots.size(), 0, 0};
+		bool    ok  = p != MAP_FAILED && SendMessage(Sock, &req, sizeof(req), fd);
+		close(fd); // The mapping, and the daemon's copy of the descriptor, keep the memory alive
+		if (!ok) {
+			if (p != MAP_FAILED)
+				munmap(p, Info.FrameSize);
+			return -1;
+		}
+		Slots.push_back((uint8_t*) p);
+		return (int) Slots.size() - 1;
+	}
+
+	// The frame memory of a slot, which holds Info.FrameSize bytes
+	uint8_t* SlotData(int slot) { return Slots[slot]; }
+
+	// Ask the daemon to run inference on the frame in a slot. The reply comes back via Receive().
+	bool Submit(int slot, uint64_t requestID) {
+		using namespace daemonproto;
+		Request req = {Magic, (uint32_t) MessageType::Infer, (uint32_t) slot, 0, requestID};
+		return Sock != -1 && SendMessage(Sock, &req, sizeof(req));
+	}
+
+	// Block until the next reply arrives. Replies to a slot registration only arrive if it failed.
+	bool Receive(daemonproto::Reply& reply, std::vector<Detection>& dets) {
+		using namespace daemonproto;
+		ReplyBuf.resize(MaxReplySize);
+		int     fd = -1;
+		ssize_t n  = Sock == -1 ? -1 : ReceiveMessage(Sock, ReplyBuf.data(), ReplyBuf.size(), fd);
+		if (fd != -1)
+			close(fd);
+		if (n < (ssize_t) sizeof(Reply))
+			return false;
+		memcpy(&reply, ReplyBuf.data(), sizeof(reply));
+		if (reply.Magic != Magic || (MessageType) reply.Type != MessageType::Reply || reply.NumDetections > MaxDetections ||
+		    (size_t) n != sizeof(Reply) + reply.NumDetections * sizeof(detstream::PackedDetection))
+			return false;
+		dets.clear();
+		const detstream::PackedDetection* packed = (const detstream::PackedDetection*) (ReplyBuf.data() + sizeof(Reply));
+		for (uint32_t i = 0; i < reply.NumDetections; i++) {
+			const auto& d = packed[i];
+			dets.push_back({d.ClassID, d.Confidence, d.XMin, d.YMin, d.XMax, d.YMax});
+		}
+		return true;
+	}
+
+	int FD() const { return Sock; }
+
+	void Close() {
+		for (auto p : Slots)
+			munmap(p, Info.FrameSize);
+		Slots.clear();
+		if (Sock != -1)
+			close(Sock);
+		Sock = -1;
+	}
+
+private:
+	int                   Sock = -1;
+	std::vector<uint8_t*> Slots;
+	std::vector<uint8_t>  ReplyBuf;
+};
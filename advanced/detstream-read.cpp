@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../detection_stream.h"
+#include "../text_writer.h"
+
+// Reads a binary detection stream (see detection_stream.h), written by eg yolov8-pipeline --detections.
+// This is an example of an analytics process that consumes detections straight out of the mapping.
+// It has no dependency on HailoRT.
+
+// g++ -O2 -o detstream-read advanced/detstream-read.cpp && ./detstream-read detections.bin
+// ./detstream-read /dev/shm/detections --follow --print jsonl
+
+std::string streamFilename = "";
+bool        follow         = false; // Keep reading new frames from a ring buffer, until interrupted
+double      followSeconds  = 0;     // If > 0, stop following after this long
+std::string printFormat    = "";    // If not empty, print each detection as "text", "csv" or "jsonl"
+
+int run() {
+	DetectionStreamReader reader;
+	if (!reader.Open(streamFilename)) {
+		printf("Failed to open detection stream %s\n", streamFilename.c_str());
+		return 1;
+	}
+	DetectionFormat format  = DetectionFormat::Text;
+	bool            doPrint = printFormat != "";
+	if (doPrint && !ParseDetectionFormat(printFormat, format)) {
+		printf("Unknown print format '%s'\n", printFormat.c_str());
+		return 1;
+	}
+	if (reader.IsRing() && !follow)
+		reader.Rewind(); // Read what's in the buffer now
+
+	TextWriter out(STDOUT_FILENO);
+	if (doPrint)
+		WriteDetectionHeader(out, format);
+
+	detstream::FrameRecord                  header;
+	std::vector<detstream::PackedDetection> dets;
+	uint64_t                                nFrames = 0, nDets = 0, nTorn = 0;
+	auto                                    start = std::chrono::steady_clock::now();
+	while (true) {
+		const detstream::FrameRecord* r = reader.Next();
+		if (!r) {
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (!follow || (followSeconds > 0 && elapsed >= followSeconds))
+				break;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+		// Copy the frame out of the mapping, because a ring buffer writer may overwrite it at any moment
+		if (!reader.CopyLast(header, dets)) {
+			nTorn++;
+			continue;
+		}
+		if (doPrint) {
+			for (const auto& d : dets) {
+				Detection det = {d.ClassID, d.Confidence, d.XMin, d.YMin, d.XMax, d.YMax};
+				WriteDetection(out, format, header.FrameIndex, det, header.Width, header.Height);
+			}
+		}
+		nFrames++;
+		nDets += header.NumDetections;
+	}
+	out.Flush();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "Read %llu frames, %llu detections in %.3fs (%.0f frames/s)\n", (unsigned long long) nFrames, (unsigned long long) nDets, elapsed, nFrames / elapsed);
+	if (reader.Lost != 0 || nTorn != 0)
+		fprintf(stderr, "Fell behind the writer %llu times, and discarded %llu overwritten frames\n", (unsigned long long) reader.Lost, (unsigned long long) nTorn);
+	return 0;
+}
+
+void PrintHelp() {
+	printf("Usage: detstream-read <file> [options]\n");
+	printf("  --follow              Keep reading new frames from a ring buffer\n");
+	printf("  --seconds <n>         Stop following after n seconds\n");
+	printf("  --print <format>      Print every detection as text, csv or jsonl\n");
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--help" || arg == "-h") {
+			PrintHelp();
+			return 1;
+		} else if (arg == "--follow") {
+			follow = true;
+		} else if (arg == "--seconds" && next) {
+			followSeconds = atof(next);
+			i++;
+		} else if (arg == "--print" && next) {
+			printFormat = next;
+			i++;
+		} else if (arg[0] != '-' && streamFilename == "") {
+			streamFilename = arg;
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			PrintHelp();
+			return 1;
+		}
+	}
+	if (streamFilename == "") {
+		PrintHelp();
+		return 1;
+	}
+	return run();
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+// InferBackend for a real Hailo device, via HailoRT's async InferModel API.
+
+#include <hailo/hailort.h>
+#include <hailo/vdevice.hpp>
+#include <hailo/infer_model.hpp>
+#include <stdio.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "../model_cache.h"
+#include "backend.h"
+#include "telemetry.h"
+
+class HailoBackend : public InferBackend {
+public:
+	HailoBackend(hailort::VDevice* vdevice, const std::string& hefFile, float confidenceThreshold, float nmsIoUThreshold)
+	    : VDevice(vdevice), HefFile(hefFile), ConfidenceThreshold(confidenceThreshold), NMSIoUThreshold(nmsIoUThreshold) {}
+
+	~HailoBackend() override {
+		WaitIdle();
+	}
+
+	const char* Name() const override { return "hailo"; }
+
+	int Configure(int batchSize) override {
+		using namespace hailort;
+		WaitIdle();
+		Configured.reset();
+
+		// The HEF is only parsed the first time. After that, the same model is reconfigured.
+		hailo_status status = Cache.Get(*VDevice, HefFile, Model);
+		if (status != HAILO_SUCCESS) {
+			printf("Failed to create infer model\n");
+			return status;
+		}
+		Model->set_hw_latency_measurement_flags(HAILO_LATENCY_MEASURE);
+		Model->set_batch_size(batchSize);
+		Model->output()->set_nms_score_threshold(ConfidenceThreshold);
+		Model->output()->set_nms_iou_threshold(NMSIoUThreshold);
+
+		Expected<ConfiguredInferModel> configured_infer_model_exp = Model->configure();
+		if (!configured_infer_model_exp) {
+			printf("Failed to get configured infer model\n");
+			return configured_infer_model_exp.status();
+		}
+		Configured = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
+
+		auto queueSize = Configured->get_async_queue_size();
+		AsyncQueueSize = queueSize ? (uint32_t) queueSize.release() : (uint32_t) batchSize;
+
+		InputInfo = MakeInfo(Model->inputs()[0]);
+		OutputInfo.clear();
+		for (const auto& output_name : Model->get_output_names())
+			OutputInfo.push_back(MakeInfo(Model->output(output_name).release()));
+		return HAILO_SUCCESS;
+	}
+
+	const TensorInfo&              Input() const override { return InputInfo; }
+	const std::vector<TensorInfo>& Outputs() const override { return OutputInfo; }
+
+	uint32_t QueueSize() const override { return AsyncQueueSize; }
+
+	int WaitForAsyncReady(std::chrono::milliseconds timeout, uint32_t nFrames) override {
+		return Configured->wait_for_async_ready(timeout, nFrames);
+	}
+
+	// Bindings are created for every batch. This is cheap compared to the inference itself, and
+	// it means that the caller can use a different set of buffers every time.
+	int RunAsync(const std::vector<BackendFrame>& frames, BackendCallback done) override {
+		using namespace hailort;
+		std::vector<ConfiguredInferModel::Bindings> bindings;
+		for (const auto& frame : frames) {
+			Expected<ConfiguredInferModel::Bindings> bindings_exp = Configured->create_bindings();
+			if (!bindings_exp) {
+				printf("Failed to get infer model bindings\n");
+				return bindings_exp.status();
+			}
+			auto status = bindings_exp->input(InputInfo.Name)->set_buffer(MemoryView((void*) frame.Input, InputInfo.FrameSize));
+			if (status != HAILO_SUCCESS) {
+				printf("Failed to set memory buffer: %d\n", (int) status);
+				return status;
+			}
+			for (size_t i = 0; i < OutputInfo.size() && i < frame.Outputs.size(); i++) {
+				status = bindings_exp->output(OutputInfo[i].Name)->set_buffer(MemoryView(frame.Outputs[i], OutputInfo[i].FrameSize));
+				if (status != HAILO_SUCCESS) {
+					printf("Failed to set infer output buffer, status = %d\n", (int) status);
+					return status;
+				}
+			}
+			bindings.emplace_back(std::move(bindings_exp.release()));
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			InFlightBatches++;
+		}
+		Expected<AsyncInferJob> job_exp = Configured->run_async(bindings, [this, done](const AsyncInferCompletionInfo& completion_info) {
+			done(completion_info.status);
+			std::lock_guard<std::mutex> lock(Lock);
+			InFlightBatches--;
+			CV.notify_all();
+		});
+		if (!job_exp) {
+			std::lock_guard<std::mutex> lock(Lock);
+			InFlightBatches--;
+			printf("Failed to start async infer job, status = %d\n", (int) job_exp.status());
+			return job_exp.status();
+		}
+		// We track completion with our own counter, so the job doesn't need to be kept alive
+		job_exp->detach();
+		return HAILO_SUCCESS;
+	}
+
+	void WaitIdle() override {
+		std::unique_lock<std::mutex> lock(Lock);
+		CV.wait(lock, [&] { return InFlightBatches == 0; });
+	}
+
+	uint64_t DeviceLatencyNs() override {
+		return Configured ? QueryHwLatencyNs(*Configured) : 0;
+	}
+
+private:
+	hailort::VDevice*                              VDevice;
+	std::string                                    HefFile;
+	float                                          ConfidenceThreshold;
+	float                                          NMSIoUThreshold;
+	ModelCache                                     Cache;
+	std::shared_ptr<hailort::InferModel>           Model;
+	std::shared_ptr<hailort::ConfiguredInferModel> Configured;
+	uint32_t                                       AsyncQueueSize = 0;
+	TensorInfo                                     InputInfo;
+	std::vector<TensorInfo>                        OutputInfo;
+	std::mutex                                     Lock;
+	std::condition_variable                        CV;
+	int                                            InFlightBatches = 0;
+
+	static TensorInfo MakeInfo(const hailort::InferModel::InferStream& stream) {
+		TensorInfo                      info;
+		hailo_3d_image_shape_t          shape  = stream.shape();
+		hailo_format_t                  format = stream.format();
+		std::vector<hailo_quant_info_t> quant  = stream.get_quant_infos();
+		info.Name      = stream.name();
+		info.Height    = shape.height;
+		info.Width     = shape.width;
+		info.Features  = shape.features;
+		info.IsNMS     = format.order == HAILO_FORMAT_ORDER_HAILO_NMS;
+		info.FrameSize = stream.get_frame_size();
+		switch (format.type) {
+		case HAILO_FORMAT_TYPE_UINT16: info.Type = TensorType::UInt16; break;
+		case HAILO_FORMAT_TYPE_FLOAT32: info.Type = TensorType::Float32; break;
+		default: info.Type = TensorType::UInt8; break;
+		}
+		if (!quant.empty()) {
+			info.QpZp    = quant[0].qp_zp;
+			info.QpScale = quant[0].qp_scale;
+		}
+		return info;
+	}
+};
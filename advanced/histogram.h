@@ -0,0 +1,137 @@
+#pragma once
+
+// A fixed-memory, log-linear histogram in the style of HdrHistogram.
+//
+// Values are split into power-of-two ranges, and each range is divided into SubBuckets linear
+// buckets, so the relative error of any reported value is at most 1/SubBuckets (about 1.6%),
+// from 0 all the way up to 2^64. Values below SubBuckets are recorded exactly.
+//
+// Record() is lock free (a few relaxed atomic increments), so it can be called from HailoRT
+// callback threads without contention. To read the histogram, take a Snapshot, which is a plain
+// copy of the counts. Snapshots can be merged, eg to combine histograms from several threads.
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+class HdrHistogram {
+public:
+	static const int SubBucketBits = 6;
+	static const int SubBuckets    = 1 << SubBucketBits;
+	static const int NumBuckets    = (64 - SubBucketBits + 1) * SubBuckets;
+
+	static int BucketIndex(uint64_t v) {
+		if (v < SubBuckets)
+			return (int) v;
+		int msb = 63 - __builtin_clzll(v);
+		int sub = (int) (v >> (msb - SubBucketBits)) & (SubBuckets - 1);
+		return (msb - SubBucketBits + 1) * SubBuckets + sub;
+	}
+
+	// Lowest value that maps to the given bucket
+	static uint64_t BucketLow(int i) {
+		if (i < SubBuckets)
+			return (uint64_t) i;
+		int msb = i / SubBuckets + SubBucketBits - 1;
+		int sub = i & (SubBuckets - 1);
+		return ((uint64_t) (SubBuckets + sub)) << (msb - SubBucketBits);
+	}
+
+	// Middle of the range of values that map to the given bucket
+	static uint64_t BucketMid(int i) {
+		if (i < SubBuckets)
+			return (uint64_t) i;
+		int msb = i / SubBuckets + SubBucketBits - 1;
+		return BucketLow(i) + ((1ull << (msb - SubBucketBits)) >> 1);
+	}
+
+	// A plain, non-atomic copy of a histogram
+	class Snapshot {
+	public:
+		std::vector<uint64_t> Counts;
+		uint64_t              Count = 0;
+		uint64_t              Sum   = 0;
+		uint64_t              Min   = UINT64_MAX;
+		uint64_t              Max   = 0;
+
+		Snapshot() : Counts(NumBuckets, 0) {}
+
+		void Merge(const Snapshot& s) {
+			for (int i = 0; i < NumBuckets; i++)
+				Counts[i] += s.Counts[i];
+			Count += s.Count;
+			Sum += s.Sum;
+			Min = std::min(Min, s.Min);
+			Max = std::max(Max, s.Max);
+		}
+
+		double Mean() const { return Count == 0 ? 0 : (double) Sum / Count; }
+
+		// p is from 0 to 100. The result is clamped to the recorded min and max, so p100 is exact.
+		uint64_t Percentile(double p) const {
+			if (Count == 0)
+				return 0;
+			uint64_t target = (uint64_t) (p / 100.0 * Count + 0.5);
+			target          = std::max<uint64_t>(target, 1);
+			uint64_t seen   = 0;
+			for (int i = 0; i < NumBuckets; i++) {
+				seen += Counts[i];
+				if (seen >= target)
+					return std::min(std::max(BucketMid(i), Min), Max);
+			}
+			return Max;
+		}
+	};
+
+	void Record(uint64_t v, uint64_t count = 1) {
+		Counts[BucketIndex(v)].fetch_add(count, std::memory_order_relaxed);
+		TotalCount.fetch_add(count, std::memory_order_relaxed);
+		TotalSum.fetch_add(v * count, std::memory_order_relaxed);
+		uint64_t m = MinValue.load(std::memory_order_relaxed);
+		while (v < m && !MinValue.compare_exchange_weak(m, v, std::memory_order_relaxed)) {
+		}
+		m = MaxValue.load(std::memory_order_relaxed);
+		while (v > m && !MaxValue.compare_exchange_weak(m, v, std::memory_order_relaxed)) {
+		}
+	}
+
+	// If other threads are recording, then the snapshot may be very slightly inconsistent
+	// (eg Count may include a value that is not yet in Counts), but never wildly wrong.
+	Snapshot GetSnapshot() const {
+		Snapshot s;
+		for (int i = 0; i < NumBuckets; i++)
+			s.Counts[i] = Counts[i].load(std::memory_order_relaxed);
+		s.Count = TotalCount.load(std::memory_order_relaxed);
+		s.Sum   = TotalSum.load(std::memory_order_relaxed);
+		s.Min   = MinValue.load(std::memory_order_relaxed);
+		s.Max   = MaxValue.load(std::memory_order_relaxed);
+		return s;
+	}
+
+	// Convenience functions, each of which reads the histogram
+	uint64_t Count() const { return TotalCount.load(std::memory_order_relaxed); }
+	uint64_t Max() const { return MaxValue.load(std::memory_order_relaxed); }
+	double   Mean() const {
+		uint64_t n = Count();
+		return n == 0 ? 0 : (double) TotalSum.load(std::memory_order_relaxed) / n;
+	}
+	uint64_t Percentile(double p) const { return GetSnapshot().Percentile(p); }
+
+	// Not safe to call while other threads are recording
+	void Reset() {
+		for (auto& c : Counts)
+			c.store(0, std::memory_order_relaxed);
+		TotalCount = 0;
+		TotalSum   = 0;
+		MinValue   = UINT64_MAX;
+		MaxValue   = 0;
+	}
+
+private:
+	std::atomic<uint64_t> Counts[NumBuckets] = {};
+	std::atomic<uint64_t> TotalCount{0};
+	std::atomic<uint64_t> TotalSum{0};
+	std::atomic<uint64_t> MinValue{UINT64_MAX};
+	std::atomic<uint64_t> MaxValue{0};
+};
@@ -0,0 +1,489 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../dump.h"
+#include "../motion.h"
+#include "../nms.h"
+#include "../npy.h"
+#include "../seg.h"
+#include "../text_writer.h"
+#include "../tracker.h"
+#include "../video_reader.h"
+#include "../yuv.h"
+#include "allocator.h"
+#include "affinity.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+// Microbenchmarks for the CPU side of the pipeline. This has no dependency on HailoRT, so it
+// runs on any Linux machine.
+
+// g++ -O2 -o microbench advanced/microbench.cpp && ./microbench
+// ./microbench --filter NMS --cpu 3
+
+std::string imgFilename   = "test-image-640x640.jpg";
+std::string filter        = "";  // Only run benchmarks whose name contains this
+int         pinCpu        = -1;  // Core to pin the benchmark thread to. -1 = the last core.
+double      sampleSeconds = 0.1; // Minimum duration of each sample
+int         numSamples    = 9;   // We report the median and the fastest sample
+
+// Prevent the compiler from optimizing away a computed value
+template <typename T>
+inline void DoNotOptimize(const T& v) {
+	asm volatile("" : : "g"(&v) : "memory");
+}
+
+struct BenchStats {
+	double NsPerOp;     // Median
+	double NsPerOpBest; // Fastest sample
+	double Spread;      // (slowest - fastest) / median
+};
+
+// fn(n) must perform the operation n times.
+// bytesPerOp is used to report throughput, and may be zero.
+void Bench(const char* name, size_t bytesPerOp, std::function<void(size_t n)> fn) {
+	if (filter != "" && strstr(name, filter.c_str()) == nullptr)
+		return;
+
+	using clock = std::chrono::steady_clock;
+
+	// Calibrate the number of iterations so that each sample takes at least sampleSeconds
+	size_t n = 1;
+	while (true) {
+		auto start = clock::now();
+		fn(n);
+		double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+		if (elapsed >= sampleSeconds)
+			break;
+		double scale = elapsed > 0 ? sampleSeconds / elapsed * 1.2 : 100;
+		n            = std::max(n + 1, (size_t) (n * std::min(scale, 100.0)));
+	}
+
+	std::vector<double> samples;
+	for (int i = 0; i < numSamples; i++) {
+		auto start = clock::now();
+		fn(n);
+		samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / n);
+	}
+	std::sort(samples.begin(), samples.end());
+
+	BenchStats s;
+	s.NsPerOp     = samples[samples.size() / 2];
+	s.NsPerOpBest = samples[0];
+	s.Spread      = (samples.back() - samples[0]) / s.NsPerOp;
+
+	char throughput[64] = "";
+	if (bytesPerOp != 0)
+		snprintf(throughput, sizeof(throughput), "%10.1f MB/s", bytesPerOp / s.NsPerOp * 1e9 / (1024 * 1024));
+	printf("%-32s %12.1f ns/op %12.1f best %6.1f%% spread %s\n", name, s.NsPerOp, s.NsPerOpBest, 100 * s.Spread, throughput);
+}
+
+// Build a HAILO NMS buffer with boxesPerClass boxes in each of numClasses classes
+std::vector<float> MakeNMSBuffer(int numClasses, int maxBoxesPerClass, int boxesPerClass) {
+	// Same size as the real output buffer, which is (1 + 5 * maxBoxes) floats per class
+	std::vector<float> buf(numClasses * (1 + 5 * maxBoxesPerClass), 0.0f);
+	size_t             idx = 0;
+	for (int c = 0; c < numClasses; c++) {
+		buf[idx++] = (float) boxesPerClass;
+		for (int i = 0; i < boxesPerClass; i++) {
+			float x      = (float) ((c * 7 + i * 13) % 100) / 100;
+			buf[idx + 0] = x * 0.5f;
+			buf[idx + 1] = x * 0.4f;
+			buf[idx + 2] = x * 0.5f + 0.2f;
+			buf[idx + 3] = x * 0.4f + 0.3f;
+			buf[idx + 4] = 0.3f + 0.7f * x;
+			idx += 5;
+		}
+	}
+	return buf;
+}
+
+std::vector<uint8_t> ReadFile(const std::string& filename) {
+	std::vector<uint8_t> data;
+	FILE*                f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return data;
+	fseek(f, 0, SEEK_END);
+	data.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	if (fread(data.data(), 1, data.size(), f) != data.size())
+		data.clear();
+	fclose(f);
+	return data;
+}
+
+int run() {
+	int cpu = pinCpu >= 0 ? pinCpu : (int) sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if (PinThreadToCores({cpu}) != 0)
+		printf("Failed to pin to CPU %d\n", cpu);
+	else
+		printf("Pinned to CPU %d\n", cpu);
+
+	// JPEG decode. We decode from memory so that we're not measuring the filesystem.
+	std::vector<uint8_t> jpeg = ReadFile(imgFilename);
+	if (jpeg.empty()) {
+		printf("Failed to read %s\n", imgFilename.c_str());
+		return 1;
+	}
+	int w = 0, h = 0, chan = 0;
+	stbi_info_from_memory(jpeg.data(), (int) jpeg.size(), &w, &h, &chan);
+	Bench("stbi_load jpeg 640x640", w * h * 3, [&](size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			int            iw, ih, ic;
+			unsigned char* img = stbi_load_from_memory(jpeg.data(), (int) jpeg.size(), &iw, &ih, &ic, 3);
+			DoNotOptimize(img);
+			stbi_image_free(img);
+		}
+	});
+
+	// YUV to RGB, straight into a 640x640 input buffer: the row kernel on its own (SIMD and
+	// scalar), and fused with letterboxing, from a 640x480 I420 frame and a 1080p NV12 frame.
+	{
+		std::vector<uint8_t> yuv(1920 * 1080 * 3 / 2);
+		std::vector<uint8_t> rgb(640 * 640 * 3);
+		for (size_t i = 0; i < yuv.size(); i++)
+			yuv[i] = (uint8_t) (i * 7 + i / 1920);
+		const YUVCoeffs& c = BT601(false);
+		Bench("YUVRowToRGB 640x640", rgb.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				for (int row = 0; row < 640; row++)
+					YUVRowToRGB(yuv.data() + row * 640, yuv.data() + 640 * 640, yuv.data() + 640 * 640 + 640, rgb.data() + row * 640 * 3, 640, c);
+				DoNotOptimize(rgb.data());
+			}
+		});
+		Bench("YUVRowToRGBScalar 640x640", rgb.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				for (int row = 0; row < 640; row++)
+					YUVRowToRGBScalar(yuv.data() + row * 640, yuv.data() + 640 * 640, yuv.data() + 640 * 640 + 640, rgb.data() + row * 640 * 3, 640, c);
+				DoNotOptimize(rgb.data());
+			}
+		});
+		InputConverter conv;
+		Bench("I420 640x480 to 640x640", rgb.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				conv.Convert(YUVImage::I420(yuv.data(), 640, 480), rgb.data(), 640, 640);
+				DoNotOptimize(rgb.data());
+			}
+		});
+		Bench("NV12 1920x1080 to 640x640", rgb.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				conv.Convert(YUVImage::NV12(yuv.data(), 1920, 1080, 1920), rgb.data(), 640, 640);
+				DoNotOptimize(rgb.data());
+			}
+		});
+	}
+
+	// Motion detection on a 1080p luma plane: downscale 8x and compare in blocks with the
+	// reference. Every frame is compared with the same reference, which is what happens when the
+	// scene is static.
+	{
+		std::vector<uint8_t> luma(1920 * 1080);
+		for (size_t i = 0; i < luma.size(); i++)
+			luma[i] = (uint8_t) (i * 7 + i / 1920);
+		MotionDetector motion;
+		motion.Detect(luma.data(), 1920, 1080, 1920);
+		motion.Accept();
+		Bench("MotionDetector 1920x1080", luma.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++)
+				DoNotOptimize(motion.Detect(luma.data(), 1920, 1080, 1920));
+		});
+	}
+
+	// ByteTracker with a crowd of objects that move in straight lines. Every frame, a few of them
+	// are missed, and a few are detected with low confidence, so every stage of matching runs.
+	for (int objects : {20, 300}) {
+		std::vector<Detection> scene(objects);
+		std::vector<float>     vel(objects * 2);
+		uint32_t               seed = 1;
+		auto                   rnd  = [&]() { return (seed = seed * 1664525 + 1013904223) / 4294967296.0f; };
+		for (int i = 0; i < objects; i++) {
+			scene[i]       = {0, 0.8f, rnd(), rnd(), 0, 0};
+			scene[i].XMax  = scene[i].XMin + 0.02f + 0.02f * rnd();
+			scene[i].YMax  = scene[i].YMin + 0.04f + 0.03f * rnd();
+			vel[i * 2]     = (rnd() - 0.5f) * 0.004f;
+			vel[i * 2 + 1] = (rnd() - 0.5f) * 0.004f;
+		}
+		ByteTracker            tracker;
+		std::vector<Detection> dets;
+		std::string            name = "ByteTracker " + std::to_string(objects) + " objects";
+		Bench(name.c_str(), 0, [&](size_t n) {
+			for (size_t f = 0; f < n; f++) {
+				dets.clear();
+				for (int i = 0; i < objects; i++) {
+					Detection& d = scene[i];
+					d.XMin += vel[i * 2];
+					d.XMax += vel[i * 2];
+					d.YMin += vel[i * 2 + 1];
+					d.YMax += vel[i * 2 + 1];
+					float r = rnd();
+					if (r < 0.05f)
+						continue;
+					dets.push_back(d);
+					dets.back().Confidence = r < 0.1f ? 0.3f : 0.8f;
+				}
+				DoNotOptimize(tracker.Update(dets).data());
+			}
+		});
+	}
+
+	// YOLOv8-seg masks from 160x160x32 prototypes: a typical frame with 20 objects of various sizes
+	// (bitmask and RLE), the same with soft masks, and one object that covers the whole frame. Like
+	// real prototypes, the synthetic ones are smooth, so the masks are blobs rather than noise.
+	{
+		std::vector<uint8_t> proto(160 * 160 * 32);
+		uint32_t             seed = 1;
+		auto                 rnd  = [&]() { return (seed = seed * 1664525 + 1013904223) / 4294967296.0f; };
+		for (int c = 0; c < 32; c++) {
+			float fx = 0.02f + 0.1f * rnd(), fy = 0.02f + 0.1f * rnd(), phase = 6.3f * rnd();
+			for (int i = 0; i < 160 * 160; i++)
+				proto[i * 32 + c] = (uint8_t) (128 + 100 * sinf(fx * (i % 160) + phase) * cosf(fy * (i / 160)));
+		}
+		MaskPrototypes         protos = {proto.data(), 160, 160, 128, 0.02f};
+		std::vector<Detection> boxes(20);
+		std::vector<float>     coeffs(boxes.size() * MaskDecoder::NumCoefficients);
+		for (auto& b : boxes) {
+			b      = {0, 0.8f, rnd() * 0.8f, rnd() * 0.8f, 0, 0};
+			b.XMax = b.XMin + 0.03f + 0.2f * rnd();
+			b.YMax = b.YMin + 0.05f + 0.2f * rnd();
+		}
+		for (auto& c : coeffs)
+			c = rnd() - 0.5f;
+		MaskDecoder           decoder;
+		SegMask               mask;
+		std::vector<uint8_t>  probs;
+		std::vector<uint32_t> counts;
+		Bench("MaskDecoder 20 objects + RLE", 0, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				for (size_t b = 0; b < boxes.size(); b++) {
+					decoder.Decode(boxes[b], &coeffs[b * MaskDecoder::NumCoefficients], protos, mask);
+					EncodeMaskRLE(mask, counts);
+				}
+				DoNotOptimize(counts.data());
+			}
+		});
+		Bench("MaskDecoder 20 objects soft", 0, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				for (size_t b = 0; b < boxes.size(); b++)
+					decoder.DecodeSoft(boxes[b], &coeffs[b * MaskDecoder::NumCoefficients], protos, mask, probs);
+				DoNotOptimize(probs.data());
+			}
+		});
+		Detection whole = {0, 0.8f, 0, 0, 1, 1};
+		Bench("MaskDecoder 160x160", proto.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				decoder.Decode(whole, coeffs.data(), protos, mask);
+				DoNotOptimize(mask.Bits.data());
+			}
+		});
+	}
+
+	// NMS parsing, with a typical frame (a handful of boxes), and a crowded frame
+	std::vector<Detection> dets;
+	dets.reserve(80 * 100);
+	for (int boxes : {0, 1, 20}) {
+		std::vector<float> nms      = MakeNMSBuffer(80, 100, boxes);
+		size_t             consumed = ParseHailoNMS(nms.data(), 80, nms.size(), 0.5f, dets);
+		std::string        name     = "ParseHailoNMS " + std::to_string(boxes) + " boxes/class";
+		Bench(name.c_str(), consumed * sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				dets.clear();
+				ParseHailoNMS(nms.data(), 80, nms.size(), 0.5f, dets);
+				DoNotOptimize(dets.data());
+			}
+		});
+	}
+
+	// Printing 20 detections per frame to /dev/null: printf (the way yolov8.cpp used to do it),
+	// versus TextWriter, which formats with to_chars and does one write() per 64KB.
+	{
+		std::vector<float> nms = MakeNMSBuffer(80, 100, 1);
+		dets.clear();
+		ParseHailoNMS(nms.data(), 80, nms.size(), 0.0f, dets);
+		dets.resize(20);
+		auto outputSize = [&](DetectionFormat format) {
+			TextWriter sizer(-1);
+			for (const auto& d : dets)
+				WriteDetection(sizer, format, 0, d, 640, 640);
+			return sizer.Size();
+		};
+		FILE* devNull = fopen("/dev/null", "w");
+		Bench("printf 20 detections", outputSize(DetectionFormat::Text), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				for (const auto& d : dets)
+					fprintf(devNull, "class: %d, confidence: %.2f, %.0f,%.0f - %.0f,%.0f\n", d.ClassID, d.Confidence, d.XMin * 640, d.YMin * 640, d.XMax * 640, d.YMax * 640);
+			}
+			fflush(devNull);
+		});
+		fclose(devNull);
+
+		int fd = open("/dev/null", O_WRONLY);
+		for (auto format : {DetectionFormat::Text, DetectionFormat::CSV, DetectionFormat::JSONL}) {
+			const char* names[] = {"TextWriter text 20 detections", "TextWriter csv 20 detections", "TextWriter jsonl 20 detections"};
+			TextWriter  out(fd);
+			Bench(names[(int) format], outputSize(format), [&](size_t n) {
+				for (size_t i = 0; i < n; i++) {
+					for (const auto& d : dets)
+						WriteDetection(out, format, i, d, 640, 640);
+				}
+				out.Flush();
+			});
+		}
+		close(fd);
+	}
+
+	// PageAlignedAllocator, with the buffer sizes used for one 640x640 input and one NMS output
+	{
+		PageAlignedAllocator alloc;
+		Bench("PageAlignedAllocator reuse", 0, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				void* a = alloc.Alloc(1228800);
+				void* b = alloc.Alloc(160320);
+				DoNotOptimize(a);
+				DoNotOptimize(b);
+				alloc.Free(b);
+				alloc.Free(a);
+			}
+		});
+	}
+	{
+		// The worst case for this allocator: 64 live buffers, so every Alloc/Free scans the lists
+		PageAlignedAllocator alloc;
+		std::vector<void*>   live;
+		for (int i = 0; i < 64; i++)
+			live.push_back(alloc.Alloc(4096 * (i + 1)));
+		Bench("PageAlignedAllocator 64 live", 0, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				size_t j = i % live.size();
+				alloc.Free(live[j]);
+				live[j] = alloc.Alloc(4096 * (j + 1));
+			}
+		});
+		for (void* p : live)
+			alloc.Free(p);
+	}
+
+	// DumpFloat32 on an 80x100 block of floats
+	{
+		std::vector<float> m(80 * 100);
+		for (size_t i = 0; i < m.size(); i++)
+			m[i] = (float) i / 37;
+		size_t outBytes = DumpFloat32(m.data(), 100, 100, 80, 1.0f).size();
+		Bench("DumpFloat32 80x100", outBytes, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				std::string s = DumpFloat32(m.data(), 100, 100, 80, 1.0f);
+				DoNotOptimize(s.data());
+			}
+		});
+	}
+
+	// Saving a whole NMS output buffer (80 x 501 floats) as .npy, and loading it back.
+	// The file goes to /dev/shm if possible, so that we're measuring our code rather than a disk.
+	{
+		std::vector<size_t> shape = {80, 501};
+		std::vector<float>  m(80 * 501);
+		for (size_t i = 0; i < m.size(); i++)
+			m[i] = (float) i / 37;
+		std::string filename = access("/dev/shm", W_OK) == 0 ? "/dev/shm/microbench.npy" : "/tmp/microbench.npy";
+		Bench("NpyWrite 80x501", m.size() * sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++)
+				NpyWrite(filename, "<f4", shape, m.data(), m.size() * sizeof(float));
+		});
+		Bench("NpyFile open 80x501", m.size() * sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				NpyFile f;
+				f.Open(filename);
+				DoNotOptimize(f.Data);
+			}
+		});
+		unlink(filename.c_str());
+	}
+
+	// Splitting an MJPEG file into frames. The last frame ends exactly at the end of the file,
+	// which must not stop us from finding its EOI, so we check that before timing anything.
+	{
+		const int            numFrames = 8;
+		std::vector<uint8_t> mjpeg;
+		for (int i = 0; i < numFrames; i++)
+			mjpeg.insert(mjpeg.end(), jpeg.begin(), jpeg.end());
+		std::string filename = access("/dev/shm", W_OK) == 0 ? "/dev/shm/microbench.mjpeg" : "/tmp/microbench.mjpeg";
+		FILE*       f        = fopen(filename.c_str(), "wb");
+		if (!f || fwrite(mjpeg.data(), 1, mjpeg.size(), f) != mjpeg.size()) {
+			printf("Failed to write %s\n", filename.c_str());
+			if (f)
+				fclose(f);
+			return 1;
+		}
+		fclose(f);
+		VideoReader video;
+		if (!video.Open(filename)) {
+			printf("Failed to open %s\n", filename.c_str());
+			unlink(filename.c_str());
+			return 1;
+		}
+		VideoFrame frame;
+		int        frames = 0;
+		while (video.Next(frame))
+			frames++;
+		if (frames != numFrames || video.SkippedBytes != 0) {
+			printf("VideoReader split %d JPEGs into %d frames, skipping %d bytes\n", numFrames, frames, (int) video.SkippedBytes);
+			unlink(filename.c_str());
+			return 1;
+		}
+		Bench("VideoReader MJPEG 8 frames", mjpeg.size(), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				video.Rewind();
+				while (video.Next(frame))
+					DoNotOptimize(frame.Data);
+			}
+		});
+		unlink(filename.c_str());
+	}
+
+	return 0;
+}
+
+void PrintHelp() {
+	printf("Usage: microbench [options]\n");
+	printf("  --filter <text>       Only run benchmarks whose name contains text\n");
+	printf("  --cpu <n>             Pin to this core (default: the last core)\n");
+	printf("  --image <file>        JPEG to decode (default %s)\n", imgFilename.c_str());
+	printf("  --samples <n>         Number of samples per benchmark (default %d)\n", numSamples);
+	printf("  --sample-time <sec>   Minimum duration of each sample (default %.2f)\n", sampleSeconds);
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (next == nullptr || arg == "--help" || arg == "-h") {
+			PrintHelp();
+			return 1;
+		} else if (arg == "--filter") {
+			filter = next;
+		} else if (arg == "--cpu") {
+			pinCpu = atoi(next);
+		} else if (arg == "--image") {
+			imgFilename = next;
+		} else if (arg == "--samples") {
+			numSamples = std::max(1, atoi(next));
+		} else if (arg == "--sample-time") {
+			sampleSeconds = atof(next);
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			PrintHelp();
+			return 1;
+		}
+		i++;
+	}
+	return run();
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+// Compare benchmark results against a stored baseline, and decide whether any metric has
+// regressed by more than measurement noise.
+//
+// A result is a flat JSON object of strings and numbers, such as those written by yolov8-fps --json.
+// If a metric "x" is accompanied by "x_stddev" and the object has "runs" > 1 (ie the benchmark
+// was repeated), then we use Welch's t-test to decide whether a change is real. Without that,
+// we can only use the relative threshold.
+// A change is flagged as a regression if it is worse than the relative threshold AND (when
+// variance is known) statistically significant.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchRecord {
+	std::map<std::string, std::string> Strings;
+	std::map<std::string, double>      Numbers;
+
+	double Number(const std::string& key, double defaultValue = 0) const {
+		auto it = Numbers.find(key);
+		return it == Numbers.end() ? defaultValue : it->second;
+	}
+	std::string String(const std::string& key) const {
+		auto it = Strings.find(key);
+		return it == Strings.end() ? "" : it->second;
+	}
+};
+
+// Returns s with the characters that may not appear in a JSON string escaped, but without the
+// surrounding quotes. Bytes >= 0x80 are copied as they are, so UTF-8 stays UTF-8.
+inline std::string JSONEscape(const std::string& s) {
+	std::string out;
+	out.reserve(s.size());
+	for (char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if ((unsigned char) c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char) c);
+				out += buf;
+			} else {
+				out += c;
+			}
+		}
+	}
+	return out;
+}
+
+// Parses a single flat object, or an array of flat objects. Nested values are not supported.
+// Returns false on a syntax error.
+inline bool ParseBenchJSON(const std::string& text, std::vector<BenchRecord>& records) {
+	size_t i = 0;
+
+	// Commas are treated as whitespace, which is fine for the flat objects that we write
+	auto skipSpace = [&]() {
+		while (i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r' || text[i] == ','))
+			i++;
+	};
+	auto parseHex4 = [&](size_t at, uint32_t& v) -> bool {
+		if (at + 4 > text.size())
+			return false;
+		v = 0;
+		for (size_t j = at; j < at + 4; j++) {
+			char c = text[j];
+			if (!isxdigit((unsigned char) c))
+				return false;
+			v = v * 16 + (isdigit((unsigned char) c) ? c - '0' : (tolower((unsigned char) c) - 'a' + 10));
+		}
+		return true;
+	};
+	auto parseString = [&](std::string& out) -> bool {
+		if (i >= text.size() || text[i] != '"')
+			return false;
+		out.clear();
+		for (i++; i < text.size(); i++) {
+			char c = text[i];
+			if (c == '"') {
+				i++;
+				return true;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+			if (++i >= text.size())
+				return false;
+			switch (text[i]) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32_t cp = 0, low = 0;
+				if (!parseHex4(i + 1, cp))
+					return false;
+				i += 4;
+				// A surrogate pair is two escapes
+				if (cp >= 0xD800 && cp <= 0xDBFF && text.compare(i + 1, 2, "\\u") == 0 && parseHex4(i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				}
+				// UTF-8
+				if (cp < 0x80) {
+					out += (char) cp;
+				} else if (cp < 0x800) {
+					out += (char) (0xC0 | (cp >> 6));
+					out += (char) (0x80 | (cp & 0x3F));
+				} else if (cp < 0x10000) {
+					out += (char) (0xE0 | (cp >> 12));
+					out += (char) (0x80 | ((cp >> 6) & 0x3F));
+					out += (char) (0x80 | (cp & 0x3F));
+				} else {
+					out += (char) (0xF0 | (cp >> 18));
+					out += (char) (0x80 | ((cp >> 12) & 0x3F));
+					out += (char) (0x80 | ((cp >> 6) & 0x3F));
+					out += (char) (0x80 | (cp & 0x3F));
+				}
+				break;
+			}
+			default: return false;
+			}
+		}
+		return false;
+	};
+
+	skipSpace();
+	bool isArray = i < text.size() && text[i] == '[';
+	if (isArray)
+		i++;
+	while (true) {
+		skipSpace();
+		if (i >= text.size())
+			return !isArray;
+		if (text[i] == ']')
+			return isArray;
+		if (text[i] != '{')
+			return false;
+		i++;
+		BenchRecord r;
+		while (true) {
+			skipSpace();
+			if (i >= text.size())
+				return false;
+			if (text[i] == '}') {
+				i++;
+				break;
+			}
+			std::string key;
+			if (!parseString(key))
+				return false;
+			skipSpace();
+			if (i >= text.size() || text[i] != ':')
+				return false;
+			i++;
+			skipSpace();
+			if (i < text.size() && text[i] == '"') {
+				std::string value;
+				if (!parseString(value))
+					return false;
+				r.Strings[key] = value;
+			} else {
+				const char* start = text.c_str() + i;
+				char*       end   = nullptr;
+				double      v     = strtod(start, &end);
+				if (end == start)
+					return false;
+				r.Numbers[key] = v;
+				i += end - start;
+			}
+		}
+		records.push_back(r);
+	}
+}
+
+inline bool LoadBenchJSON(const std::string& filename, std::vector<BenchRecord>& records) {
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+	std::string text;
+	char        buf[4096];
+	size_t      n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	return ParseBenchJSON(text, records);
+}
+
+struct MetricSpec {
+	const char* Name;
+	bool        HigherIsBetter;
+};
+
+struct MetricComparison {
+	std::string Metric;
+	double      Baseline   = 0;
+	double      Current    = 0;
+	double      Change     = 0; // Relative change, positive = better
+	double      T          = 0; // Welch's t statistic, or 0 if variance is unknown
+	bool        Regression = false;
+	bool        Improved   = false;
+};
+
+// threshold is the relative change (eg 0.05 for 5%) that is considered significant.
+// tCritical is the t statistic required to reject noise. 2.0 is roughly 95% confidence
+// for a handful of runs on each side.
+inline std::vector<MetricComparison> CompareBenchRecords(const BenchRecord& baseline, const BenchRecord& current, const std::vector<MetricSpec>& metrics, double threshold, double tCritical = 2.0) {
+	std::vector<MetricComparison> out;
+	double                        nBase = baseline.Number("runs", 1);
+	double                        nCur  = current.Number("runs", 1);
+	for (const auto& m : metrics) {
+		if (baseline.Numbers.count(m.Name) == 0 || current.Numbers.count(m.Name) == 0)
+			continue;
+		MetricComparison c;
+		c.Metric   = m.Name;
+		c.Baseline = baseline.Number(m.Name);
+		c.Current  = current.Number(m.Name);
+		if (c.Baseline == 0)
+			continue;
+		double delta = m.HigherIsBetter ? c.Current - c.Baseline : c.Baseline - c.Current;
+		c.Change     = delta / fabs(c.Baseline);
+
+		bool   significant = true;
+		double sdBase      = baseline.Number(std::string(m.Name) + "_stddev", -1);
+		double sdCur       = current.Number(std::string(m.Name) + "_stddev", -1);
+		if (nBase > 1 && nCur > 1 && sdBase >= 0 && sdCur >= 0) {
+			double se   = sqrt(sdBase * sdBase / nBase + sdCur * sdCur / nCur);
+			c.T         = se > 0 ? delta / se : (delta == 0 ? 0 : (delta > 0 ? INFINITY : -INFINITY));
+			significant = fabs(c.T) >= tCritical;
+		}
+		c.Regression = significant && c.Change <= -threshold;
+		c.Improved   = significant && c.Change >= threshold;
+		out.push_back(c);
+	}
+	return out;
+}
+
+// Prints the comparison, and returns true if any metric regressed
+inline bool PrintBenchComparison(const std::string& title, const std::vector<MetricComparison>& comparisons) {
+	bool anyRegression = false;
+	printf("%s\n", title.c_str());
+	printf("  %-18s %12s %12s %9s %8s\n", "metric", "baseline", "current", "change", "t");
+	for (const auto& c : comparisons) {
+		const char* verdict = c.Regression ? "REGRESSION" : (c.Improved ? "improved" : "");
+		printf("  %-18s %12.3f %12.3f %+8.1f%% %8.2f %s\n", c.Metric.c_str(), c.Baseline, c.Current, 100 * c.Change, c.T, verdict);
+		anyRegression |= c.Regression;
+	}
+	return anyRegression;
+}
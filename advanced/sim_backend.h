@@ -0,0 +1,239 @@
+#pragma once
+
+// A software stand-in for a Hailo device, running a YOLOv8 model with on-chip NMS.
+//
+// Batches are processed one at a time, in submission order, by a single "device" thread that
+// sleeps for the modelled latency of each batch. The async queue holds QueueDepth batches, and
+// WaitForAsyncReady() blocks when it is full, just like the real thing. Outputs are filled in the
+// HAILO NMS layout, either with synthetic boxes, or with a recorded output buffer.
+//
+// Nothing here touches HailoRT, so pipelines built on InferBackend can be measured anywhere.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "backend.h"
+
+class SimBackend : public InferBackend {
+public:
+	static const int ErrTimeout = -1;
+	static const int ErrInvalid = -2;
+
+	// Latency model. Each batch takes FixedMs + PerFrameMs * batchSize, plus gaussian jitter.
+	double FixedMs    = 0.5;
+	double PerFrameMs = 3.0;
+	double JitterMs   = 0;
+	int    QueueDepth = 4; // Number of batches that can be in flight
+
+	// Network shape
+	int InputWidth       = 640;
+	int InputHeight      = 640;
+	int NumClasses       = 80;
+	int MaxBoxesPerClass = 100;
+
+	// Number of synthetic boxes in each frame. Ignored if RecordedNMS is not empty.
+	int BoxesPerFrame = 5;
+
+	// If not empty, this is copied into every NMS output, instead of synthetic boxes
+	std::vector<uint8_t> RecordedNMS;
+
+	~SimBackend() override {
+		Stop();
+	}
+
+	const char* Name() const override { return "sim"; }
+
+	// Load a raw HAILO NMS output buffer, such as one written by --record.
+	// Returns false if the file is missing, or is not the size of an output frame.
+	bool LoadRecordedNMS(const std::string& filename) {
+		FILE* f = fopen(filename.c_str(), "rb");
+		if (!f)
+			return false;
+		std::vector<uint8_t> data(NMSFrameSize());
+		bool                 ok = fread(data.data(), 1, data.size(), f) == data.size() && fgetc(f) == EOF;
+		fclose(f);
+		if (ok)
+			RecordedNMS = std::move(data);
+		return ok;
+	}
+
+	int Configure(int batchSize) override {
+		if (batchSize < 1)
+			return ErrInvalid;
+		Stop();
+		BatchSize = batchSize;
+
+		InputInfo           = TensorInfo();
+		InputInfo.Name      = "sim/input_layer1";
+		InputInfo.Height    = InputHeight;
+		InputInfo.Width     = InputWidth;
+		InputInfo.Features  = 3;
+		InputInfo.Type      = TensorType::UInt8;
+		InputInfo.FrameSize = (size_t) InputWidth * InputHeight * 3;
+
+		TensorInfo nms;
+		nms.Name      = "sim/yolov8_nms_postprocess";
+		nms.Height    = NumClasses;
+		nms.Width     = MaxBoxesPerClass;
+		nms.Type      = TensorType::Float32;
+		nms.IsNMS     = true;
+		nms.FrameSize = NMSFrameSize();
+		OutputInfo    = {nms};
+
+		Stopping = false;
+		Device   = std::thread([this] { DeviceThread(); });
+		return 0;
+	}
+
+	const TensorInfo&              Input() const override { return InputInfo; }
+	const std::vector<TensorInfo>& Outputs() const override { return OutputInfo; }
+
+	uint32_t QueueSize() const override { return (uint32_t) (QueueDepth * BatchSize); }
+
+	int WaitForAsyncReady(std::chrono::milliseconds timeout, uint32_t nFrames) override {
+		std::unique_lock<std::mutex> lock(Lock);
+		bool                         ready = CV.wait_for(lock, timeout, [&] { return InFlightFrames + nFrames <= QueueSize(); });
+		return ready ? 0 : ErrTimeout;
+	}
+
+	int RunAsync(const std::vector<BackendFrame>& frames, BackendCallback done) override {
+		if (frames.empty() || frames.size() > (size_t) BatchSize || !Device.joinable())
+			return ErrInvalid;
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			if (InFlightFrames + frames.size() > QueueSize())
+				return ErrInvalid;
+			InFlightFrames += (uint32_t) frames.size();
+			Queue.push_back({frames, std::move(done)});
+		}
+		CV.notify_all();
+		return 0;
+	}
+
+	void WaitIdle() override {
+		std::unique_lock<std::mutex> lock(Lock);
+		CV.wait(lock, [&] { return InFlightFrames == 0; });
+	}
+
+	uint64_t DeviceLatencyNs() override {
+		std::lock_guard<std::mutex> lock(Lock);
+		return NumFrames == 0 ? 0 : TotalLatencyNs / NumFrames;
+	}
+
+private:
+	struct Job {
+		std::vector<BackendFrame> Frames;
+		BackendCallback           Done;
+	};
+
+	int                     BatchSize = 1;
+	TensorInfo              InputInfo;
+	std::vector<TensorInfo> OutputInfo;
+	std::thread             Device;
+	std::mutex              Lock;
+	std::condition_variable CV;
+	std::deque<Job>         Queue;
+	uint32_t                InFlightFrames = 0;
+	bool                    Stopping       = false;
+	uint64_t                NumFrames      = 0;
+	uint64_t                TotalLatencyNs = 0;
+	uint64_t                FrameCounter   = 0; // Seeds the synthetic boxes, so that they move around
+
+	size_t NMSFrameSize() const {
+		return (size_t) NumClasses * (1 + 5 * MaxBoxesPerClass) * sizeof(float);
+	}
+
+	// Finish the jobs that are in flight, and stop the device thread
+	void Stop() {
+		if (!Device.joinable())
+			return;
+		WaitIdle();
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			Stopping = true;
+		}
+		CV.notify_all();
+		Device.join();
+	}
+
+	void DeviceThread() {
+		std::mt19937                     rng(1234);
+		std::normal_distribution<double> jitter(0, 1);
+		std::vector<uint32_t>            classCounts(NumClasses);
+		auto                             deviceFreeAt = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(Lock);
+		while (true) {
+			CV.wait(lock, [&] { return Stopping || !Queue.empty(); });
+			if (Queue.empty())
+				return;
+			Job job = std::move(Queue.front());
+			Queue.pop_front();
+			lock.unlock();
+
+			// The device starts on this batch as soon as it has finished the previous one
+			double ms      = FixedMs + PerFrameMs * job.Frames.size() + (JitterMs > 0 ? JitterMs * jitter(rng) : 0);
+			auto   latency = std::chrono::nanoseconds((int64_t) (std::max(ms, 0.0) * 1e6));
+			auto   start   = std::max(deviceFreeAt, std::chrono::steady_clock::now());
+			deviceFreeAt   = start + latency;
+			std::this_thread::sleep_until(deviceFreeAt);
+
+			for (const auto& frame : job.Frames) {
+				for (size_t i = 0; i < frame.Outputs.size() && i < OutputInfo.size(); i++)
+					FillNMS((float*) frame.Outputs[i], classCounts);
+				FrameCounter++;
+			}
+
+			lock.lock();
+			NumFrames += job.Frames.size();
+			TotalLatencyNs += latency.count();
+			lock.unlock();
+
+			job.Done(0);
+
+			lock.lock();
+			InFlightFrames -= (uint32_t) job.Frames.size();
+			CV.notify_all();
+		}
+	}
+
+	// Write BoxesPerFrame boxes in the HAILO NMS layout: for each class, the number of boxes,
+	// followed by (ymin, xmin, ymax, xmax, confidence) for each box.
+	void FillNMS(float* out, std::vector<uint32_t>& classCounts) {
+		if (!RecordedNMS.empty()) {
+			memcpy(out, RecordedNMS.data(), RecordedNMS.size());
+			return;
+		}
+		// Each box keeps its class from frame to frame, so that it can be tracked
+		auto classOf = [&](int box) { return (int) ((box * 13) % NumClasses); };
+		std::fill(classCounts.begin(), classCounts.end(), 0);
+		for (int b = 0; b < BoxesPerFrame; b++)
+			classCounts[classOf(b)]++;
+
+		size_t idx = 0;
+		for (int c = 0; c < NumClasses; c++) {
+			uint32_t n = std::min<uint32_t>(classCounts[c], MaxBoxesPerClass);
+			out[idx++] = (float) n;
+			for (int b = 0; b < BoxesPerFrame && n > 0; b++) {
+				if (classOf(b) != c)
+					continue;
+				// Drift slowly across the frame, so that consecutive frames look like a video
+				float x      = (float) ((FrameCounter + b * 37) % 100) / 100;
+				float y      = (float) (b * 53 % 100) / 100;
+				out[idx + 0] = y * 0.8f;
+				out[idx + 1] = x * 0.8f;
+				out[idx + 2] = y * 0.8f + 0.2f;
+				out[idx + 3] = x * 0.8f + 0.2f;
+				out[idx + 4] = 0.5f + 0.5f * (float) (b % 10) / 10;
+				idx += 5;
+				n--;
+			}
+		}
+	}
+};
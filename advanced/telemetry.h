@@ -0,0 +1,171 @@
+#pragma once
+
+// Counters and histograms that tell you whether an async pipeline is host-bound or device-bound.
+//
+// We measure three things:
+// 1. How long wait_for_async_ready() blocks before each submission. If this is frequently
+//    non-zero, then the device (or its queue) is the bottleneck.
+// 2. How many frames are in flight at the moment of each submission. If this is usually below
+//    the async queue size, then the host isn't feeding the device fast enough.
+// 3. The delay between a job's completion callback and the moment the host consumes its
+//    output. If this is large, then postprocessing is the bottleneck.
+//
+// All Record functions are safe to call from any thread, including HailoRT callback threads.
+
+#include <hailo/hailort.h>
+#include <hailo/infer_model.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "histogram.h"
+
+inline uint64_t TelemetryNowNs() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns HailoRT's running average of on-device latency per frame, or 0 if it isn't available.
+// This is only measured if the model was created with set_hw_latency_measurement_flags(HAILO_LATENCY_MEASURE).
+inline uint64_t QueryHwLatencyNs(hailort::ConfiguredInferModel& model) {
+	auto measurement = model.get_hw_latency_measurement();
+	if (!measurement)
+		return 0;
+	return (uint64_t) measurement->avg_hw_latency.count();
+}
+
+// Splits the end-to-end latency of each job (submission to completion callback) into three parts,
+// assuming that the device processes jobs in the order that they were submitted:
+//   Queue:  Time spent waiting for the previous job to complete
+//   Device: On-device latency, as measured by HailoRT
+//   Host:   The remainder, which is transfer, driver, and HailoRT overhead
+// HailoRT measures the device latency per frame, so it is scaled by the frames in the job. The
+// device may overlap the frames of a batch, so that is an upper bound, and it is capped at the
+// job's service time. Jobs must be recorded in submission order. Not thread safe.
+class LatencyBreakdown {
+public:
+	HdrHistogram EndToEndNs;
+	HdrHistogram QueueNs;
+	HdrHistogram DeviceNs;
+	HdrHistogram HostNs;
+
+	void Record(uint64_t submittedAt, uint64_t completedAt, uint64_t hwLatencyPerFrameNs, uint32_t frames) {
+		uint64_t start   = std::max(submittedAt, PrevCompletedAt);
+		uint64_t service = completedAt > start ? completedAt - start : 0;
+		uint64_t device  = std::min(service, hwLatencyPerFrameNs * frames);
+		EndToEndNs.Record(completedAt - submittedAt);
+		QueueNs.Record(start - submittedAt);
+		DeviceNs.Record(device);
+		HostNs.Record(service - device);
+		PrevCompletedAt = completedAt;
+	}
+
+	void Reset() {
+		EndToEndNs.Reset();
+		QueueNs.Reset();
+		DeviceNs.Reset();
+		HostNs.Reset();
+	}
+
+private:
+	uint64_t PrevCompletedAt = 0;
+};
+
+class PipelineTelemetry {
+public:
+	// A point-in-time copy of the headline numbers
+	struct Snapshot {
+		uint64_t Submissions;
+		uint64_t BlockedSubmissions; // Submissions where wait_for_async_ready() blocked
+		double   SubmitWaitMeanUs;
+		uint64_t SubmitWaitP99Us;
+		uint64_t SubmitWaitMaxUs;
+		double   InFlightMean;
+		uint64_t InFlightMax;
+		double   ConsumeDelayMeanUs;
+		uint64_t ConsumeDelayP99Us;
+		uint64_t ConsumeDelayMaxUs;
+	};
+
+	// Waits shorter than this are considered to not have blocked
+	uint64_t BlockedThresholdNs = 20000;
+
+	HdrHistogram SubmitWaitNs;
+	HdrHistogram InFlightFrames;
+	HdrHistogram ConsumeDelayNs;
+
+	// Wraps wait_for_async_ready(), recording how long it blocked
+	hailo_status WaitForAsyncReady(hailort::ConfiguredInferModel& model, std::chrono::milliseconds timeout, uint32_t nFrames = 1) {
+		uint64_t     start  = TelemetryNowNs();
+		hailo_status status = model.wait_for_async_ready(timeout, nFrames);
+		uint64_t     wait   = TelemetryNowNs() - start;
+		SubmitWaitNs.Record(wait);
+		if (wait >= BlockedThresholdNs)
+			Blocked.fetch_add(1, std::memory_order_relaxed);
+		return status;
+	}
+
+	// Call immediately after a successful run_async()
+	void OnSubmit(uint32_t nFrames) {
+		uint64_t depth = InFlight.fetch_add(nFrames, std::memory_order_relaxed) + nFrames;
+		InFlightFrames.Record(depth);
+	}
+
+	// Call from the completion callback. Returns the completion timestamp, which you must
+	// later pass to OnConsume().
+	uint64_t OnComplete(uint32_t nFrames) {
+		InFlight.fetch_sub(nFrames, std::memory_order_relaxed);
+		return TelemetryNowNs();
+	}
+
+	// Call when the host begins consuming the outputs of a completed job
+	void OnConsume(uint64_t completedAtNs) {
+		ConsumeDelayNs.Record(TelemetryNowNs() - completedAtNs);
+	}
+
+	// Discard everything recorded so far, eg after warmup. Frames in flight are still tracked.
+	void Reset() {
+		SubmitWaitNs.Reset();
+		InFlightFrames.Reset();
+		ConsumeDelayNs.Reset();
+		Blocked = 0;
+	}
+
+	uint64_t FramesInFlight() const { return InFlight.load(std::memory_order_relaxed); }
+
+	Snapshot GetSnapshot() const {
+		Snapshot s;
+		s.Submissions        = SubmitWaitNs.Count();
+		s.BlockedSubmissions = Blocked.load(std::memory_order_relaxed);
+		s.SubmitWaitMeanUs   = SubmitWaitNs.Mean() / 1000;
+		s.SubmitWaitP99Us    = SubmitWaitNs.Percentile(99) / 1000;
+		s.SubmitWaitMaxUs    = SubmitWaitNs.Max() / 1000;
+		s.InFlightMean       = InFlightFrames.Mean();
+		s.InFlightMax        = InFlightFrames.Max();
+		s.ConsumeDelayMeanUs = ConsumeDelayNs.Mean() / 1000;
+		s.ConsumeDelayP99Us  = ConsumeDelayNs.Percentile(99) / 1000;
+		s.ConsumeDelayMaxUs  = ConsumeDelayNs.Max() / 1000;
+		return s;
+	}
+
+	// queueSize is the async queue size of the model, in frames
+	void Print(uint32_t queueSize) const {
+		Snapshot s       = GetSnapshot();
+		double   blocked = s.Submissions == 0 ? 0 : 100.0 * s.BlockedSubmissions / s.Submissions;
+		printf("%-16s %d (%.1f%% blocked)\n", "Submissions", (int) s.Submissions, blocked);
+		printf("%-16s mean %.0fus, p99 %dus, max %dus\n", "Submit wait", s.SubmitWaitMeanUs, (int) s.SubmitWaitP99Us, (int) s.SubmitWaitMaxUs);
+		printf("%-16s mean %.1f, max %d (queue size %d)\n", "In flight", s.InFlightMean, (int) s.InFlightMax, (int) queueSize);
+		printf("%-16s mean %.0fus, p99 %dus, max %dus\n", "Consume delay", s.ConsumeDelayMeanUs, (int) s.ConsumeDelayP99Us, (int) s.ConsumeDelayMaxUs);
+		if (blocked > 50)
+			printf("%-16s %s\n", "Verdict", "device-bound (submissions usually wait for the device)");
+		else if (s.InFlightMean < queueSize * 0.5)
+			printf("%-16s %s\n", "Verdict", "host-bound (the device queue is mostly empty)");
+		else
+			printf("%-16s %s\n", "Verdict", "balanced");
+	}
+
+private:
+	std::atomic<uint64_t> InFlight{0};
+	std::atomic<uint64_t> Blocked{0};
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+// Record the raw output tensors of every frame into a file, and replay them later, without a device.
+// This lets you measure and regression-test postprocessing on any machine, with real outputs.
+//
+// The file is append-only, so a recording that was interrupted is still readable up to its last
+// complete frame. All integers are little-endian (the only byte order that we run on).
+//
+//   File:   FileHeader, then any number of frames
+//   Frame:  FrameHeader, then FrameHeader.NumTensors tensors
+//   Tensor: TensorHeader, name (padded), data (padded)
+//
+// Everything is padded to Align bytes, so that the tensor data can be used directly from the
+// mmapped file, without copying.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+namespace tensor_record {
+
+const uint32_t FileMagic  = 0x52544859; // "YHTR"
+const uint32_t FrameMagic = 0x4d415246; // "FRAM"
+const uint32_t Version    = 1;
+const size_t   Align      = 16;
+
+struct FileHeader {
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Reserved;
+};
+
+struct FrameHeader {
+	uint32_t Magic;
+	uint32_t NumTensors;
+	uint64_t FrameIndex;
+	uint64_t TimestampNs;
+	uint64_t TotalSize; // Size of the frame, including this header
+};
+
+struct TensorHeader {
+	uint32_t NameLen;
+	uint32_t Height;
+	uint32_t Width;
+	uint32_t Features;
+	uint32_t Type; // TensorType
+	uint32_t IsNMS;
+	float    QpZp;
+	float    QpScale;
+	uint64_t DataSize;
+};
+
+static_assert(sizeof(FileHeader) % Align == 0, "FileHeader must be a multiple of Align");
+static_assert(sizeof(FrameHeader) % 8 == 0, "FrameHeader must be 8-byte aligned");
+static_assert(sizeof(TensorHeader) % 8 == 0, "TensorHeader must be 8-byte aligned");
+
+inline size_t PadTo(size_t n, size_t align) {
+	return (n + align - 1) & ~(align - 1);
+}
+
+} // namespace tensor_record
+
+// Appends frames to a recording.
+class TensorRecorder {
+public:
+	~TensorRecorder() {
+		Close();
+	}
+
+	// If the file already holds a recording, then new frames are appended to it
+	bool Open(const std::string& filename) {
+		using namespace tensor_record;
+		Close();
+		F = fopen(filename.c_str(), "ab");
+		if (!F)
+			return false;
+		if (ftell(F) == 0) {
+			FileHeader h = {FileMagic, Version, 0};
+			if (fwrite(&h, sizeof(h), 1, F) != 1) {
+				Close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// data[i] holds tensors[i].FrameSize bytes
+	bool WriteFrame(uint64_t frameIndex, uint64_t timestampNs, const std::vector<TensorInfo>& tensors, const std::vector<const void*>& data) {
+		using namespace tensor_record;
+		if (!F || tensors.size() != data.size())
+			return false;
+
+		size_t total = PadTo(sizeof(FrameHeader), Align);
+		for (const auto& t : tensors)
+			total += PadTo(sizeof(TensorHeader) + t.Name.size(), Align) + PadTo(t.FrameSize, Align);
+
+		FrameHeader fh = {FrameMagic, (uint32_t) tensors.size(), frameIndex, timestampNs, total};
+		bool        ok = Write(&fh, sizeof(fh), Align);
+		for (size_t i = 0; i < tensors.size() && ok; i++) {
+			const TensorInfo& t  = tensors[i];
+			TensorHeader      th = {(uint32_t) t.Name.size(), t.Height, t.Width, t.Features, (uint32_t) t.Type, t.IsNMS ? 1u : 0u, t.QpZp, t.QpScale, t.FrameSize};
+			ok                   = fwrite(&th, sizeof(th), 1, F) == 1 && Write(t.Name.data(), t.Name.size(), Align, sizeof(th)) && Write(data[i], t.FrameSize, Align);
+		}
+		return ok;
+	}
+
+	bool IsOpen() const { return F != nullptr; }
+
+	bool Close() {
+		if (!F)
+			return true;
+		bool ok = fclose(F) == 0;
+		F       = nullptr;
+		return ok;
+	}
+
+private:
+	FILE* F = nullptr;
+
+	// Write size bytes, followed by zeros up to the next multiple of align.
+	// 'already' is the number of bytes of this aligned block that were written before.
+	bool Write(const void* p, size_t size, size_t align, size_t already = 0) {
+		static const uint8_t zeros[tensor_record::Align] = {};
+		if (size != 0 && fwrite(p, size, 1, F) != 1)
+			return false;
+		size_t pad = tensor_record::PadTo(already + size, align) - (already + size);
+		return pad == 0 || fwrite(zeros, pad, 1, F) == 1;
+	}
+};
+
+// A memory-mapped recording. Tensor data points directly into the mapping.
+class TensorReplay {
+public:
+	struct Tensor {
+		TensorInfo     Info;
+		const uint8_t* Data;
+	};
+	struct Frame {
+		uint64_t            FrameIndex;
+		uint64_t            TimestampNs;
+		std::vector<Tensor> Tensors;
+	};
+
+	std::vector<Frame> Frames;
+	bool               Truncated = false; // True if the file ends with an incomplete frame
+
+	~TensorReplay() {
+		Close();
+	}
+
+	bool Open(const std::string& filename) {
+		using namespace tensor_record;
+		Close();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FileHeader)) {
+			close(fd);
+			return false;
+		}
+		Size = (size_t) st.st_size;
+		Data = (const uint8_t*) mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (Data == MAP_FAILED) {
+			Data = nullptr;
+			return false;
+		}
+		madvise((void*) Data, Size, MADV_WILLNEED);
+
+		FileHeader fh;
+		memcpy(&fh, Data, sizeof(fh));
+		if (fh.Magic != FileMagic || fh.Version != Version) {
+			Close();
+			return false;
+		}
+
+		size_t pos = sizeof(FileHeader);
+		while (pos < Size) {
+			Frame frame;
+			if (!ParseFrame(pos, frame)) {
+				Truncated = true;
+				break;
+			}
+			Frames.push_back(std::move(frame));
+		}
+		return true;
+	}
+
+	void Close() {
+		if (Data)
+			munmap((void*) Data, Size);
+		Data      = nullptr;
+		Size      = 0;
+		Truncated = false;
+		Frames.clear();
+	}
+
+	size_t FileSize() const { return Size; }
+
+private:
+	const uint8_t* Data = nullptr;
+	size_t         Size = 0;
+
+	// Parses the frame at pos, and advances pos past it. Returns false if the frame is incomplete or corrupt.
+	bool ParseFrame(size_t& pos, Frame& frame) {
+		using namespace tensor_record;
+		FrameHeader fh;
+		if (pos + sizeof(fh) > Size)
+			return false;
+		memcpy(&fh, Data + pos, sizeof(fh));
+		if (fh.Magic != FrameMagic || fh.TotalSize > Size - pos)
+			return false;
+		size_t end        = pos + fh.TotalSize;
+		size_t p          = pos + PadTo(sizeof(fh), Align);
+		frame.FrameIndex  = fh.FrameIndex;
+		frame.TimestampNs = fh.TimestampNs;
+		for (uint32_t i = 0; i < fh.NumTensors; i++) {
+			TensorHeader th;
+			if (p + sizeof(th) > end)
+				return false;
+			memcpy(&th, Data + p, sizeof(th));
+			size_t dataPos = p + PadTo(sizeof(th) + th.NameLen, Align);
+			if (dataPos > end || th.DataSize > end - dataPos || th.Type > (uint32_t) TensorType::Float32)
+				return false;
+			Tensor t;
+			t.Info.Name      = std::string((const char*) Data + p + sizeof(th), th.NameLen);
+			t.Info.Height    = th.Height;
+			t.Info.Width     = th.Width;
+			t.Info.Features  = th.Features;
+			t.Info.Type      = (TensorType) th.Type;
+			t.Info.IsNMS     = th.IsNMS != 0;
+			t.Info.QpZp      = th.QpZp;
+			t.Info.QpScale   = th.QpScale;
+			t.Info.FrameSize = th.DataSize;
+			t.Data           = Data + dataPos;
+			frame.Tensors.push_back(t);
+			p = dataPos + PadTo(th.DataSize, Align);
+		}
+		pos = end;
+		return true;
+	}
+};
@@ -0,0 +1,187 @@
+#include <hailo/hailort.h>
+#include <hailo/hailort_common.hpp>
+#include <hailo/vdevice.hpp>
+#include <hailo/infer_model.hpp>
+#include <chrono>
+
+#include "../output_tensor.h"
+#include "../debug.h"
+#include "coinfer.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+// Runs several independent "streams", each written as a plain sequential loop using co_await,
+// while all of their requests are in flight on the device at the same time.
+
+// g++ -std=c++20 -O2 -o yolov8-coro advanced/yolov8-coro.cpp -lhailort && ./yolov8-coro
+
+std::string hefFile             = "yolov8s.hef";
+std::string imgFilename         = "test-image-640x640.jpg";
+float       confidenceThreshold = 0.5f;  // Lower number = accept more boxes
+float       nmsIoUThreshold     = 0.45f; // Lower number = merge more boxes (I think!)
+int         nStreams            = 8;
+int         framesPerStream     = 50;
+
+struct Stream {
+	Stream(const hailort::ConfiguredInferModel::Bindings& bindings) : Bindings(bindings) {}
+
+	hailort::ConfiguredInferModel::Bindings Bindings;
+	std::vector<OutTensor>                  Outputs;
+	int                                     NumBoxes = 0;
+	hailo_status                            Status   = HAILO_SUCCESS;
+};
+
+// Count the boxes inside a HAILO NMS output buffer
+static int CountBoxes(const OutTensor& out) {
+	const float* raw   = (const float*) out.data;
+	size_t       idx   = 0;
+	int          total = 0;
+	for (size_t classIdx = 0; classIdx < (size_t) out.shape.height; classIdx++) {
+		size_t numBoxes = (size_t) raw[idx++];
+		total += (int) numBoxes;
+		idx += numBoxes * 5;
+	}
+	return total;
+}
+
+CoTask RunStream(CoInferModel& model, Stream& stream, int nFrames) {
+	for (int i = 0; i < nFrames; i++) {
+		hailo_status status = co_await model.Infer(stream.Bindings);
+		if (status != HAILO_SUCCESS) {
+			stream.Status = status;
+			co_return;
+		}
+		stream.NumBoxes += CountBoxes(stream.Outputs[0]);
+	}
+}
+
+int run() {
+	using namespace hailort;
+	using namespace std::literals::chrono_literals;
+
+	int            imgWidth = 0, imgHeight = 0, imgChan = 0;
+	unsigned char* img_rgb_8 = stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3);
+	if (!img_rgb_8) {
+		printf("Failed to load image %s\n", imgFilename.c_str());
+		return 1;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////
+	// Load/Init
+	////////////////////////////////////////////////////////////////////////////////////////////
+
+	Expected<std::unique_ptr<VDevice>> vdevice_exp = VDevice::create();
+	if (!vdevice_exp) {
+		printf("Failed to create vdevice\n");
+		return vdevice_exp.status();
+	}
+	std::unique_ptr<hailort::VDevice> vdevice = vdevice_exp.release();
+
+	Expected<std::shared_ptr<InferModel>> infer_model_exp = vdevice->create_infer_model(hefFile);
+	if (!infer_model_exp) {
+		printf("Failed to create infer model\n");
+		return infer_model_exp.status();
+	}
+	std::shared_ptr<hailort::InferModel> infer_model = infer_model_exp.release();
+	infer_model->output()->set_nms_score_threshold(confidenceThreshold);
+	infer_model->output()->set_nms_iou_threshold(nmsIoUThreshold);
+
+	Expected<ConfiguredInferModel> configured_infer_model_exp = infer_model->configure();
+	if (!configured_infer_model_exp) {
+		printf("Failed to get configured infer model\n");
+		return configured_infer_model_exp.status();
+	}
+	std::shared_ptr<hailort::ConfiguredInferModel> configured_infer_model = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
+
+	const std::string& input_name       = infer_model->get_input_names()[0];
+	size_t             input_frame_size = infer_model->input(input_name)->get_frame_size();
+	if ((size_t) (imgWidth * imgHeight * 3) != input_frame_size) {
+		printf("Input image size %d x %d does not match NN input frame size %d\n", imgWidth, imgHeight, (int) input_frame_size);
+		return 1;
+	}
+
+	// Each stream gets its own bindings and output buffers, since its request may be in flight
+	// at the same time as every other stream's.
+	std::vector<Stream> streams;
+	streams.reserve(nStreams);
+	for (int iStream = 0; iStream < nStreams; iStream++) {
+		Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model->create_bindings();
+		if (!bindings_exp) {
+			printf("Failed to get infer model bindings\n");
+			return bindings_exp.status();
+		}
+		streams.emplace_back(bindings_exp.release());
+		Stream& stream = streams.back();
+
+		auto status = stream.Bindings.input(input_name)->set_buffer(MemoryView(img_rgb_8, input_frame_size));
+		if (status != HAILO_SUCCESS) {
+			printf("Failed to set memory buffer: %d\n", (int) status);
+			return status;
+		}
+
+		for (auto const& output_name : infer_model->get_output_names()) {
+			size_t   output_size   = infer_model->output(output_name)->get_frame_size();
+			uint8_t* output_buffer = (uint8_t*) malloc(output_size);
+			if (!output_buffer) {
+				printf("Could not allocate an output buffer!");
+				return HAILO_OUT_OF_HOST_MEMORY;
+			}
+			status = stream.Bindings.output(output_name)->set_buffer(MemoryView(output_buffer, output_size));
+			if (status != HAILO_SUCCESS) {
+				printf("Failed to set infer output buffer, status = %d", (int) status);
+				return status;
+			}
+			const std::vector<hailo_quant_info_t> quant  = infer_model->output(output_name)->get_quant_infos();
+			const hailo_3d_image_shape_t          shape  = infer_model->output(output_name)->shape();
+			const hailo_format_t                  format = infer_model->output(output_name)->format();
+			stream.Outputs.emplace_back(output_buffer, output_name, quant[0], shape, format);
+		}
+		std::sort(stream.Outputs.begin(), stream.Outputs.end(), OutTensor::SortFunction);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////
+	// Run
+	////////////////////////////////////////////////////////////////////////////////////////////
+
+	CoExecutor   executor;
+	CoInferModel model(executor, configured_infer_model);
+	printf("Async queue size: %d\n", (int) model.AsyncQueueSize());
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (auto& stream : streams)
+		RunStream(model, stream, framesPerStream).Spawn(executor);
+	executor.Run();
+
+	double elapsedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	int nFrames = 0;
+	for (size_t i = 0; i < streams.size(); i++) {
+		if (streams[i].Status != HAILO_SUCCESS) {
+			printf("Stream %d failed, status = %d\n", (int) i, (int) streams[i].Status);
+			return streams[i].Status;
+		}
+		nFrames += framesPerStream;
+	}
+	printf("%-16s %d\n", "Streams", nStreams);
+	printf("%-16s %s\n", "Model", hefFile.c_str());
+	printf("%-16s %d\n", "Boxes/frame", streams[0].NumBoxes / framesPerStream);
+	printf("%-16s %.2f\n", "FPS", nFrames / elapsedSeconds);
+
+	for (auto& stream : streams) {
+		for (auto& out : stream.Outputs)
+			free(out.data);
+	}
+
+	return 123456789;
+}
+
+int main(int argc, char** argv) {
+	int status = run();
+	if (status == 123456789)
+		printf("SUCCESS\n");
+	else
+		printf("Failed with error code %d\n", status);
+	return 0;
+}
@@ -0,0 +1,586 @@
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../nms.h"
+#include "allocator.h"
+#include "backend.h"
+#include "daemon_protocol.h"
+#include "histogram.h"
+#include "sim_backend.h"
+
+#ifndef NO_HAILORT
+#include "hailo_backend.h"
+#endif
+
+// A long-running inference server. Creating the VDevice, loading the HEF and configuring the
+// model takes far longer than running it, so instead of paying that in every process, the
+// daemon does it once, and any number of local clients send it frames over a Unix socket.
+// See daemon_protocol.h for the protocol, and daemon-client.cpp for a client.
+//
+// Everything runs on one thread, around poll(): accept clients, receive requests, submit them
+// to the device (up to batchSize at a time), and reply when the backend signals completion via
+// an eventfd. The device reads the input straight out of the client's shared memory slot.
+// With --sim (or built with -DNO_HAILORT), the device is replaced by SimBackend.
+
+// g++ -O2 -o yolov8-daemon advanced/yolov8-daemon.cpp -lhailort && ./yolov8-daemon
+// g++ -O2 -DNO_HAILORT -o yolov8-daemon-sim advanced/yolov8-daemon.cpp && ./yolov8-daemon-sim
+
+std::string hefFile             = "yolov8s.hef";
+std::string socketPath          = "/tmp/yolohailo.sock";
+float       confidenceThreshold = 0.5f;  // Lower number = accept more boxes
+float       nmsIoUThreshold     = 0.45f; // Lower number = merge more boxes (I think!)
+int         batchSize           = 1;     // Maximum frames per batch. We never wait to fill a batch.
+int         maxClients          = 64;
+double      durationSeconds     = 0;     // If > 0, exit after this long. Otherwise run until SIGINT or SIGTERM.
+bool        useSim              = false;
+double      simFixedMs          = 0.5;   // SimBackend latency per batch...
+double      simFrameMs          = 3.0;   // ...plus this much per frame
+int         simBoxes            = 5;     // Synthetic boxes per frame
+
+#ifdef NO_HAILORT
+const bool haveHailoRT = false;
+#else
+const bool haveHailoRT = true;
+#endif
+
+std::atomic<bool> stopRequested(false);
+
+uint64_t NowNs() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A client's memfd, mapped into our address space
+struct SharedSlot {
+	uint8_t* Data = nullptr;
+	size_t   Size = 0;
+	bool     Busy = false; // A request for this slot is in flight
+
+	~SharedSlot() {
+		if (Data)
+			munmap(Data, Size);
+	}
+};
+
+struct Client {
+	int                                      FD = -1; // -1 once the client has gone
+	std::vector<std::shared_ptr<SharedSlot>> Slots;
+};
+
+// One request for one frame. The shared pointers keep the client's memory mapped until the device
+// is done with it, even if the client disconnects in the meantime.
+struct PendingRequest {
+	std::shared_ptr<Client>     Owner;
+	std::shared_ptr<SharedSlot> Slot;
+	uint32_t                    SlotIndex  = 0;
+	uint64_t                    RequestID  = 0;
+	uint64_t                    ReceivedAt = 0;
+};
+
+// A batch on the device, with its own output buffers
+struct Job {
+	std::vector<PendingRequest> Requests;
+	std::vector<BackendFrame>   Frames;
+	std::vector<BackendFrame>   Submitted; // The first Requests.size() of Frames
+	uint64_t                    SubmittedAt = 0;
+	uint64_t                    CompletedAt = 0;
+	int                         Status      = 0;
+	bool                        Busy        = false;
+};
+
+class Daemon {
+public:
+	Daemon(InferBackend* backend) : Backend(backend) {}
+
+	~Daemon() {
+		Backend->WaitIdle();
+		for (auto& c : Clients)
+			Disconnect(*c);
+		if (ListenFD != -1) {
+			close(ListenFD);
+			unlink(socketPath.c_str());
+		}
+		if (EventFD != -1)
+			close(EventFD);
+	}
+
+	int Start() {
+		int status = Backend->Configure(batchSize);
+		if (status != 0) {
+			printf("Failed to configure %s backend, status = %d\n", Backend->Name(), status);
+			return status;
+		}
+		const TensorInfo& input = Backend->Input();
+		Hello                   = {daemonproto::Magic, (uint32_t) daemonproto::MessageType::Hello, daemonproto::Version, input.Width, input.Height, input.Features, input.FrameSize};
+
+		// Enough jobs to keep the device's queue full
+		int nJobs = std::max(1, (int) Backend->QueueSize() / batchSize);
+		for (int i = 0; i < nJobs; i++) {
+			auto job = std::make_unique<Job>();
+			for (int j = 0; j < batchSize; j++) {
+				BackendFrame frame;
+				for (const auto& out : Backend->Outputs())
+					frame.Outputs.push_back(Allocator.Alloc(out.FrameSize));
+				job->Frames.push_back(frame);
+			}
+			Jobs.push_back(std::move(job));
+		}
+
+		EventFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (EventFD == -1) {
+			printf("Failed to create eventfd: %s\n", strerror(errno));
+			return 1;
+		}
+
+		struct sockaddr_un addr = {};
+		if (socketPath.size() >= sizeof(addr.sun_path)) {
+			printf("Socket path %s is too long\n", socketPath.c_str());
+			return 1;
+		}
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+		unlink(socketPath.c_str()); // Left behind by a daemon that didn't exit cleanly
+		ListenFD = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+		if (ListenFD == -1 || bind(ListenFD, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(ListenFD, 16) != 0) {
+			printf("Failed to listen on %s: %s\n", socketPath.c_str(), strerror(errno));
+			return 1;
+		}
+		printf("Listening on %s (%s backend, %u x %u input, batch size %d, queue size %u)\n", socketPath.c_str(), Backend->Name(), input.Width, input.Height,
+		       batchSize, Backend->QueueSize());
+		fflush(stdout);
+		return 0;
+	}
+
+	int Run() {
+		auto                                 start = std::chrono::steady_clock::now();
+		std::vector<struct pollfd>           fds;
+		std::vector<std::shared_ptr<Client>> fdClients;
+		while (!stopRequested) {
+			if (durationSeconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= durationSeconds)
+				break;
+
+			fds.clear();
+			fdClients.clear();
+			fds.push_back({EventFD, POLLIN, 0});
+			fds.push_back({ListenFD, POLLIN, 0});
+			for (auto& c : Clients) {
+				fds.push_back({c->FD, POLLIN, 0});
+				fdClients.push_back(c);
+			}
+			int n = poll(fds.data(), fds.size(), 100);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				printf("poll failed: %s\n", strerror(errno));
+				return 1;
+			}
+
+			if (fds[0].revents & POLLIN)
+				Complete();
+			if (fds[1].revents & POLLIN)
+				Accept();
+			for (size_t i = 2; i < fds.size(); i++) {
+				if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && fdClients[i - 2]->FD != -1)
+					Receive(fdClients[i - 2]);
+			}
+			Clients.erase(std::remove_if(Clients.begin(), Clients.end(), [](const std::shared_ptr<Client>& c) { return c->FD == -1; }), Clients.end());
+
+			int status = Dispatch();
+			if (status != 0)
+				return status;
+		}
+		return 0;
+	}
+
+	void PrintStats() {
+		auto queue    = QueueNs.GetSnapshot();
+		auto overhead = OverheadNs.GetSnapshot();
+		printf("%-16s %d\n", "Clients", (int) nConnected);
+		printf("%-16s %d (%d rejected)\n", "Requests", (int) nServed, (int) nRejected);
+		if (nServed != 0) {
+			printf("%-16s p50 %.1fus, p99 %.1fus\n", "Queued", queue.Percentile(50) / 1e3, queue.Percentile(99) / 1e3);
+			printf("%-16s p50 %.1fus, p99 %.1fus (time in the daemon, excluding the queue and the device)\n", "Overhead", overhead.Percentile(50) / 1e3,
+			       overhead.Percentile(99) / 1e3);
+		}
+	}
+
+private:
+	InferBackend*                        Backend;
+	daemonproto::HelloMessage            Hello    = {};
+	int                                  ListenFD = -1;
+	int                                  EventFD  = -1;
+	std::vector<std::shared_ptr<Client>> Clients;
+	std::deque<PendingRequest>           Pending;
+	std::vector<std::unique_ptr<Job>>    Jobs;
+	PageAlignedAllocator                 Allocator;
+	std::mutex                           DoneLock;
+	std::vector<Job*>                    Done; // Completed jobs, protected by DoneLock
+	std::vector<Detection>               Dets;
+	std::vector<uint8_t>                 ReplyBuf;
+	HdrHistogram                         QueueNs;    // Request received to submitted, per frame
+	HdrHistogram                         OverheadNs; // Request received to reply sent, minus the time queued and on the device
+	uint64_t                             nConnected = 0;
+	uint64_t                             nServed    = 0;
+	uint64_t                             nRejected  = 0;
+
+	void Accept() {
+		while (true) {
+			int fd = accept4(ListenFD, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd == -1)
+				return;
+			if ((int) Clients.size() >= maxClients || !daemonproto::SendMessage(fd, &Hello, sizeof(Hello))) {
+				close(fd);
+				continue;
+			}
+			auto c = std::make_shared<Client>();
+			c->FD  = fd;
+			Clients.push_back(c);
+			nConnected++;
+		}
+	}
+
+	void Disconnect(Client& c) {
+		if (c.FD != -1)
+			close(c.FD);
+		c.FD = -1;
+		c.Slots.clear(); // In-flight requests keep their slots mapped until they complete
+	}
+
+	void Receive(const std::shared_ptr<Client>& client) {
+		using namespace daemonproto;
+		Client& c   = *client;
+		Request req = {};
+		int     fd  = -1;
+		ssize_t n  = ReceiveMessage(c.FD, &req, sizeof(req), fd);
+		if (n <= 0) {
+			Disconnect(c);
+			return;
+		}
+		if (n != sizeof(req) || req.Magic != Magic) {
+			if (fd != -1)
+				close(fd);
+			SendError(c, req.Slot, req.RequestID, ErrBadRequest);
+			return;
+		}
+		switch ((MessageType) req.Type) {
+		case MessageType::RegisterSlot: {
+			int status = RegisterSlot(c, req.Slot, fd);
+			if (status != StatusOK)
+				SendError(c, req.Slot, req.RequestID, status);
+			break;
+		}
+		case MessageType::Infer: {
+			if (fd != -1)
+				close(fd);
+			if (req.Slot >= c.Slots.size() || !c.Slots[req.Slot]) {
+				SendError(c, req.Slot, req.RequestID, ErrBadSlot);
+			} else if (c.Slots[req.Slot]->Busy) {
+				SendError(c, req.Slot, req.RequestID, ErrSlotBusy);
+			} else {
+				c.Slots[req.Slot]->Busy = true;
+				Pending.push_back({client, c.Slots[req.Slot], req.Slot, req.RequestID, NowNs()});
+			}
+			break;
+		}
+		default:
+			if (fd != -1)
+				close(fd);
+			SendError(c, req.Slot, req.RequestID, ErrBadRequest);
+			break;
+		}
+	}
+
+	// Takes ownership of fd
+	int RegisterSlot(Client& c, uint32_t index, int fd) {
+		using namespace daemonproto;
+		if (fd == -1)
+			return ErrBadSlot;
+		if (index >= MaxSlots || (index < c.Slots.size() && c.Slots[index] && c.Slots[index]->Busy)) {
+			close(fd);
+			return index >= MaxSlots ? ErrTooManySlots : ErrSlotBusy;
+		}
+		// The memory must be big enough, and the client must not be able to shrink it later,
+		// otherwise reading it could fault (SIGBUS) in our process.
+		struct stat st;
+		int         seals = fcntl(fd, F_GET_SEALS);
+		if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < Hello.FrameSize || seals == -1 || !(seals & F_SEAL_SHRINK)) {
+			close(fd);
+			return ErrBadSlot;
+		}
+		// Writable, because pinning the pages for DMA may require it, even though we only read them
+		void* p = mmap(nullptr, Hello.FrameSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return ErrBadSlot;
+		auto slot  = std::make_shared<SharedSlot>();
+		slot->Data = (uint8_t*) p;
+		slot->Size = Hello.FrameSize;
+		if (index >= c.Slots.size())
+			c.Slots.resize(index + 1);
+		c.Slots[index] = slot;
+		return StatusOK;
+	}
+
+	void SendError(Client& c, uint32_t slot, uint64_t requestID, int32_t status) {
+		using namespace daemonproto;
+		Reply reply     = {};
+		reply.Magic     = Magic;
+		reply.Type      = (uint32_t) MessageType::Reply;
+		reply.Status    = status;
+		reply.RequestID = requestID;
+		reply.Slot      = slot;
+		nRejected++;
+		if (!SendMessage(c.FD, &reply, sizeof(reply), -1, MSG_DONTWAIT))
+			Disconnect(c);
+	}
+
+	// Submit as many pending requests as we have free jobs for
+	int Dispatch() {
+		using namespace std::literals::chrono_literals;
+		while (!Pending.empty()) {
+			Job* job = nullptr;
+			for (auto& j : Jobs) {
+				if (!j->Busy) {
+					job = j.get();
+					break;
+				}
+			}
+			if (!job)
+				return 0;
+
+			job->Requests.clear();
+			job->Submitted.clear();
+			while (!Pending.empty() && (int) job->Requests.size() < batchSize) {
+				PendingRequest& req = Pending.front();
+				if (req.Owner->FD == -1) {
+					// The client has gone, so don't bother
+					req.Slot->Busy = false;
+					Pending.pop_front();
+					continue;
+				}
+				BackendFrame    frame;
+				frame.Input   = req.Slot->Data;
+				frame.Outputs = job->Frames[job->Requests.size()].Outputs;
+				job->Submitted.push_back(frame);
+				job->Requests.push_back(std::move(req));
+				Pending.pop_front();
+			}
+			if (job->Requests.empty())
+				return 0;
+
+			int status = Backend->WaitForAsyncReady(1s, (uint32_t) job->Requests.size());
+			if (status != 0) {
+				printf("Failed to wait for async ready, status = %d\n", status);
+				return status;
+			}
+			job->Busy        = true;
+			job->SubmittedAt = NowNs();
+			job->CompletedAt = 0;
+			status           = Backend->RunAsync(job->Submitted, [this, job](int s) {
+				job->Status      = s;
+				job->CompletedAt = NowNs();
+				{
+					std::lock_guard<std::mutex> lock(DoneLock);
+					Done.push_back(job);
+				}
+				uint64_t one = 1;
+				if (write(EventFD, &one, sizeof(one)) < 0) {
+					// The counter can only overflow after 2^64 completions
+				}
+			});
+			if (status != 0) {
+				printf("Failed to submit batch, status = %d\n", status);
+				return status;
+			}
+		}
+		return 0;
+	}
+
+	// Parse and reply to every completed job
+	void Complete() {
+		using namespace daemonproto;
+		uint64_t count;
+		if (read(EventFD, &count, sizeof(count)) < 0) {
+			// Nothing to read, which is fine
+		}
+		std::vector<Job*> done;
+		{
+			std::lock_guard<std::mutex> lock(DoneLock);
+			done.swap(Done);
+		}
+		const std::vector<TensorInfo>& outputs = Backend->Outputs();
+		ReplyBuf.resize(MaxReplySize);
+		for (Job* job : done) {
+			for (size_t i = 0; i < job->Requests.size(); i++) {
+				PendingRequest& req = job->Requests[i];
+				req.Slot->Busy      = false;
+				if (req.Owner->FD == -1)
+					continue;
+
+				Dets.clear();
+				if (job->Status == 0) {
+					for (size_t j = 0; j < outputs.size(); j++) {
+						if (outputs[j].IsNMS && outputs[j].Type == TensorType::Float32)
+							ParseHailoNMS((const float*) job->Submitted[i].Outputs[j], outputs[j].Height, outputs[j].FrameSize / sizeof(float), confidenceThreshold, Dets);
+					}
+				}
+				uint32_t nDets      = (uint32_t) std::min<size_t>(Dets.size(), MaxDetections);
+				Reply    reply      = {};
+				reply.Magic         = Magic;
+				reply.Type          = (uint32_t) MessageType::Reply;
+				reply.Status        = job->Status;
+				reply.NumDetections = nDets;
+				reply.RequestID     = req.RequestID;
+				reply.Slot          = req.SlotIndex;
+				reply.QueueNs       = job->SubmittedAt - req.ReceivedAt;
+				reply.InferNs       = job->CompletedAt - job->SubmittedAt;
+				memcpy(ReplyBuf.data(), &reply, sizeof(reply));
+				detstream::PackedDetection* packed = (detstream::PackedDetection*) (ReplyBuf.data() + sizeof(reply));
+				for (uint32_t k = 0; k < nDets; k++) {
+					const Detection& d = Dets[k];
+					packed[k]          = {d.XMin, d.YMin, d.XMax, d.YMax, d.Confidence, (uint16_t) d.ClassID, 0};
+				}
+				// Never block on a client. If one isn't reading its replies, it loses its connection.
+				if (!SendMessage(req.Owner->FD, ReplyBuf.data(), sizeof(reply) + nDets * sizeof(detstream::PackedDetection), -1, MSG_DONTWAIT)) {
+					Disconnect(*req.Owner);
+					continue;
+				}
+				uint64_t now = NowNs();
+				QueueNs.Record(reply.QueueNs);
+				OverheadNs.Record(now - req.ReceivedAt - reply.QueueNs - reply.InferNs);
+				nServed++;
+			}
+			job->Requests.clear();
+			job->Busy = false;
+		}
+	}
+};
+
+void OnSignal(int) {
+	stopRequested = true;
+}
+
+int run() {
+	// No SA_RESTART, so that poll() returns with EINTR, and we shut down cleanly
+	struct sigaction sa = {};
+	sa.sa_handler       = OnSignal;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	std::unique_ptr<InferBackend> backend;
+#ifndef NO_HAILORT
+	std::unique_ptr<hailort::VDevice> vdevice;
+#endif
+	if (useSim) {
+		auto sim           = std::make_unique<SimBackend>();
+		sim->FixedMs       = simFixedMs;
+		sim->PerFrameMs    = simFrameMs;
+		sim->BoxesPerFrame = simBoxes;
+		backend            = std::move(sim);
+	} else {
+#ifndef NO_HAILORT
+		hailort::Expected<std::unique_ptr<hailort::VDevice>> vdevice_exp = hailort::VDevice::create();
+		if (!vdevice_exp) {
+			printf("Failed to create vdevice\n");
+			return vdevice_exp.status();
+		}
+		vdevice = vdevice_exp.release();
+		backend = std::make_unique<HailoBackend>(vdevice.get(), hefFile, confidenceThreshold, nmsIoUThreshold);
+#endif
+	}
+
+	int status;
+	{
+		Daemon daemon(backend.get());
+		status = daemon.Start();
+		if (status == 0)
+			status = daemon.Run();
+		daemon.PrintStats();
+	}
+	backend.reset();
+	return status == 0 ? 123456789 : status;
+}
+
+void PrintHelp() {
+	printf("Usage: yolov8-daemon [options]\n");
+	printf("  --hef <file>          Model (default %s)\n", hefFile.c_str());
+	printf("  --socket <path>       Unix socket to listen on (default %s)\n", socketPath.c_str());
+	printf("  --batch <n>           Maximum frames per batch (default %d)\n", batchSize);
+	printf("  --max-clients <n>     Maximum number of connected clients (default %d)\n", maxClients);
+	printf("  --duration <seconds>  Exit after this long (default: run until interrupted)\n");
+	printf("  --sim                 Use a simulated device instead of the Hailo accelerator%s\n", haveHailoRT ? "" : " (always on in this build)");
+	printf("  --sim-fixed-ms <ms>   Simulated latency per batch (default %.2f)\n", simFixedMs);
+	printf("  --sim-frame-ms <ms>   Simulated latency per frame in a batch (default %.2f)\n", simFrameMs);
+	printf("  --sim-boxes <n>       Synthetic boxes per frame (default %d)\n", simBoxes);
+}
+
+// Returns false if the arguments are invalid
+bool ParseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--help" || arg == "-h") {
+			return false;
+		} else if (arg == "--sim") {
+			useSim = true;
+			continue;
+		} else if (next == nullptr) {
+			printf("Missing value for %s\n", arg.c_str());
+			return false;
+		} else if (arg == "--hef") {
+			hefFile = next;
+		} else if (arg == "--socket") {
+			socketPath = next;
+		} else if (arg == "--batch") {
+			batchSize = atoi(next);
+		} else if (arg == "--max-clients") {
+			maxClients = atoi(next);
+		} else if (arg == "--duration") {
+			durationSeconds = atof(next);
+		} else if (arg == "--sim-fixed-ms") {
+			simFixedMs = atof(next);
+		} else if (arg == "--sim-frame-ms") {
+			simFrameMs = atof(next);
+		} else if (arg == "--sim-boxes") {
+			simBoxes = atoi(next);
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			return false;
+		}
+		i++;
+	}
+	if (batchSize < 1 || maxClients < 1) {
+		printf("Batch size and maximum clients must be at least 1\n");
+		return false;
+	}
+	if (!haveHailoRT)
+		useSim = true;
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (!ParseArgs(argc, argv)) {
+		PrintHelp();
+		return 1;
+	}
+	int status = run();
+	if (status == 123456789)
+		printf("SUCCESS\n");
+	else
+		printf("Failed with error code %d\n", status);
+	return 0;
+}
@@ -2,126 +2,138 @@
 #include <hailo/hailort_common.hpp>
 #include <hailo/vdevice.hpp>
 #include <hailo/infer_model.hpp>
+#include <algorithm>
 #include <chrono>
+#include <future>
+#include <optional>
+#include <thread>
 
 #include "../output_tensor.h"
 #include "../debug.h"
+#include "../model_cache.h"
+#include "../startup.h"
+#include "../trace.h"
 #include "allocator.h"
+#include "affinity.h"
+#include "histogram.h"
+#include "regression.h"
+#include "telemetry.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb_image.h"
 
 // g++ -O2 -o yolov8-fps advanced/yolov8-fps.cpp -lhailort && ./yolov8-fps
+// ./yolov8-fps --hef yolov8s.hef --batch 4 --inflight 2 --duration 20 --json result.json
 
+// Defaults, which can be overridden on the command line. Run with --help for details.
 std::string hefFile             = "yolov8m.hef";
 std::string imgFilename         = "test-image-640x640.jpg";
 float       confidenceThreshold = 0.5f;  // Lower number = accept more boxes
 float       nmsIoUThreshold     = 0.45f; // Lower number = merge more boxes (I think!)
 int         batchSize           = 8;
-
-int run() {
+int         inFlight            = 1;     // Number of batches submitted to the device at the same time
+double      durationSeconds     = 10;    // Measurement time, after warmup
+int         iterations          = 0;     // If > 0, measure this many batches instead of durationSeconds
+double      warmupSeconds       = 2;     // The first runs are much slower than the rest, so we discard them
+std::string jsonFilename        = "";    // If not empty, write results here as JSON
+std::string csvFilename         = "";    // If not empty, append results here as a CSV row
+std::string traceFilename       = "";    // If not empty, write a Chrome trace here (open it in https://ui.perfetto.dev)
+std::string stageAffinity       = "";    // eg "submit=1,callback=2" to pin threads to cores (4 cores on a Pi 5)
+int         submitPriority      = 0;     // If > 0, run the submission thread with SCHED_FIFO at this priority
+std::string sweepBatchSizes     = "";    // eg "1,2,4,8" to measure every combination of these batch sizes...
+std::string sweepInFlight       = "";    // ...and these in-flight counts, eg "1,2,4"
+int         repeats             = 1;     // Run each configuration this many times, to measure run-to-run noise
+std::string baselineFilename    = "";    // If not empty, compare against this JSON result, and exit with 2 on a regression (3 if it's incomplete)
+double      regressionThreshold = 0.05;  // Relative change that counts as a regression, if it is also beyond the noise
+bool        regressionDetected  = false;
+bool        baselineIncomplete  = false; // A configuration that we measured has no baseline to compare with
+
+// The HEF is read and parsed once, and the same InferModel is reconfigured for every run of a sweep
+ModelCache modelCache;
+
+struct BenchResult {
+	std::string Model;
+	int         BatchSize = 0;
+	int         InFlight  = 0;
+	int         NNWidth   = 0;
+	int         NNHeight  = 0;
+	int64_t     Frames    = 0;
+	double      Seconds   = 0;
+	double      FPS       = 0;
+	// Per-frame latency from submission to completion callback, in milliseconds.
+	// Every frame in a batch shares the latency of its batch.
+	double LatencyMean = 0;
+	double LatencyP50  = 0;
+	double LatencyP90  = 0;
+	double LatencyP99  = 0;
+	double LatencyMax  = 0;
+	// Means of the latency split, in milliseconds. See LatencyBreakdown.
+	double QueueMean  = 0;
+	double DeviceMean = 0;
+	double HostMean   = 0;
+	// When a configuration is repeated, the fields above are means over all runs, and these
+	// are the sample standard deviations of the metrics that we compare against a baseline.
+	int    Runs              = 1;
+	double FPSStdDev         = 0;
+	double LatencyMeanStdDev = 0;
+	double LatencyP50StdDev  = 0;
+	double LatencyP99StdDev  = 0;
+};
+
+// One batch worth of bindings and output buffers, which can be in flight independently of
+// all the other slots.
+struct Slot {
+	std::vector<hailort::ConfiguredInferModel::Bindings> Bindings;
+	std::vector<OutTensor>                               Outputs;
+	std::optional<hailort::AsyncInferJob>                Job;
+	uint64_t                                             SubmittedAt = 0;
+	std::atomic<uint64_t>                                CompletedAt{0};
+	std::atomic<hailo_status>                            Status{HAILO_SUCCESS};
+};
+
+// Configure the model with the current batchSize and inFlight, and measure it.
+// If printDetails is true, then print the queue telemetry and thread CPU times.
+int RunBenchmark(hailort::VDevice* vdevice, unsigned char* img_rgb_8, StageAffinity& affinity, PipelineTelemetry& telemetry, bool printDetails, BenchResult& result) {
 	using namespace hailort;
 	using namespace std::literals::chrono_literals;
 
-	// Load image
-
-	int            imgWidth = 0, imgHeight = 0, imgChan = 0;
-	unsigned char* img_rgb_8 = stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3);
-	if (!img_rgb_8) {
-		printf("Failed to load image %s\n", imgFilename.c_str());
-		return 1;
-	}
-
 	////////////////////////////////////////////////////////////////////////////////////////////
 	// Load/Init
 	////////////////////////////////////////////////////////////////////////////////////////////
 
-	Expected<std::unique_ptr<VDevice>> vdevice_exp = VDevice::create();
-	if (!vdevice_exp) {
-		printf("Failed to create vdevice\n");
-		return vdevice_exp.status();
-	}
-	std::unique_ptr<hailort::VDevice> vdevice = vdevice_exp.release();
-
-	// Create infer model from HEF file.
-	Expected<std::shared_ptr<InferModel>> infer_model_exp = vdevice->create_infer_model(hefFile);
-	if (!infer_model_exp) {
+	// Get the infer model. Everything below is set again before every configure(), because the
+	// model is shared between runs.
+	std::shared_ptr<hailort::InferModel> infer_model;
+	auto                                 status = modelCache.Get(*vdevice, hefFile, infer_model);
+	if (status != HAILO_SUCCESS) {
 		printf("Failed to create infer model\n");
-		return infer_model_exp.status();
+		return status;
 	}
-	std::shared_ptr<hailort::InferModel> infer_model = infer_model_exp.release();
 	infer_model->set_hw_latency_measurement_flags(HAILO_LATENCY_MEASURE);
 	infer_model->set_batch_size(batchSize);
 	infer_model->output()->set_nms_score_threshold(confidenceThreshold);
 	infer_model->output()->set_nms_iou_threshold(nmsIoUThreshold);
 
-	//printf("infer_model N inputs: %d\n", (int) infer_model->inputs().size());
-	//printf("infer_model N outputs: %d\n", (int) infer_model->outputs().size());
-	//printf("infer_model inputstream[0]: %s\n", DumpStream(infer_model->inputs()[0]).c_str());
-	//printf("infer_model outputstream[0]: %s\n", DumpStream(infer_model->outputs()[0]).c_str());
-	for (auto inputName : infer_model->get_input_names()) {
-		printf("Input name: %s\n", inputName.c_str());
-	}
-	for (auto outputName : infer_model->get_output_names()) {
-		printf("Output name: %s\n", outputName.c_str());
-	}
-
 	int nnWidth  = infer_model->inputs()[0].shape().width;
 	int nnHeight = infer_model->inputs()[0].shape().height;
 
-	//if (imgWidth * imgHeight * imgChan != input_frame_size) {
-	//	printf("Input image resolution %d x %d x %d = %d not equal to NN input size %d", imgWidth, imgHeight, imgChan, int(imgWidth * imgHeight * imgChan), (int) input_frame_size);
-	//}
-	if (imgWidth != nnWidth || imgHeight != nnHeight) {
-		printf("Input image resolution %d x %d not equal to NN input resolution %d x %d\n", imgWidth, imgHeight, nnWidth, nnHeight);
-	}
-
 	// Configure the infer model
-	// infer_model->output()->set_format_type(HAILO_FORMAT_TYPE_FLOAT32);
 	Expected<ConfiguredInferModel> configured_infer_model_exp = infer_model->configure();
-	//auto configured_infer_model_exp = infer_model->configure();
 	if (!configured_infer_model_exp) {
 		printf("Failed to get configured infer model\n");
 		return configured_infer_model_exp.status();
 	}
 	std::shared_ptr<hailort::ConfiguredInferModel> configured_infer_model = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
 
-	auto startTime = std::chrono::high_resolution_clock::now(); // this will be overwritten after the 1st run
-
-	////////////////////////////////////////////////////////////////////////////////////////////
-	// Run
-	////////////////////////////////////////////////////////////////////////////////////////////
-
 	const std::string& input_name       = infer_model->get_input_names()[0];
 	size_t             input_frame_size = infer_model->input(input_name)->get_frame_size();
-	//printf("input_name: %s\n", input_name.c_str());
-	//printf("input_frame_size: %d\n", (int) input_frame_size); // eg 640x640x3 = 1228800
-
-	size_t singleImageSize = imgWidth * imgHeight * imgChan;
-	//uint8_t* img_batch       = (uint8_t*) malloc(singleImageSize * batchSize);
-	//for (int i = 0; i < batchSize; i++) {
-	//	memcpy(img_batch + i * singleImageSize, img_rgb_8, singleImageSize);
-	//}
-
-	int nRun = 10;
-
-	for (int iRun = 0; iRun < nRun + 1; iRun++) {
-		if (iRun == 1) {
-			// Ignore the first run, which is much slower than the rest
-			startTime = std::chrono::high_resolution_clock::now();
-		}
-
-		// Waiting for available requests in the pipeline.
-		auto status = configured_infer_model->wait_for_async_ready(1s);
-		if (status != HAILO_SUCCESS) {
-			printf("Failed to wait for async ready, status = %d", (int) status);
-			return status;
-		}
-
-		// Create infer bindings
-		std::vector<ConfiguredInferModel::Bindings> bindings_batch;
-		std::vector<OutTensor>                      output_tensors_batch;
 
+	// Create all bindings and output buffers up front, so that the measurement loop does
+	// nothing but submit and wait.
+	PageAlignedAllocator               allocator;
+	std::vector<std::unique_ptr<Slot>> slots;
+	for (int iSlot = 0; iSlot < inFlight; iSlot++) {
+		auto slot = std::make_unique<Slot>();
 		for (int i = 0; i < batchSize; i++) {
 			Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model->create_bindings();
 			if (!bindings_exp) {
@@ -129,7 +141,7 @@ int run() {
 				return bindings_exp.status();
 			}
 
-			status = bindings_exp->input(input_name)->set_buffer(MemoryView(img_rgb_8, input_frame_size));
+			auto status = bindings_exp->input(input_name)->set_buffer(MemoryView(img_rgb_8, input_frame_size));
 			if (status != HAILO_SUCCESS) {
 				printf("Failed to set memory buffer: %d\n", (int) status);
 				return status;
@@ -137,13 +149,11 @@ int run() {
 
 			// Output tensors.
 			for (auto const& output_name : infer_model->get_output_names()) {
-				size_t output_size = infer_model->output(output_name)->get_frame_size();
-				//printf("output_size = %d\n", (int) output_size);
-
-				uint8_t* output_buffer = (uint8_t*) malloc(output_size);
-				if (!output_buffer) {
+				size_t   output_size   = infer_model->output(output_name)->get_frame_size();
+				uint8_t* output_buffer = (uint8_t*) allocator.Alloc(output_size);
+				if (output_buffer == MAP_FAILED) {
 					printf("Could not allocate an output buffer!");
-					return status;
+					return HAILO_OUT_OF_HOST_MEMORY;
 				}
 
 				status = bindings_exp->output(output_name)->set_buffer(MemoryView(output_buffer, output_size));
@@ -155,52 +165,583 @@ int run() {
 				const std::vector<hailo_quant_info_t> quant  = infer_model->output(output_name)->get_quant_infos();
 				const hailo_3d_image_shape_t          shape  = infer_model->output(output_name)->shape();
 				const hailo_format_t                  format = infer_model->output(output_name)->format();
-				output_tensors_batch.emplace_back(output_buffer, output_name, quant[0], shape, format);
+				slot->Outputs.emplace_back(output_buffer, output_name, quant[0], shape, format);
 			}
 
-			bindings_batch.emplace_back(std::move(bindings_exp.release()));
+			slot->Bindings.emplace_back(std::move(bindings_exp.release()));
+		}
+		slots.push_back(std::move(slot));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////
+	// Run
+	////////////////////////////////////////////////////////////////////////////////////////////
+
+	HdrHistogram     latencyNs; // One entry per frame
+	LatencyBreakdown breakdown;
+	int64_t          nBatches  = 0;
+	bool             warmingUp = warmupSeconds > 0;
+	auto             startTime = std::chrono::steady_clock::now();
+
+	// Wait for the slot's job to finish, and record its latency
+	auto finish = [&](Slot* slot) -> hailo_status {
+		if (!slot->Job)
+			return HAILO_SUCCESS;
+		uint64_t traceStart = Tracer::NowNs();
+		auto     status     = slot->Job->wait(5s);
+		Tracer::Record("job.wait", traceStart, Tracer::NowNs());
+		slot->Job.reset();
+		if (status != HAILO_SUCCESS) {
+			printf("Failed to wait for inference to finish, status = %d\n", (int) status);
+			return status;
+		}
+		// The job can be signalled as done a moment before our callback has run. The callback
+		// publishes Status before CompletedAt, so once we see CompletedAt, Status is this batch's.
+		while (slot->CompletedAt.load(std::memory_order_acquire) == 0)
+			std::this_thread::yield();
+		hailo_status batchStatus = slot->Status.load(std::memory_order_relaxed);
+		if (batchStatus != HAILO_SUCCESS) {
+			printf("Inference failed, status = %d\n", (int) batchStatus);
+			return batchStatus;
+		}
+		telemetry.OnConsume(slot->CompletedAt);
+		breakdown.Record(slot->SubmittedAt, slot->CompletedAt, QueryHwLatencyNs(*configured_infer_model), batchSize);
+		if (!warmingUp) {
+			latencyNs.Record(slot->CompletedAt - slot->SubmittedAt, batchSize);
+			nBatches++;
+		}
+		return HAILO_SUCCESS;
+	};
+
+	for (size_t iSubmit = 0;; iSubmit++) {
+		Slot* slot   = slots[iSubmit % slots.size()].get();
+		auto  status = finish(slot);
+		if (status != HAILO_SUCCESS)
+			return status;
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (warmingUp && elapsed >= warmupSeconds) {
+			// Discard everything measured so far. Jobs that are still in flight will be counted,
+			// so that the device queue doesn't drain between warmup and measurement.
+			warmingUp = false;
+			startTime = std::chrono::steady_clock::now();
+			telemetry.Reset();
+			breakdown.Reset();
+			affinity.StartMeasurement();
+			elapsed = 0;
+		}
+		if (!warmingUp) {
+			int64_t pending = 0;
+			for (const auto& s : slots)
+				pending += s->Job ? 1 : 0;
+			if (iterations > 0 ? nBatches + pending >= iterations : elapsed >= durationSeconds)
+				break;
+		}
+
+		// Waiting for available requests in the pipeline.
+		uint64_t traceStart = Tracer::NowNs();
+		status              = telemetry.WaitForAsyncReady(*configured_infer_model, 1s, batchSize);
+		Tracer::Record("wait_for_async_ready", traceStart, Tracer::NowNs());
+		if (status != HAILO_SUCCESS) {
+			printf("Failed to wait for async ready, status = %d", (int) status);
+			return status;
 		}
 
 		// Dispatch the job.
-		Expected<AsyncInferJob> job_exp = configured_infer_model->run_async(bindings_batch, [](const AsyncInferCompletionInfo& completion_info) {
-			// Use completion_info to get the async operation status
+		slot->SubmittedAt = TelemetryNowNs();
+		slot->Status.store(HAILO_SUCCESS, std::memory_order_relaxed);
+		slot->CompletedAt.store(0, std::memory_order_relaxed);
+		Expected<AsyncInferJob> job_exp = configured_infer_model->run_async(slot->Bindings, [slot, &affinity, &telemetry](const AsyncInferCompletionInfo& completion_info) {
 			// Note that this callback must be executed as quickly as possible
-			(void) completion_info.status;
+			affinity.EnterOnce("callback");
+			uint64_t completedAt = telemetry.OnComplete(batchSize);
+			slot->Status.store(completion_info.status, std::memory_order_relaxed);
+			slot->CompletedAt.store(completedAt, std::memory_order_release);
+			Tracer::Record("device", slot->SubmittedAt, completedAt);
 		});
+		Tracer::Record("run_async", slot->SubmittedAt, Tracer::NowNs());
 		if (!job_exp) {
 			printf("Failed to start async infer job, status = %d\n", (int) job_exp.status());
+			return job_exp.status();
+		}
+		slot->Job = job_exp.release();
+		telemetry.OnSubmit(batchSize);
+	}
+
+	// Drain the jobs that are still in flight
+	for (size_t i = 0; i < slots.size(); i++) {
+		auto status = finish(slots[i].get());
+		if (status != HAILO_SUCCESS)
 			return status;
+	}
+
+	double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	HdrHistogram::Snapshot latency = latencyNs.GetSnapshot();
+
+	result.Model       = hefFile;
+	result.BatchSize   = batchSize;
+	result.InFlight    = inFlight;
+	result.NNWidth     = nnWidth;
+	result.NNHeight    = nnHeight;
+	result.Frames      = nBatches * batchSize;
+	result.Seconds     = elapsedSeconds;
+	result.FPS         = result.Frames / elapsedSeconds;
+	result.LatencyMean = latency.Mean() / 1e6;
+	result.LatencyP50  = latency.Percentile(50) / 1e6;
+	result.LatencyP90  = latency.Percentile(90) / 1e6;
+	result.LatencyP99  = latency.Percentile(99) / 1e6;
+	result.LatencyMax  = latency.Max / 1e6;
+	result.QueueMean   = breakdown.QueueNs.Mean() / 1e6;
+	result.DeviceMean  = breakdown.DeviceNs.Mean() / 1e6;
+	result.HostMean    = breakdown.HostNs.Mean() / 1e6;
+
+	if (printDetails) {
+		auto queueSize = configured_infer_model->get_async_queue_size();
+		telemetry.Print(queueSize ? (uint32_t) queueSize.release() : batchSize);
+		// The HailoRT callback threads go away with the configured model, so print this now
+		affinity.PrintCpuTimes(elapsedSeconds);
+	}
+
+	return HAILO_SUCCESS;
+}
+
+void PrintResult(const BenchResult& r) {
+	printf("%-16s %d\n", "Batch size", r.BatchSize);
+	printf("%-16s %d\n", "In flight", r.InFlight);
+	printf("%-16s %s\n", "Model", r.Model.c_str());
+	printf("%-16s %d x %d\n", "NN resolution", r.NNWidth, r.NNHeight);
+	printf("%-16s %d in %.1fs\n", "Frames", (int) r.Frames, r.Seconds);
+	printf("%-16s %.2f\n", "FPS", r.FPS);
+	printf("%-16s %.1fms\n", "Time per frame", r.FPS > 0 ? 1000.0 / r.FPS : 0.0);
+	printf("%-16s mean %.2fms, p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms\n", "Latency", r.LatencyMean, r.LatencyP50, r.LatencyP90, r.LatencyP99, r.LatencyMax);
+	printf("%-16s queue %.2fms, device %.2fms, host %.2fms (means)\n", "Latency split", r.QueueMean, r.DeviceMean, r.HostMean);
+}
+
+void WriteJSONObject(FILE* f, const BenchResult& r, const char* indent) {
+	fprintf(f, "%s{\n", indent);
+	fprintf(f, "%s  \"model\": \"%s\",\n", indent, JSONEscape(r.Model).c_str());
+	fprintf(f, "%s  \"batch_size\": %d,\n", indent, r.BatchSize);
+	fprintf(f, "%s  \"in_flight\": %d,\n", indent, r.InFlight);
+	fprintf(f, "%s  \"nn_width\": %d,\n", indent, r.NNWidth);
+	fprintf(f, "%s  \"nn_height\": %d,\n", indent, r.NNHeight);
+	fprintf(f, "%s  \"frames\": %lld,\n", indent, (long long) r.Frames);
+	fprintf(f, "%s  \"seconds\": %.4f,\n", indent, r.Seconds);
+	fprintf(f, "%s  \"fps\": %.3f,\n", indent, r.FPS);
+	fprintf(f, "%s  \"latency_mean_ms\": %.4f,\n", indent, r.LatencyMean);
+	fprintf(f, "%s  \"latency_p50_ms\": %.4f,\n", indent, r.LatencyP50);
+	fprintf(f, "%s  \"latency_p90_ms\": %.4f,\n", indent, r.LatencyP90);
+	fprintf(f, "%s  \"latency_p99_ms\": %.4f,\n", indent, r.LatencyP99);
+	fprintf(f, "%s  \"latency_max_ms\": %.4f,\n", indent, r.LatencyMax);
+	fprintf(f, "%s  \"queue_mean_ms\": %.4f,\n", indent, r.QueueMean);
+	fprintf(f, "%s  \"device_mean_ms\": %.4f,\n", indent, r.DeviceMean);
+	fprintf(f, "%s  \"host_mean_ms\": %.4f,\n", indent, r.HostMean);
+	fprintf(f, "%s  \"runs\": %d,\n", indent, r.Runs);
+	fprintf(f, "%s  \"fps_stddev\": %.3f,\n", indent, r.FPSStdDev);
+	fprintf(f, "%s  \"latency_mean_ms_stddev\": %.4f,\n", indent, r.LatencyMeanStdDev);
+	fprintf(f, "%s  \"latency_p50_ms_stddev\": %.4f,\n", indent, r.LatencyP50StdDev);
+	fprintf(f, "%s  \"latency_p99_ms_stddev\": %.4f\n", indent, r.LatencyP99StdDev);
+	fprintf(f, "%s}", indent);
+}
+
+// A single result is written as an object, and a sweep as an array of objects
+bool WriteJSON(const std::string& filename, const std::vector<BenchResult>& results) {
+	FILE* f = fopen(filename.c_str(), "w");
+	if (!f)
+		return false;
+	if (results.size() == 1) {
+		WriteJSONObject(f, results[0], "");
+	} else {
+		fprintf(f, "[\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			WriteJSONObject(f, results[i], "  ");
+			fprintf(f, i + 1 < results.size() ? ",\n" : "\n");
 		}
-		hailort::AsyncInferJob job = job_exp.release();
+		fprintf(f, "]");
+	}
+	fprintf(f, "\n");
+	return fclose(f) == 0;
+}
 
-		// Wait for job completion.
-		status = job.wait(1s);
-		if (status != HAILO_SUCCESS) {
-			printf("Failed to wait for inference to finish, status = %d\n", (int) status);
+// Appends rows, and writes the header first if the file is new
+bool AppendCSV(const std::string& filename, const std::vector<BenchResult>& results) {
+	FILE* existing = fopen(filename.c_str(), "r");
+	bool  isNew    = existing == nullptr;
+	if (existing)
+		fclose(existing);
+	FILE* f = fopen(filename.c_str(), "a");
+	if (!f)
+		return false;
+	if (isNew)
+		fprintf(f, "model,batch_size,in_flight,nn_width,nn_height,frames,seconds,fps,latency_mean_ms,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms,queue_mean_ms,device_mean_ms,host_mean_ms,runs,fps_stddev,latency_p99_ms_stddev\n");
+	for (const auto& r : results) {
+		fprintf(f, "%s,%d,%d,%d,%d,%lld,%.4f,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%.3f,%.4f\n", r.Model.c_str(), r.BatchSize, r.InFlight, r.NNWidth, r.NNHeight,
+		        (long long) r.Frames, r.Seconds, r.FPS, r.LatencyMean, r.LatencyP50, r.LatencyP90, r.LatencyP99, r.LatencyMax, r.QueueMean, r.DeviceMean, r.HostMean, r.Runs,
+		        r.FPSStdDev, r.LatencyP99StdDev);
+	}
+	return fclose(f) == 0;
+}
+
+// Combine repeated runs of the same configuration into one result, whose metrics are the means
+// over all runs, with the run-to-run standard deviations alongside.
+BenchResult AggregateRuns(const std::vector<BenchResult>& runs) {
+	BenchResult r = runs[0];
+	if (runs.size() == 1)
+		return r;
+
+	auto mean = [&](double BenchResult::*field) {
+		double sum = 0;
+		for (const auto& run : runs)
+			sum += run.*field;
+		return sum / runs.size();
+	};
+	auto stddev = [&](double BenchResult::*field) {
+		double m   = mean(field);
+		double sum = 0;
+		for (const auto& run : runs)
+			sum += (run.*field - m) * (run.*field - m);
+		return sqrt(sum / (runs.size() - 1));
+	};
+
+	r.Frames = 0;
+	for (const auto& run : runs)
+		r.Frames += run.Frames;
+	r.Seconds           = mean(&BenchResult::Seconds);
+	r.FPS               = mean(&BenchResult::FPS);
+	r.LatencyMean       = mean(&BenchResult::LatencyMean);
+	r.LatencyP50        = mean(&BenchResult::LatencyP50);
+	r.LatencyP90        = mean(&BenchResult::LatencyP90);
+	r.LatencyP99        = mean(&BenchResult::LatencyP99);
+	r.LatencyMax        = mean(&BenchResult::LatencyMax);
+	r.QueueMean         = mean(&BenchResult::QueueMean);
+	r.DeviceMean        = mean(&BenchResult::DeviceMean);
+	r.HostMean          = mean(&BenchResult::HostMean);
+	r.Runs              = (int) runs.size();
+	r.FPSStdDev         = stddev(&BenchResult::FPS);
+	r.LatencyMeanStdDev = stddev(&BenchResult::LatencyMean);
+	r.LatencyP50StdDev  = stddev(&BenchResult::LatencyP50);
+	r.LatencyP99StdDev  = stddev(&BenchResult::LatencyP99);
+	return r;
+}
+
+// Run the current configuration 'repeats' times, and aggregate the results
+int RunRepeated(hailort::VDevice* vdevice, unsigned char* img_rgb_8, StageAffinity& affinity, bool printDetails, BenchResult& result) {
+	std::vector<BenchResult> runs;
+	for (int i = 0; i < repeats; i++) {
+		PipelineTelemetry telemetry;
+		BenchResult       run;
+		// Only print the details of the last run, so that they're not repeated
+		auto status = RunBenchmark(vdevice, img_rgb_8, affinity, telemetry, printDetails && i == repeats - 1, run);
+		if (status != HAILO_SUCCESS)
 			return status;
+		if (repeats > 1)
+			printf("Run %d of %d: %.2f FPS, p50 %.2fms, p99 %.2fms\n", i + 1, repeats, run.FPS, run.LatencyP50, run.LatencyP99);
+		runs.push_back(run);
+	}
+	result = AggregateRuns(runs);
+	return HAILO_SUCCESS;
+}
+
+// Convert to the same form as a result that was loaded from JSON
+BenchRecord ToBenchRecord(const BenchResult& r) {
+	BenchRecord rec;
+	rec.Strings["model"]                  = r.Model;
+	rec.Numbers["batch_size"]             = r.BatchSize;
+	rec.Numbers["in_flight"]              = r.InFlight;
+	rec.Numbers["runs"]                   = r.Runs;
+	rec.Numbers["fps"]                    = r.FPS;
+	rec.Numbers["fps_stddev"]             = r.FPSStdDev;
+	rec.Numbers["latency_mean_ms"]        = r.LatencyMean;
+	rec.Numbers["latency_mean_ms_stddev"] = r.LatencyMeanStdDev;
+	rec.Numbers["latency_p50_ms"]         = r.LatencyP50;
+	rec.Numbers["latency_p50_ms_stddev"]  = r.LatencyP50StdDev;
+	rec.Numbers["latency_p99_ms"]         = r.LatencyP99;
+	rec.Numbers["latency_p99_ms_stddev"]  = r.LatencyP99StdDev;
+	return rec;
+}
+
+// Compare every result against the baseline result with the same model, batch size and
+// in-flight count. Returns false if the baseline could not be loaded. Sets regressionDetected, and
+// baselineIncomplete if a result has nothing to compare with.
+bool CompareWithBaseline(const std::string& filename, const std::vector<BenchResult>& results) {
+	std::vector<BenchRecord> baseline;
+	if (!LoadBenchJSON(filename, baseline)) {
+		printf("Failed to read baseline %s\n", filename.c_str());
+		return false;
+	}
+	// Without repeated runs, the t-test is skipped, and only the relative threshold applies
+	std::vector<MetricSpec> metrics = {
+	    {"fps", true},
+	    {"latency_mean_ms", false},
+	    {"latency_p50_ms", false},
+	    {"latency_p99_ms", false},
+	};
+	printf("\nComparing with baseline %s (threshold %.1f%%)\n", filename.c_str(), 100 * regressionThreshold);
+	for (const auto& r : results) {
+		BenchRecord current = ToBenchRecord(r);
+		auto        match   = std::find_if(baseline.begin(), baseline.end(), [&](const BenchRecord& b) {
+			return b.String("model") == r.Model && (int) b.Number("batch_size") == r.BatchSize && (int) b.Number("in_flight") == r.InFlight;
+		});
+		if (match == baseline.end()) {
+			printf("batch %d, inflight %d: not in baseline\n", r.BatchSize, r.InFlight);
+			baselineIncomplete = true;
+			continue;
 		}
+		char title[128];
+		snprintf(title, sizeof(title), "batch %d, inflight %d (%d vs %d runs):", r.BatchSize, r.InFlight, (int) match->Number("runs", 1), r.Runs);
+		if (PrintBenchComparison(title, CompareBenchRecords(*match, current, metrics, regressionThreshold)))
+			regressionDetected = true;
+	}
+	if (regressionDetected)
+		printf("Performance regression against baseline\n");
+	return true;
+}
+
+// Parse a list such as "1,2,4,8". Returns false if any element is not a positive integer.
+bool ParseIntList(const std::string& s, std::vector<int>& list) {
+	size_t i = 0;
+	while (i < s.size()) {
+		size_t end = s.find(',', i);
+		end        = end == std::string::npos ? s.size() : end;
+		int v      = atoi(s.substr(i, end - i).c_str());
+		if (v < 1)
+			return false;
+		list.push_back(v);
+		i = end + 1;
+	}
+	return !list.empty();
+}
+
+// Returns the indices of the results which are not dominated by any other result, where
+// dominated means that another result has higher (or equal) FPS and lower (or equal) p99 latency,
+// and is strictly better in at least one of the two. Sorted by ascending latency.
+std::vector<size_t> ParetoFrontier(const std::vector<BenchResult>& results) {
+	std::vector<size_t> frontier;
+	for (size_t i = 0; i < results.size(); i++) {
+		bool dominated = false;
+		for (size_t j = 0; j < results.size() && !dominated; j++) {
+			const auto& a = results[i];
+			const auto& b = results[j];
+			dominated     = b.FPS >= a.FPS && b.LatencyP99 <= a.LatencyP99 && (b.FPS > a.FPS || b.LatencyP99 < a.LatencyP99);
+		}
+		if (!dominated)
+			frontier.push_back(i);
+	}
+	std::sort(frontier.begin(), frontier.end(), [&](size_t a, size_t b) { return results[a].LatencyP99 < results[b].LatencyP99; });
+	return frontier;
+}
+
+void PrintSweepTable(const std::vector<BenchResult>& results) {
+	std::vector<size_t> frontier = ParetoFrontier(results);
+	printf("%6s %9s %10s %10s %10s %10s %10s %7s\n", "batch", "inflight", "fps", "p50 ms", "p99 ms", "max ms", "device ms", "pareto");
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto& r        = results[i];
+		bool        isPareto = std::find(frontier.begin(), frontier.end(), i) != frontier.end();
+		printf("%6d %9d %10.2f %10.2f %10.2f %10.2f %10.2f %7s\n", r.BatchSize, r.InFlight, r.FPS, r.LatencyP50, r.LatencyP99, r.LatencyMax, r.DeviceMean, isPareto ? "*" : "");
+	}
+	printf("\nPareto frontier (p99 latency vs FPS):\n");
+	for (size_t i : frontier)
+		printf("  batch %d, inflight %d: %.2f FPS at %.2fms p99\n", results[i].BatchSize, results[i].InFlight, results[i].FPS, results[i].LatencyP99);
+}
+
+int run() {
+	using namespace hailort;
+
+	Tracer::Enabled = traceFilename != "";
+
+	StageAffinity affinity;
+	if (!affinity.Parse(stageAffinity)) {
+		printf("Invalid stage affinity '%s'\n", stageAffinity.c_str());
+		return 1;
+	}
+	affinity.Enter("submit");
+	if (submitPriority > 0 && SetRealtimePriority(submitPriority) != 0)
+		printf("Failed to set SCHED_FIFO priority %d for the submission thread (needs CAP_SYS_NICE)\n", submitPriority);
+
+	// Read the HEF and decode the image while the device is being opened
+
+	StartupTimer startup;
+	auto         hefRead = std::async(std::launch::async, [&] { return startup.Time("read HEF", [&] { return modelCache.Preload(hefFile); }); });
+
+	int  imgWidth = 0, imgHeight = 0, imgChan = 0;
+	auto imgDecode = std::async(std::launch::async, [&] {
+		return startup.Time("stbi_load", [&] { return stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3); });
+	});
+
+	Expected<std::unique_ptr<VDevice>> vdevice_exp = startup.Time("VDevice::create", [] { return VDevice::create(); });
+	if (!vdevice_exp) {
+		printf("Failed to create vdevice\n");
+		return vdevice_exp.status();
+	}
+	std::unique_ptr<hailort::VDevice> vdevice = vdevice_exp.release();
 
-		for (auto out : output_tensors_batch) {
-			free(out.data);
+	unsigned char* img_rgb_8 = imgDecode.get();
+	if (!img_rgb_8) {
+		printf("Failed to load image %s\n", imgFilename.c_str());
+		return 1;
+	}
+	if (!hefRead.get()) {
+		printf("Failed to read %s\n", hefFile.c_str());
+		return 1;
+	}
+	std::shared_ptr<hailort::InferModel> infer_model;
+	auto                                 status = startup.Time("create infer model", [&] { return modelCache.Get(*vdevice, hefFile, infer_model); });
+	if (status != HAILO_SUCCESS) {
+		printf("Failed to create infer model\n");
+		return status;
+	}
+	startup.Print();
+	printf("\n");
+
+	std::vector<BenchResult> results;
+
+	if (sweepBatchSizes != "" || sweepInFlight != "") {
+		// Reconfigure the model for every combination of batch size and in-flight count
+		std::vector<int> batchSizes, inFlights;
+		if (!ParseIntList(sweepBatchSizes != "" ? sweepBatchSizes : std::to_string(batchSize), batchSizes) ||
+		    !ParseIntList(sweepInFlight != "" ? sweepInFlight : std::to_string(inFlight), inFlights)) {
+			printf("Invalid sweep list\n");
+			return 1;
 		}
+		for (int b : batchSizes) {
+			for (int n : inFlights) {
+				batchSize = b;
+				inFlight  = n;
+				BenchResult result;
+				auto        status = RunRepeated(vdevice.get(), img_rgb_8, affinity, false, result);
+				if (status != HAILO_SUCCESS)
+					return status;
+				printf("batch %d, inflight %d: %.2f FPS, p99 %.2fms\n", b, n, result.FPS, result.LatencyP99);
+				results.push_back(result);
+			}
+		}
+		printf("\n");
+		PrintSweepTable(results);
+	} else {
+		BenchResult result;
+		auto        status = RunRepeated(vdevice.get(), img_rgb_8, affinity, true, result);
+		if (status != HAILO_SUCCESS)
+			return status;
+		PrintResult(result);
+		results.push_back(result);
 	}
 
-	double elapsedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
-	int    nFrames        = nRun * batchSize;
-	printf("%-16s %d\n", "Batch size", batchSize);
-	printf("%-16s %s\n", "Model", hefFile.c_str());
-	printf("%-16s %d x %d\n", "NN resolution", nnWidth, nnHeight);
-	printf("%-16s %.2f\n", "FPS", nFrames / elapsedSeconds);
-	printf("%-16s %.1fms\n", "Time per frame", 1000.0 * elapsedSeconds / nFrames);
+	if (results[0].NNWidth != imgWidth || results[0].NNHeight != imgHeight) {
+		printf("Input image resolution %d x %d not equal to NN input resolution %d x %d\n", imgWidth, imgHeight, results[0].NNWidth, results[0].NNHeight);
+	}
+
+	if (jsonFilename != "" && !WriteJSON(jsonFilename, results)) {
+		printf("Failed to write %s\n", jsonFilename.c_str());
+		return 1;
+	}
+	if (csvFilename != "" && !AppendCSV(csvFilename, results)) {
+		printf("Failed to write %s\n", csvFilename.c_str());
+		return 1;
+	}
+	if (Tracer::Enabled && !Tracer::WriteChromeJSON(traceFilename)) {
+		printf("Failed to write %s\n", traceFilename.c_str());
+		return 1;
+	}
+	if (baselineFilename != "" && !CompareWithBaseline(baselineFilename, results))
+		return 1;
 
 	return 123456789;
 }
 
+void PrintHelp() {
+	printf("Usage: yolov8-fps [options]\n");
+	printf("  --hef <file>          Model (default %s)\n", hefFile.c_str());
+	printf("  --image <file>        Input image (default %s)\n", imgFilename.c_str());
+	printf("  --batch <n>           Batch size (default %d)\n", batchSize);
+	printf("  --inflight <n>        Batches in flight at once (default %d)\n", inFlight);
+	printf("  --duration <seconds>  Measurement time after warmup (default %.0f)\n", durationSeconds);
+	printf("  --iterations <n>      Measure n batches instead of a fixed duration\n");
+	printf("  --warmup <seconds>    Warmup time, which is not measured (default %.0f)\n", warmupSeconds);
+	printf("  --json <file>         Write results as JSON\n");
+	printf("  --csv <file>          Append results as a CSV row\n");
+	printf("  --trace <file>        Write a Chrome trace, which you can open in https://ui.perfetto.dev\n");
+	printf("  --affinity <map>      Pin threads to cores, eg submit=1,callback=2\n");
+	printf("  --priority <n>        Run the submission thread with SCHED_FIFO at priority n\n");
+	printf("  --sweep-batch <list>  Measure each of these batch sizes, eg 1,2,4,8\n");
+	printf("  --sweep-inflight <list> Measure each of these in-flight counts, eg 1,2,4\n");
+	printf("                        Each sweep point runs for --duration, after --warmup\n");
+	printf("  --repeat <n>          Run each configuration n times, and report the mean and stddev\n");
+	printf("  --baseline <file>     Compare with a previous --json result. Exit with 2 on a regression, 3 if a configuration isn't in it\n");
+	printf("  --threshold <frac>    Relative change that counts as a regression (default %.2f)\n", regressionThreshold);
+}
+
+// Returns false if the arguments are invalid
+bool ParseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--help" || arg == "-h") {
+			return false;
+		} else if (next == nullptr) {
+			printf("Missing value for %s\n", arg.c_str());
+			return false;
+		} else if (arg == "--hef") {
+			hefFile = next;
+		} else if (arg == "--image") {
+			imgFilename = next;
+		} else if (arg == "--batch") {
+			batchSize = atoi(next);
+		} else if (arg == "--inflight") {
+			inFlight = atoi(next);
+		} else if (arg == "--duration") {
+			durationSeconds = atof(next);
+		} else if (arg == "--iterations") {
+			iterations = atoi(next);
+		} else if (arg == "--warmup") {
+			warmupSeconds = atof(next);
+		} else if (arg == "--json") {
+			jsonFilename = next;
+		} else if (arg == "--csv") {
+			csvFilename = next;
+		} else if (arg == "--trace") {
+			traceFilename = next;
+		} else if (arg == "--affinity") {
+			stageAffinity = next;
+		} else if (arg == "--priority") {
+			submitPriority = atoi(next);
+		} else if (arg == "--sweep-batch") {
+			sweepBatchSizes = next;
+		} else if (arg == "--sweep-inflight") {
+			sweepInFlight = next;
+		} else if (arg == "--repeat") {
+			repeats = atoi(next);
+		} else if (arg == "--baseline") {
+			baselineFilename = next;
+		} else if (arg == "--threshold") {
+			regressionThreshold = atof(next);
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			return false;
+		}
+		i++;
+	}
+	if (batchSize < 1 || inFlight < 1 || repeats < 1) {
+		printf("Batch size, in-flight count and repeat count must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char** argv) {
+	if (!ParseArgs(argc, argv)) {
+		PrintHelp();
+		return 1;
+	}
 	int status = run();
 	if (status == 123456789)
 		printf("SUCCESS\n");
 	else
 		printf("Failed with error code %d\n", status);
-	return 0;
-}
\ No newline at end of file
+	// A non-zero exit code lets a CI script fail the build on a failure, a slowdown, or a
+	// baseline that doesn't cover what was measured
+	if (status != 123456789)
+		return 1;
+	if (regressionDetected)
+		return 2;
+	return baselineIncomplete ? 3 : 0;
+}
@@ -0,0 +1,1043 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../detection_stream.h"
+#include "../frame_skip.h"
+#include "../motion.h"
+#include "../nms.h"
+#include "../tiling.h"
+#include "../tracker.h"
+#include "../video_reader.h"
+#include "../yuv.h"
+#include "allocator.h"
+#include "backend.h"
+#include "histogram.h"
+#include "sim_backend.h"
+#include "tensor_record.h"
+
+#ifndef NO_HAILORT
+#include "hailo_backend.h"
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+// Measures the throughput and latency of the whole host pipeline: copy a frame into the input
+// buffer, submit it, wait for the result, and parse the NMS output.
+// With --sim, the device is replaced by SimBackend, so this runs on any Linux machine. Build
+// with -DNO_HAILORT to leave out HailoRT entirely.
+// With --record, the output tensors of every frame are saved, and --replay runs the postprocessing
+// on a recording as fast as possible, without any device.
+// With --video, the frames come from an MJPEG or Y4M file instead of a single image, and are
+// decoded straight into the input buffers (see video_reader.h).
+// With --tiles, each frame is cut into overlapping tiles, which go to the device as one batch,
+// and their detections are merged (see tiling.h).
+// With --motion, frames (or tiles) that haven't changed since they last went through the network
+// are not submitted, and their previous detections are reused (see motion.h).
+// With --track, the detections of every frame go through a multi-object tracker (see tracker.h).
+// With --every, only some frames go through the network, and the tracker predicts the boxes of
+// the others (see frame_skip.h).
+
+// g++ -O2 -o yolov8-pipeline advanced/yolov8-pipeline.cpp -lhailort && ./yolov8-pipeline
+// g++ -O2 -DNO_HAILORT -o yolov8-pipeline-sim advanced/yolov8-pipeline.cpp && ./yolov8-pipeline-sim --sim
+
+std::string hefFile             = "yolov8s.hef";
+std::string imgFilename         = "test-image-640x640.jpg";
+std::string videoFilename       = "";    // If not empty, process the frames of this MJPEG or Y4M file, instead of imgFilename over and over
+bool        loopVideo           = false; // Go back to the start of the video at the end, and run for durationSeconds. Otherwise stop at the end.
+int         decodeThreads       = 1;     // Threads that decode the video frames of a batch in parallel
+float       confidenceThreshold = 0.5f;  // Lower number = accept more boxes
+float       nmsIoUThreshold     = 0.45f; // Lower number = merge more boxes (I think!)
+int         batchSize           = 8;
+int         inFlight            = 2;     // Number of batches submitted at the same time
+double      durationSeconds     = 5;
+double      warmupSeconds       = 1;
+bool        useSim              = false;
+double      simFixedMs          = 0.5;   // SimBackend latency per batch...
+double      simFrameMs          = 3.0;   // ...plus this much per frame...
+double      simJitterMs         = 0;     // ...plus gaussian jitter with this stddev
+int         simQueueDepth       = 4;     // Batches that fit in the simulated async queue
+int         simBoxes            = 5;     // Synthetic boxes per frame
+std::string simNMSFilename      = "";    // If not empty, a raw NMS output buffer to use instead of synthetic boxes
+std::string recordFilename      = "";    // If not empty, append the output tensors of every frame here
+std::string replayFilename      = "";    // If not empty, measure postprocessing of this recording instead of running inference
+std::string detectionsFilename  = "";    // If not empty, write the detections of every frame here, in the format of detection_stream.h
+double      ringMB              = 0;     // If > 0, detectionsFilename is a ring buffer of this size (eg in /dev/shm), instead of a file
+bool        useTiles            = false; // Cut each frame into tiles, which are run as one batch (the batch size is the number of tiles)
+TileConfig  tileConfig;                  // Tile layout, and overlap
+float       tileMergeOverlap    = 0.5f;  // Boxes from different tiles that overlap by more than this are the same object
+bool        useMotion           = false; // Only run frames (or tiles) that have changed, and reuse the detections of the others
+int         motionThreshold     = 6;     // Mean absolute luma difference of a 64x64 block, above which it has changed
+bool        useTracker          = false; // Track objects across frames. Boxes down to the tracker's LowThreshold are parsed for it.
+int         inferEvery          = 1;     // Run inference on every nth frame, and let the tracker predict the others. 0 = adapt to the scene.
+int         inferEveryMax       = 8;     // With inferEvery = 0, the longest interval
+bool        verifySkips         = false; // Run a frame that would be skipped anyway, if something moved where no track can explain it
+
+// The tracker also wants the low confidence boxes, which are not written to the detection stream
+float ParseThreshold() {
+	return useTracker ? std::min(confidenceThreshold, ByteTracker().LowThreshold) : confidenceThreshold;
+}
+
+#ifdef NO_HAILORT
+const bool haveHailoRT = false;
+#else
+const bool haveHailoRT = true;
+#endif
+
+// The buffers of one batch, which is in flight independently of the other slots
+struct Slot {
+	std::vector<BackendFrame> Frames;
+	std::vector<Letterbox>    Boxes;  // With tiles, where each tile went in its input buffer
+	std::vector<BackendFrame> Batch;  // The frames that were submitted. With --motion, only those that changed.
+	std::vector<int>          Source; // For each frame (or tile), its index in Batch, or -1 to reuse its previous detections
+	uint64_t                  SubmittedAt = 0;
+	uint64_t                  CompletedAt = 0; // Protected by doneLock
+	int                       Status      = 0;
+	bool                      Pending     = false;
+};
+
+std::mutex              doneLock;
+std::condition_variable doneCV;
+
+uint64_t NowNs() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Decode a video frame straight into the input buffer, scaled to fit with conv. Returns false if
+// the frame is corrupt.
+bool DecodeVideoFrame(const VideoReader& video, const VideoFrame& frame, const TensorInfo& input, InputConverter& conv, uint8_t* dst) {
+	if (video.GetFormat() == VideoFormat::Y4M) {
+		conv.Convert(YUVImage::I420(frame.Data, video.Width, video.Height, video.FullRange), dst, input.Width, input.Height);
+		return true;
+	}
+	int            width = 0, height = 0, chan = 0;
+	unsigned char* rgb = stbi_load_from_memory(frame.Data, (int) frame.Size, &width, &height, &chan, 3);
+	if (!rgb) {
+		memset(dst, conv.PadValue, input.FrameSize);
+		return false;
+	}
+	conv.Convert(rgb, width, height, width * 3, dst, input.Width, input.Height);
+	stbi_image_free(rgb);
+	return true;
+}
+
+// Splits the decoding of a batch between the calling thread and nThreads - 1 workers, which live
+// as long as the pool. Each thread has its own InputConverter, so that the scaling tables are only
+// built once, rather than for every batch.
+class DecodePool {
+public:
+	using Work = std::function<void(size_t from, size_t to, InputConverter& conv)>;
+
+	explicit DecodePool(int nThreads) : Converters(std::max(1, nThreads)) {
+		for (int t = 1; t < nThreads; t++)
+			Threads.emplace_back([this, t] { Worker((size_t) t); });
+	}
+
+	~DecodePool() {
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			Stopping = true;
+		}
+		CV.notify_all();
+		for (auto& t : Threads)
+			t.join();
+	}
+
+	// Split [0, n) into one range per thread, run work on every range, and wait for all of them
+	void Run(size_t n, const Work& work) {
+		size_t nThreads = std::min(Converters.size(), n);
+		if (nThreads == 0)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			Job       = &work;
+			JobSize   = n;
+			JobRanges = nThreads;
+			Remaining = nThreads - 1;
+			Generation++;
+		}
+		CV.notify_all();
+		work(0, n / nThreads, Converters[0]);
+		std::unique_lock<std::mutex> lock(Lock);
+		DoneCV.wait(lock, [&] { return Remaining == 0; });
+	}
+
+private:
+	std::vector<InputConverter> Converters; // One per thread. The calling thread uses the first.
+	std::vector<std::thread>    Threads;
+	std::mutex                  Lock;
+	std::condition_variable     CV;
+	std::condition_variable     DoneCV;
+	const Work*                 Job        = nullptr;
+	size_t                      JobSize    = 0;
+	size_t                      JobRanges  = 0;
+	size_t                      Remaining  = 0; // Ranges of the current job that workers haven't finished
+	uint64_t                    Generation = 0; // Incremented for every job
+	bool                        Stopping   = false;
+
+	void Worker(size_t t) {
+		uint64_t                     seen = 0;
+		std::unique_lock<std::mutex> lock(Lock);
+		for (;;) {
+			CV.wait(lock, [&] { return Stopping || Generation != seen; });
+			if (Stopping)
+				return;
+			seen = Generation;
+			if (t >= JobRanges)
+				continue; // Fewer frames than threads
+			const Work* job = Job;
+			size_t      n = JobSize, ranges = JobRanges;
+			lock.unlock();
+			(*job)(t * n / ranges, (t + 1) * n / ranges, Converters[t]);
+			lock.lock();
+			if (--Remaining == 0)
+				DoneCV.notify_all();
+		}
+	}
+};
+
+// One frame to cut into tiles: a video frame (decoded first, if it's a JPEG), or the image
+struct TileSource {
+	YUVImage       YUV;
+	const uint8_t* RGB     = nullptr; // If not null, the frame is packed RGB, otherwise it is YUV
+	unsigned char* Decoded = nullptr;
+	int            Width   = 0;
+	int            Height  = 0;
+
+	~TileSource() { stbi_image_free(Decoded); }
+
+	// The frame is a video frame if video isn't null, otherwise img. Returns false if the video
+	// frame is corrupt, or not the same size as the first frame, which the tiles are laid out for.
+	bool Load(const VideoReader* video, const VideoFrame& frame, const unsigned char* img, int width, int height) {
+		Width  = width;
+		Height = height;
+		if (video && video->GetFormat() == VideoFormat::Y4M) {
+			YUV = YUVImage::I420(frame.Data, video->Width, video->Height, video->FullRange);
+			return true;
+		} else if (video) {
+			int w = 0, h = 0, chan = 0;
+			Decoded = stbi_load_from_memory(frame.Data, (int) frame.Size, &w, &h, &chan, 3);
+			RGB     = Decoded;
+			return Decoded && w == width && h == height;
+		}
+		RGB = img;
+		return true;
+	}
+
+	// The luma plane, for motion detection. For RGB, the green channel stands in for it.
+	void Luma(const uint8_t*& luma, int& stride, int& pixelStride) const {
+		luma        = RGB ? RGB + 1 : YUV.Y;
+		stride      = RGB ? Width * 3 : YUV.StrideY;
+		pixelStride = RGB ? 3 : 1;
+	}
+
+	// Compare the frame with the reference
+	int DetectMotion(MotionDetector& motion) const {
+		const uint8_t* luma;
+		int            stride, pixelStride;
+		Luma(luma, stride, pixelStride);
+		return motion.Detect(luma, Width, Height, stride, pixelStride);
+	}
+
+	Letterbox Cut(InputConverter& conv, const Tile& t, const TensorInfo& input, uint8_t* dst) const {
+		if (RGB)
+			return conv.Convert(RGB + ((size_t) t.Y * Width + t.X) * 3, t.Width, t.Height, Width * 3, dst, input.Width, input.Height);
+		return conv.Convert(YUV.Crop(t.X, t.Y, t.Width, t.Height), dst, input.Width, input.Height);
+	}
+};
+
+// Frames come from video if it isn't null, otherwise img is copied into every frame
+int RunPipeline(InferBackend* backend, unsigned char* img, int imgWidth, int imgHeight, VideoReader* video) {
+	using namespace std::literals::chrono_literals;
+
+	int status = backend->Configure(batchSize);
+	if (status == 0 && useTiles) {
+		// Now that we know the network's resolution, lay out the tiles, and configure for a batch of all of them
+		std::vector<Tile> tiles = MakeTiles(imgWidth, imgHeight, backend->Input().Width, backend->Input().Height, tileConfig);
+		if ((int) tiles.size() != batchSize) {
+			batchSize = (int) tiles.size();
+			status    = backend->Configure(batchSize);
+		}
+	}
+	if (status != 0) {
+		printf("Failed to configure %s backend, status = %d\n", backend->Name(), status);
+		return status;
+	}
+	const TensorInfo&              input   = backend->Input();
+	const std::vector<TensorInfo>& outputs = backend->Outputs();
+	std::vector<Tile>              tiles;
+	if (useTiles) {
+		tiles = MakeTiles(imgWidth, imgHeight, input.Width, input.Height, tileConfig);
+		printf("Cutting %d x %d frames into %d tiles of %d x %d%s\n", imgWidth, imgHeight, (int) tiles.size(), tiles[0].Width, tiles[0].Height,
+		       tileConfig.Global && tiles.size() > 1 ? ", including the whole frame" : "");
+	} else if ((int) input.Width != imgWidth || (int) input.Height != imgHeight) {
+		if (video)
+			printf("Video frames of %d x %d are scaled to fit the NN input resolution of %d x %d\n", imgWidth, imgHeight, input.Width, input.Height);
+		else
+			printf("Input image resolution %d x %d not equal to NN input resolution %d x %d\n", imgWidth, imgHeight, input.Width, input.Height);
+	}
+	size_t copySize = std::min(input.FrameSize, (size_t) imgWidth * imgHeight * 3);
+
+	PageAlignedAllocator               allocator;
+	std::vector<std::unique_ptr<Slot>> slots;
+	for (int iSlot = 0; iSlot < inFlight; iSlot++) {
+		auto slot = std::make_unique<Slot>();
+		for (int i = 0; i < batchSize; i++) {
+			BackendFrame frame;
+			frame.Input = allocator.Alloc(input.FrameSize);
+			for (const auto& out : outputs)
+				frame.Outputs.push_back(allocator.Alloc(out.FrameSize));
+			slot->Frames.push_back(frame);
+		}
+		for (const auto& t : tiles)
+			slot->Boxes.push_back(FitLetterbox(t.Width, t.Height, input.Width, input.Height));
+		slots.push_back(std::move(slot));
+	}
+	// However we return, wait for the batches in flight first. The device writes into the buffers
+	// of the slots, and the completion callbacks into the slots, which are freed on return.
+	struct WaitIdleOnReturn {
+		InferBackend* Backend;
+		~WaitIdleOnReturn() { Backend->WaitIdle(); }
+	} waitIdleOnReturn{backend};
+
+	TensorRecorder recorder;
+	if (recordFilename != "" && !recorder.Open(recordFilename)) {
+		printf("Failed to open %s\n", recordFilename.c_str());
+		return 1;
+	}
+	uint64_t                 nRecorded = 0;
+	std::vector<const void*> outputPtrs(outputs.size());
+
+	DetectionStreamWriter detOut;
+	if (detectionsFilename != "") {
+		bool ok = ringMB > 0 ? detOut.OpenRing(detectionsFilename, (size_t) (ringMB * 1024 * 1024)) : detOut.OpenFile(detectionsFilename);
+		if (!ok) {
+			printf("Failed to open %s\n", detectionsFilename.c_str());
+			return 1;
+		}
+	}
+	uint64_t nStreamed = 0;
+
+	std::vector<VideoFrame> videoFrames(batchSize);
+	std::vector<uint64_t>   decodeNs(batchSize);
+	std::vector<char>       decodeOK(batchSize);
+	std::vector<char>       inferFrame(batchSize, 1); // Per frame of the slot, or per tile
+	uint64_t                videoBytes   = 0; // After warmup
+	int64_t                 decodeErrors = 0;
+	bool                    anyFrames    = false;
+	DecodePool              decodePool(video && !useTiles ? decodeThreads : 1);
+	bool                    endOfVideo   = false;
+
+	InputConverter                      tileConv;
+	MotionDetector                      motion;
+	HdrHistogram                        motionNs;                // Per frame
+	int64_t                             motionFrames        = 0; // After warmup
+	int64_t                             motionSkippedFrames = 0; // Frames that didn't need any inference
+	int64_t                             motionTiles         = 0;
+	int64_t                             motionSkippedTiles  = 0;
+	std::vector<Detection>              lastDets;                // Of the last frame that went through the network
+	std::vector<std::vector<Detection>> tileDets(tiles.size());  // Of each tile, in frame coordinates, the last time it went through the network
+	motion.Threshold = motionThreshold;
+
+	ByteTracker  tracker;
+	HdrHistogram trackNs;                            // Per frame
+	int64_t      nTracks        = 0;                 // Confirmed tracks, summed over all frames after warmup
+	float        parseThreshold = ParseThreshold();
+
+	bool               useSkipping = inferEvery != 1;
+	FrameSkipper       skipper;
+	std::vector<Track> lastTracks;                                                 // The tracker's output for the last frame that it saw
+	int64_t            nScheduled = 0, nTracked = 0;                               // Frames that have been submitted, and tracked
+	int64_t            skipFrames = 0, skipInferred = 0, skipForced = 0;           // After warmup
+	Letterbox          nnBox      = FitLetterbox(imgWidth, imgHeight, input.Width, input.Height); // Where a whole frame goes in the input
+	skipper.MinInterval = inferEvery == 0 ? 1 : inferEvery;
+	skipper.MaxInterval = inferEvery == 0 ? inferEveryMax : inferEvery;
+	skipper.Interval    = skipper.MinInterval;
+
+	HdrHistogram           latencyNs;    // Submit to completion callback, per batch
+	HdrHistogram           preprocessNs; // Per frame
+	HdrHistogram           parseNs;      // Per frame, including the merge of tiles
+	std::vector<Detection> dets;
+	int64_t                nFrames   = 0;
+	int64_t                nBoxes    = 0;
+	bool                   warmingUp = warmupSeconds > 0 && !(video && !loopVideo); // Every frame of a video counts
+	auto                   startTime = std::chrono::steady_clock::now();
+
+	// Wait for the slot's batch to complete, and parse its outputs
+	auto finish = [&](Slot* slot) -> int {
+		if (!slot->Pending)
+			return 0;
+		uint64_t completedAt;
+		{
+			std::unique_lock<std::mutex> lock(doneLock);
+			doneCV.wait(lock, [&] { return slot->CompletedAt != 0; });
+			completedAt = slot->CompletedAt;
+		}
+		slot->Pending = false;
+		if (slot->Status != 0) {
+			printf("Inference failed, status = %d\n", slot->Status);
+			return slot->Status;
+		}
+		for (const auto& frame : slot->Batch) {
+			if (recorder.IsOpen()) {
+				for (size_t i = 0; i < outputs.size(); i++)
+					outputPtrs[i] = frame.Outputs[i];
+				if (!recorder.WriteFrame(nRecorded++, completedAt, outputs, outputPtrs)) {
+					printf("Failed to write to %s\n", recordFilename.c_str());
+					return 1;
+				}
+			}
+		}
+
+		// Track, count the detections of one frame, and write them to the detection stream. inferred
+		// is false if the frame didn't go through the network.
+		auto emit = [&](uint64_t parseStart, uint32_t width, uint32_t height, bool inferred) -> bool {
+			if (!warmingUp && (inferred || !useSkipping))
+				parseNs.Record(NowNs() - parseStart);
+			if (useTracker) {
+				// With --every, a frame that didn't go through the network just moves the tracks forward
+				uint64_t                  t0     = NowNs();
+				const std::vector<Track>& tracks = inferred || !useSkipping ? tracker.Update(dets) : tracker.Predict();
+				if (!warmingUp) {
+					trackNs.Record(NowNs() - t0);
+					nTracks += tracks.size();
+				}
+				if (useSkipping) {
+					if (inferred)
+						skipper.Observe(tracks, tracker.NumCreated());
+					lastTracks = tracks;
+					nTracked++;
+					// Write the tracks instead of the detections, so that every frame has boxes
+					dets.clear();
+					for (const auto& t : tracks)
+						dets.push_back({t.ClassID, t.Confidence, t.XMin, t.YMin, t.XMax, t.YMax});
+				} else if (parseThreshold < confidenceThreshold) {
+					dets.erase(std::remove_if(dets.begin(), dets.end(), [](const Detection& d) { return d.Confidence < confidenceThreshold; }), dets.end());
+				}
+			}
+			nBoxes += warmingUp ? 0 : dets.size();
+			return detectionsFilename == "" || detOut.Write(nStreamed++, completedAt, width, height, dets);
+		};
+		auto parse = [&](const BackendFrame& frame, std::vector<Detection>& to) {
+			for (size_t i = 0; i < outputs.size(); i++) {
+				if (outputs[i].IsNMS && outputs[i].Type == TensorType::Float32)
+					ParseHailoNMS((const float*) frame.Outputs[i], outputs[i].Height, outputs[i].FrameSize / sizeof(float), parseThreshold, to);
+			}
+		};
+		uint64_t t0 = NowNs();
+		dets.clear();
+		bool anyInferred = false;
+		for (size_t f = 0; f < slot->Source.size(); f++) {
+			int b = slot->Source[f];
+			anyInferred |= b >= 0;
+			if (useTiles) {
+				if (b >= 0) {
+					tileDets[f].clear();
+					parse(slot->Batch[b], tileDets[f]);
+					TileToFrame(tiles[f], slot->Boxes[f], imgWidth, imgHeight, tileDets[f].data(), tileDets[f].size());
+				}
+				dets.insert(dets.end(), tileDets[f].begin(), tileDets[f].end());
+				continue;
+			}
+			t0 = NowNs();
+			dets.clear();
+			if (b >= 0) {
+				parse(slot->Batch[b], dets);
+				if (useMotion)
+					lastDets = dets;
+			} else if (useMotion) {
+				dets = lastDets;
+			}
+			if (!emit(t0, input.Width, input.Height, b >= 0)) {
+				printf("Failed to write to %s\n", detectionsFilename.c_str());
+				return 1;
+			}
+		}
+		if (useTiles) {
+			MergeTileDetections(dets, tileMergeOverlap);
+			if (!emit(t0, imgWidth, imgHeight, anyInferred)) {
+				printf("Failed to write to %s\n", detectionsFilename.c_str());
+				return 1;
+			}
+		}
+		if (!warmingUp) {
+			if (!slot->Batch.empty())
+				latencyNs.Record(completedAt - slot->SubmittedAt);
+			nFrames += useTiles ? 1 : slot->Source.size();
+		}
+		return 0;
+	};
+
+	// The next frame of the video, going back to the start at the end if we're looping
+	auto nextVideoFrame = [&](VideoFrame& frame) -> bool {
+		while (!endOfVideo) {
+			if (video->Next(frame)) {
+				videoBytes += warmingUp ? 0 : frame.Size;
+				anyFrames = true;
+				return true;
+			}
+			if (loopVideo && anyFrames)
+				video->Rewind();
+			else
+				endOfVideo = true;
+		}
+		return false;
+	};
+
+	// Has the frame changed since the last frame that went through the network?
+	auto detectMotion = [&](const uint8_t* luma, int width, int height, int stride, int pixelStride) -> bool {
+		uint64_t t0      = NowNs();
+		bool     changed = motion.Detect(luma, width, height, stride, pixelStride) != 0;
+		if (changed)
+			motion.Accept();
+		if (!warmingUp)
+			motionNs.Record(NowNs() - t0);
+		return changed;
+	};
+
+	// With --every, should this frame go through the network, or be left to the tracker? luma is the
+	// frame, to check for motion with --verify, or null if we can't look at it yet. toFrame maps
+	// the coordinates of the tracks to it.
+	auto scheduleFrame = [&](int64_t frameIndex, const uint8_t* luma, int width, int height, int stride, int pixelStride, const Letterbox* toFrame) -> bool {
+		bool infer = skipper.Next();
+		if (luma && verifySkips) {
+			uint64_t t0      = NowNs();
+			bool     changed = motion.Detect(luma, width, height, stride, pixelStride) != 0;
+			if (!infer && changed && !MotionExplained(motion, lastTracks, (int) (frameIndex - nTracked + 1), toFrame, width, height)) {
+				skipper.Force();
+				infer = true;
+				skipForced += warmingUp ? 0 : 1;
+			}
+			if (infer)
+				motion.Accept();
+			if (!warmingUp)
+				motionNs.Record(NowNs() - t0);
+		}
+		if (!warmingUp) {
+			skipFrames++;
+			skipInferred += infer;
+		}
+		return infer;
+	};
+
+	// Should this frame go through the network? With --motion, only if it has changed since the
+	// last one that did. With --every, only every so often.
+	auto gateFrame = [&](int64_t frameIndex, const uint8_t* luma, int width, int height, int stride, int pixelStride, const Letterbox* toFrame) -> bool {
+		if (useMotion)
+			return detectMotion(luma, width, height, stride, pixelStride);
+		if (useSkipping)
+			return scheduleFrame(frameIndex, luma, width, height, stride, pixelStride, toFrame);
+		return true;
+	};
+
+	for (size_t iSubmit = 0;; iSubmit++) {
+		Slot* slot = slots[iSubmit % slots.size()].get();
+		status     = finish(slot);
+		if (status != 0)
+			return status;
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (warmingUp && elapsed >= warmupSeconds) {
+			warmingUp = false;
+			startTime = std::chrono::steady_clock::now();
+			elapsed   = 0;
+		}
+		if (!warmingUp && elapsed >= durationSeconds && !(video && !loopVideo))
+			break;
+
+		if (useTiles) {
+			// One frame per batch. With --motion, only the tiles that have changed are cut and submitted.
+			uint64_t t0 = NowNs();
+			if (video && !nextVideoFrame(videoFrames[0]))
+				break;
+			// With --every, a frame that is left to the tracker isn't even loaded, unless it needs to
+			// be checked for motion
+			bool infer = !(useSkipping && !verifySkips) || scheduleFrame(nScheduled, nullptr, 0, 0, 0, 0, nullptr);
+			TileSource src;
+			bool       ok = !infer || src.Load(video, videoFrames[0], img, imgWidth, imgHeight);
+			if (ok && infer && useSkipping && verifySkips) {
+				const uint8_t* luma;
+				int            stride, pixelStride;
+				src.Luma(luma, stride, pixelStride);
+				infer = scheduleFrame(nScheduled, luma, imgWidth, imgHeight, stride, pixelStride, nullptr);
+			}
+			std::fill(inferFrame.begin(), inferFrame.end(), infer);
+			if (ok && useMotion) {
+				uint64_t m0 = NowNs();
+				src.DetectMotion(motion);
+				for (size_t i = 0; i < tiles.size(); i++) {
+					const Tile& t = tiles[i];
+					inferFrame[i] = motion.AnyChanged(t.X, t.Y, t.Width, t.Height);
+					if (inferFrame[i])
+						motion.Accept(t.X, t.Y, t.Width, t.Height);
+				}
+				if (!warmingUp)
+					motionNs.Record(NowNs() - m0);
+			}
+			for (size_t i = 0; i < tiles.size(); i++) {
+				uint8_t* dst = (uint8_t*) slot->Frames[i].Input;
+				if (!ok)
+					memset(dst, tileConv.PadValue, input.FrameSize);
+				else if (inferFrame[i])
+					slot->Boxes[i] = src.Cut(tileConv, tiles[i], input, dst);
+			}
+			if (!ok) {
+				decodeErrors++;
+				std::fill(inferFrame.begin(), inferFrame.end(), 1);
+			}
+			if (!warmingUp)
+				preprocessNs.Record(NowNs() - t0);
+		} else if (video) {
+			// The frames are only pointers into the mapped file, so reading them is free. The cost
+			// is in decoding, which is split between decodeThreads. With --motion, a Y4M frame that
+			// hasn't changed isn't even decoded, but a JPEG must be decoded before we can tell.
+			size_t n = 0;
+			while (n < slot->Frames.size() && nextVideoFrame(videoFrames[n]))
+				n++;
+			if (n == 0)
+				break;
+			slot->Frames.resize(n); // Only at the end of the video
+			// The luma of a Y4M frame is right there, but a JPEG has to be decoded first
+			bool isY4M           = video->GetFormat() == VideoFormat::Y4M;
+			bool gateAfterDecode = !isY4M && (useMotion || (useSkipping && verifySkips));
+			for (size_t i = 0; i < n; i++) {
+				const uint8_t* luma = isY4M ? videoFrames[i].Data : nullptr;
+				inferFrame[i]       = gateAfterDecode || gateFrame(nScheduled + i, luma, video->Width, video->Height, video->Width, 1, &nnBox);
+			}
+			decodePool.Run(n, [&](size_t from, size_t to, InputConverter& conv) {
+				for (size_t i = from; i < to; i++) {
+					if (!inferFrame[i])
+						continue;
+					uint64_t t0 = NowNs();
+					decodeOK[i] = DecodeVideoFrame(*video, videoFrames[i], input, conv, (uint8_t*) slot->Frames[i].Input);
+					decodeNs[i] = NowNs() - t0;
+				}
+			});
+			for (size_t i = 0; i < n; i++) {
+				if (!inferFrame[i])
+					continue;
+				decodeErrors += decodeOK[i] ? 0 : 1;
+				if (!warmingUp)
+					preprocessNs.Record(decodeNs[i]);
+				if (gateAfterDecode)
+					inferFrame[i] = gateFrame(nScheduled + i, (const uint8_t*) slot->Frames[i].Input + 1, input.Width, input.Height, input.Width * 3, 3, nullptr);
+			}
+		} else {
+			// Stand-in for preprocessing. A real pipeline would decode and resize here.
+			for (size_t i = 0; i < slot->Frames.size(); i++) {
+				inferFrame[i] = gateFrame(nScheduled + i, img + 1, imgWidth, imgHeight, imgWidth * 3, 3, &nnBox);
+				if (!inferFrame[i])
+					continue;
+				uint64_t t0 = NowNs();
+				memcpy((void*) slot->Frames[i].Input, img, copySize);
+				if (!warmingUp)
+					preprocessNs.Record(NowNs() - t0);
+			}
+		}
+
+		// Submit the frames (or tiles) that need inference
+		size_t nSource = useTiles ? tiles.size() : slot->Frames.size();
+		nScheduled += useTiles ? 1 : nSource;
+		slot->Batch.clear();
+		slot->Source.resize(nSource);
+		for (size_t i = 0; i < nSource; i++) {
+			slot->Source[i] = inferFrame[i] ? (int) slot->Batch.size() : -1;
+			if (inferFrame[i])
+				slot->Batch.push_back(slot->Frames[i]);
+		}
+		if (useMotion && !warmingUp) {
+			size_t nSkipped = nSource - slot->Batch.size();
+			motionFrames += useTiles ? 1 : nSource;
+			motionSkippedFrames += useTiles ? slot->Batch.empty() : nSkipped;
+			motionTiles += useTiles ? nSource : 0;
+			motionSkippedTiles += useTiles ? nSkipped : 0;
+		}
+
+		slot->SubmittedAt = NowNs();
+		slot->Pending     = true;
+		if (slot->Batch.empty()) {
+			// Nothing has changed, or every frame is left to the tracker. That happens when the slot is finished.
+			slot->CompletedAt = slot->SubmittedAt;
+			slot->Status      = 0;
+			continue;
+		}
+
+		status = backend->WaitForAsyncReady(1s, (uint32_t) slot->Batch.size());
+		if (status != 0) {
+			printf("Failed to wait for async ready, status = %d\n", status);
+			return status;
+		}
+
+		slot->SubmittedAt = NowNs();
+		slot->CompletedAt = 0;
+		status            = backend->RunAsync(slot->Batch, [slot](int s) {
+			std::lock_guard<std::mutex> lock(doneLock);
+			slot->Status      = s;
+			slot->CompletedAt = NowNs();
+			doneCV.notify_all();
+		});
+		if (status != 0) {
+			printf("Failed to submit batch, status = %d\n", status);
+			slot->Pending = false;
+			return status;
+		}
+	}
+
+	// Drain the batches that are still in flight. These count towards the result, because we
+	// stopped the clock after submitting them.
+	for (const auto& s : slots) {
+		status = finish(s.get());
+		if (status != 0)
+			return status;
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	backend->WaitIdle();
+
+	auto lat = latencyNs.GetSnapshot();
+	printf("%-16s %s\n", "Backend", backend->Name());
+	printf("%-16s %d\n", "Batch size", batchSize);
+	if (useTiles)
+		printf("%-16s %d per frame, %d x %d, overlap %.0f%%\n", "Tiles", (int) tiles.size(), tiles[0].Width, tiles[0].Height, tileConfig.Overlap * 100);
+	printf("%-16s %d (queue size %u frames)\n", "In flight", inFlight, backend->QueueSize());
+	printf("%-16s %d in %.1fs\n", "Frames", (int) nFrames, elapsed);
+	printf("%-16s %.2f\n", "FPS", nFrames / elapsed);
+	printf("%-16s p50 %.2fms, p99 %.2fms, max %.2fms\n", "Batch latency", lat.Percentile(50) / 1e6, lat.Percentile(99) / 1e6, lat.Max / 1e6);
+	printf("%-16s %.2fms per frame (running average)\n", "Device latency", backend->DeviceLatencyNs() / 1e6);
+	if (video) {
+		const char* format = video->GetFormat() == VideoFormat::Y4M ? "Y4M" : "MJPEG";
+		printf("%-16s %s, %.1f MB at %.1f MB/s\n", "Video", format, videoBytes / 1e6, videoBytes / 1e6 / elapsed);
+		if (decodeErrors != 0)
+			printf("%-16s %d frames failed to decode\n", "Decode errors", (int) decodeErrors);
+		if (video->SkippedBytes != 0)
+			printf("%-16s %d bytes between frames that were not part of any JPEG\n", "Skipped", (int) video->SkippedBytes);
+		if (!useTiles)
+			printf("%-16s %.1fus per frame, on %d threads\n", "Decode", preprocessNs.Mean() / 1e3, decodeThreads);
+	}
+	if (useTiles) {
+		printf("%-16s %.1fus per frame\n", "Cut tiles", preprocessNs.Mean() / 1e3);
+	} else if (!video) {
+		printf("%-16s %.1fus per frame\n", "Preprocess", preprocessNs.Mean() / 1e3);
+	}
+	if (useMotion) {
+		printf("%-16s %.1f%% of frames skipped", "Motion", motionFrames ? 100.0 * motionSkippedFrames / motionFrames : 0.0);
+		if (useTiles)
+			printf(", %.1f%% of tiles skipped", motionTiles ? 100.0 * motionSkippedTiles / motionTiles : 0.0);
+		printf(", %.1fus per frame to detect\n", motionNs.Mean() / 1e3);
+	}
+	if (useTracker) {
+		auto t = trackNs.GetSnapshot();
+		printf("%-16s %.1f tracks per frame, %u created, p50 %.1fus, p99 %.1fus per frame\n", "Tracker", nFrames ? (double) nTracks / nFrames : 0.0,
+		       tracker.NumCreated(), t.Percentile(50) / 1e3, t.Percentile(99) / 1e3);
+	}
+	if (useSkipping) {
+		printf("%-16s %d of %d frames (%.1f%%), interval %d at the end", "Inferred", (int) skipInferred, (int) skipFrames,
+		       skipFrames ? 100.0 * skipInferred / skipFrames : 0.0, skipper.Interval);
+		if (verifySkips)
+			printf(", %d forced by motion, %.1fus per frame to check", (int) skipForced, motionNs.Mean() / 1e3);
+		printf("\n");
+	}
+	printf("%-16s %.1fus per frame, %.1f boxes per frame\n", "Parse NMS", parseNs.Mean() / 1e3, nFrames ? (double) nBoxes / nFrames : 0.0);
+	if (detectionsFilename != "") {
+		if (!detOut.Close()) {
+			printf("Failed to write to %s\n", detectionsFilename.c_str());
+			return 1;
+		}
+		printf("%-16s %d frames (including warmup) to %s\n", "Detections", (int) nStreamed, detectionsFilename.c_str());
+	}
+	if (recorder.IsOpen()) {
+		if (!recorder.Close()) {
+			printf("Failed to write to %s\n", recordFilename.c_str());
+			return 1;
+		}
+		printf("%-16s %d frames (including warmup) to %s\n", "Recorded", (int) nRecorded, recordFilename.c_str());
+	}
+	return 0;
+}
+
+// Run the postprocessing over every frame of a recording, repeatedly, for durationSeconds.
+// The tensors are parsed straight out of the mmapped file.
+int RunReplay() {
+	TensorReplay replay;
+	if (!replay.Open(replayFilename)) {
+		printf("Failed to open recording %s\n", replayFilename.c_str());
+		return 1;
+	}
+	if (replay.Frames.empty()) {
+		printf("No frames in %s\n", replayFilename.c_str());
+		return 1;
+	}
+	printf("Loaded %d frames (%.1f MB) from %s%s\n", (int) replay.Frames.size(), replay.FileSize() / 1e6, replayFilename.c_str(),
+	       replay.Truncated ? ", which ends with an incomplete frame" : "");
+
+	std::vector<Detection> dets;
+	int64_t                nFrames = 0;
+	int64_t                nBoxes  = 0;
+	int64_t                nBytes  = 0;
+	int64_t                skipped = 0; // Tensors that we have no postprocessing for
+	auto                   start   = std::chrono::steady_clock::now();
+	double                 elapsed = 0;
+	while (elapsed < durationSeconds || nFrames == 0) {
+		for (const auto& frame : replay.Frames) {
+			for (const auto& t : frame.Tensors) {
+				if (t.Info.IsNMS && t.Info.Type == TensorType::Float32) {
+					dets.clear();
+					size_t consumed = ParseHailoNMS((const float*) t.Data, t.Info.Height, t.Info.FrameSize / sizeof(float), confidenceThreshold, dets);
+					nBoxes += dets.size();
+					nBytes += consumed * sizeof(float);
+				} else {
+					skipped++;
+				}
+			}
+		}
+		nFrames += replay.Frames.size();
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	printf("%-16s %d in %.2fs\n", "Frames", (int) nFrames, elapsed);
+	printf("%-16s %.0f\n", "Frames/s", nFrames / elapsed);
+	printf("%-16s %.2fus\n", "Per frame", elapsed * 1e6 / nFrames);
+	printf("%-16s %.1f MB/s\n", "Parsed", nBytes / elapsed / 1e6);
+	printf("%-16s %.1f per frame\n", "Boxes", (double) nBoxes / nFrames);
+	if (skipped != 0)
+		printf("Skipped %d tensors which are not in HAILO NMS FLOAT32 format\n", (int) (skipped / (nFrames / replay.Frames.size())));
+	return 0;
+}
+
+int run() {
+	if (replayFilename != "") {
+		int status = RunReplay();
+		return status == 0 ? 123456789 : status;
+	}
+
+	int            imgWidth = 0, imgHeight = 0, imgChan = 0;
+	unsigned char* img = nullptr;
+	VideoReader    video;
+	if (videoFilename != "") {
+		if (!video.Open(videoFilename)) {
+			printf("Failed to open video %s (it must be MJPEG, or Y4M with 4:2:0 chroma)\n", videoFilename.c_str());
+			return 1;
+		}
+		// The size of an MJPEG video is in the header of its first frame
+		VideoFrame first;
+		if (video.GetFormat() == VideoFormat::Y4M) {
+			imgWidth  = video.Width;
+			imgHeight = video.Height;
+		} else if (!video.Next(first) || !stbi_info_from_memory(first.Data, (int) first.Size, &imgWidth, &imgHeight, &imgChan)) {
+			printf("Failed to read the first frame of %s\n", videoFilename.c_str());
+			return 1;
+		}
+		video.Rewind();
+	} else {
+		img = stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3);
+		if (!img) {
+			printf("Failed to load image %s\n", imgFilename.c_str());
+			return 1;
+		}
+	}
+
+	std::unique_ptr<InferBackend> backend;
+#ifndef NO_HAILORT
+	std::unique_ptr<hailort::VDevice> vdevice;
+#endif
+	if (useSim) {
+		auto sim           = std::make_unique<SimBackend>();
+		sim->FixedMs       = simFixedMs;
+		sim->PerFrameMs    = simFrameMs;
+		sim->JitterMs      = simJitterMs;
+		sim->QueueDepth    = simQueueDepth;
+		sim->BoxesPerFrame = simBoxes;
+		if (videoFilename == "" && !useTiles) {
+			// Otherwise keep the default of 640 x 640, like a real model, so that video and tiles are scaled to fit
+			sim->InputWidth  = imgWidth;
+			sim->InputHeight = imgHeight;
+		}
+		if (simNMSFilename != "" && !sim->LoadRecordedNMS(simNMSFilename)) {
+			printf("Failed to load recorded NMS output %s\n", simNMSFilename.c_str());
+			return 1;
+		}
+		backend = std::move(sim);
+	} else {
+#ifndef NO_HAILORT
+		hailort::Expected<std::unique_ptr<hailort::VDevice>> vdevice_exp = hailort::VDevice::create();
+		if (!vdevice_exp) {
+			printf("Failed to create vdevice\n");
+			return vdevice_exp.status();
+		}
+		vdevice = vdevice_exp.release();
+		backend = std::make_unique<HailoBackend>(vdevice.get(), hefFile, ParseThreshold(), nmsIoUThreshold);
+#endif
+	}
+
+	int status = RunPipeline(backend.get(), img, imgWidth, imgHeight, videoFilename != "" ? &video : nullptr);
+	backend.reset();
+	stbi_image_free(img);
+	return status == 0 ? 123456789 : status;
+}
+
+void PrintHelp() {
+	printf("Usage: yolov8-pipeline [options]\n");
+	printf("  --hef <file>          Model (default %s)\n", hefFile.c_str());
+	printf("  --image <file>        Input image (default %s)\n", imgFilename.c_str());
+	printf("  --video <file>        Process every frame of an MJPEG or Y4M file instead of the image, without warmup\n");
+	printf("  --loop                Go back to the start of the video at the end, and run for --duration instead\n");
+	printf("  --decode-threads <n>  Threads that decode the video frames of a batch (default %d)\n", decodeThreads);
+	printf("  --batch <n>           Batch size (default %d)\n", batchSize);
+	printf("  --tiles <auto|CxR>    Cut each frame into overlapping tiles, and run them as one batch, eg 3x2\n");
+	printf("  --tile-overlap <f>    Overlap of neighbouring tiles, as a fraction of the tile size (default %.2f)\n", tileConfig.Overlap);
+	printf("  --tile-global         Add the whole frame as one more tile, for objects that are larger than a tile\n");
+	printf("  --tile-merge <f>      Merge boxes from different tiles that overlap by more than this (default %.2f)\n", tileMergeOverlap);
+	printf("  --motion              Skip frames (or tiles) that haven't changed, and reuse their previous detections\n");
+	printf("  --motion-diff <n>     Mean luma difference of a 64x64 block that counts as motion (default %d)\n", motionThreshold);
+	printf("  --track               Track objects across frames, with ByteTrack\n");
+	printf("  --every <n|auto>      Run inference on every nth frame only, and track in between (auto adapts n to the scene)\n");
+	printf("  --every-max <n>       Longest interval for --every auto (default %d)\n", inferEveryMax);
+	printf("  --verify              With --every, also run frames where something moved that the tracks don't explain\n");
+	printf("  --inflight <n>        Batches in flight at once (default %d)\n", inFlight);
+	printf("  --duration <seconds>  Measurement time after warmup (default %.0f)\n", durationSeconds);
+	printf("  --warmup <seconds>    Warmup time, which is not measured (default %.0f)\n", warmupSeconds);
+	printf("  --sim                 Use a simulated device instead of the Hailo accelerator%s\n", haveHailoRT ? "" : " (always on in this build)");
+	printf("  --sim-fixed-ms <ms>   Simulated latency per batch (default %.2f)\n", simFixedMs);
+	printf("  --sim-frame-ms <ms>   Simulated latency per frame in a batch (default %.2f)\n", simFrameMs);
+	printf("  --sim-jitter-ms <ms>  Standard deviation of simulated latency (default %.2f)\n", simJitterMs);
+	printf("  --sim-queue <n>       Batches in the simulated async queue (default %d)\n", simQueueDepth);
+	printf("  --sim-boxes <n>       Synthetic boxes per frame (default %d)\n", simBoxes);
+	printf("  --sim-nms <file>      Raw NMS output buffer to return instead of synthetic boxes\n");
+	printf("  --record <file>       Append the output tensors of every frame to a recording\n");
+	printf("  --replay <file>       Measure postprocessing of a recording, for --duration seconds\n");
+	printf("  --detections <file>   Write the detections of every frame as a binary stream (see detection_stream.h)\n");
+	printf("  --ring <MB>           Make the --detections file a ring buffer of this size, eg /dev/shm/detections\n");
+}
+
+// Returns false if the arguments are invalid
+bool ParseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--help" || arg == "-h") {
+			return false;
+		} else if (arg == "--sim") {
+			useSim = true;
+			continue;
+		} else if (arg == "--loop") {
+			loopVideo = true;
+			continue;
+		} else if (arg == "--tile-global") {
+			tileConfig.Global = true;
+			continue;
+		} else if (arg == "--motion") {
+			useMotion = true;
+			continue;
+		} else if (arg == "--track") {
+			useTracker = true;
+			continue;
+		} else if (arg == "--verify") {
+			verifySkips = true;
+			continue;
+		} else if (next == nullptr) {
+			printf("Missing value for %s\n", arg.c_str());
+			return false;
+		} else if (arg == "--hef") {
+			hefFile = next;
+		} else if (arg == "--image") {
+			imgFilename = next;
+		} else if (arg == "--video") {
+			videoFilename = next;
+		} else if (arg == "--decode-threads") {
+			decodeThreads = atoi(next);
+		} else if (arg == "--batch") {
+			batchSize = atoi(next);
+		} else if (arg == "--tiles") {
+			useTiles = true;
+			if (strcmp(next, "auto") != 0 && (sscanf(next, "%dx%d", &tileConfig.Cols, &tileConfig.Rows) != 2 || tileConfig.Cols < 1 || tileConfig.Rows < 1)) {
+				printf("--tiles must be auto, or columns x rows, eg 3x2\n");
+				return false;
+			}
+		} else if (arg == "--tile-overlap") {
+			tileConfig.Overlap = atof(next);
+		} else if (arg == "--tile-merge") {
+			tileMergeOverlap = atof(next);
+		} else if (arg == "--every") {
+			inferEvery = strcmp(next, "auto") == 0 ? 0 : atoi(next);
+			if (inferEvery < 1 && strcmp(next, "auto") != 0) {
+				printf("--every must be auto, or at least 1\n");
+				return false;
+			}
+		} else if (arg == "--every-max") {
+			inferEveryMax = atoi(next);
+		} else if (arg == "--motion-diff") {
+			motionThreshold = atoi(next);
+		} else if (arg == "--inflight") {
+			inFlight = atoi(next);
+		} else if (arg == "--duration") {
+			durationSeconds = atof(next);
+		} else if (arg == "--warmup") {
+			warmupSeconds = atof(next);
+		} else if (arg == "--sim-fixed-ms") {
+			simFixedMs = atof(next);
+		} else if (arg == "--sim-frame-ms") {
+			simFrameMs = atof(next);
+		} else if (arg == "--sim-jitter-ms") {
+			simJitterMs = atof(next);
+		} else if (arg == "--sim-queue") {
+			simQueueDepth = atoi(next);
+		} else if (arg == "--sim-boxes") {
+			simBoxes = atoi(next);
+		} else if (arg == "--sim-nms") {
+			simNMSFilename = next;
+		} else if (arg == "--record") {
+			recordFilename = next;
+		} else if (arg == "--replay") {
+			replayFilename = next;
+		} else if (arg == "--detections") {
+			detectionsFilename = next;
+		} else if (arg == "--ring") {
+			ringMB = atof(next);
+		} else {
+			printf("Unknown option %s\n", arg.c_str());
+			return false;
+		}
+		i++;
+	}
+	if (batchSize < 1 || inFlight < 1 || simQueueDepth < 1 || decodeThreads < 1) {
+		printf("Batch size, in-flight count, queue depth and decode threads must be at least 1\n");
+		return false;
+	}
+	if (inferEvery != 1) {
+		if (useMotion) {
+			printf("--every and --motion can't be used together\n");
+			return false;
+		}
+		useTracker    = true;
+		inferEveryMax = std::max(1, inferEveryMax);
+	}
+	if (tileConfig.Overlap < 0 || tileConfig.Overlap >= 0.9f) {
+		printf("Tile overlap must be between 0 and 0.9\n");
+		return false;
+	}
+	if (!haveHailoRT)
+		useSim = true;
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (!ParseArgs(argc, argv)) {
+		PrintHelp();
+		return 1;
+	}
+	int status = run();
+	if (status == 123456789)
+		printf("SUCCESS\n");
+	else
+		printf("Failed with error code %d\n", status);
+	return 0;
+}
@@ -3,15 +3,7 @@
 #include <hailo/hailort.h>
 #include <hailo/hailort_common.hpp>
 
-std::string DumpShape(std::vector<size_t> shape) {
-	std::string out;
-	for (auto n : shape) {
-		char el[100];
-		sprintf(el, "%d,", (int) n);
-		out += el;
-	}
-	return out;
-}
+#include "dump.h"
 
 std::string DumpShape(hailo_3d_image_shape_t shape) {
 	char buf[1024];
@@ -34,22 +26,4 @@ std::string DumpStream(const hailort::InferModel::InferStream& s) {
 	return buf;
 }
 
-// dump float32 as a 2d matrix
-// stride is the number of float32 elements between rows.
-// ncols is the number of columns that you want to print per line
-// nrows is the number of rows that you want to print
-std::string DumpFloat32(const float* out, int stride, int ncols, int nrows, float mul) {
-	std::string result;
-	for (int row = 0; row < nrows; row++) {
-		int p = row * stride;
-		for (int col = 0; col < ncols; col++) {
-			char buf[1024];
-			sprintf(buf, "%4.3f ", out[p + col] * mul);
-			result += buf;
-		}
-		result += "\n";
-	}
-	return result;
-}
-
 // void DumpOutputTensor(
\ No newline at end of file
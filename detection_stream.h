@@ -0,0 +1,381 @@
+#pragma once
+
+// A binary stream of detection results, which other processes can read straight out of a
+// memory mapping, without any parsing.
+//
+// The stream is either an append-only file, or a fixed-size ring buffer in a shared memory file
+// (eg under /dev/shm), which a single writer overwrites continuously, and any number of readers
+// follow. All values are little-endian, and every record is 8-byte aligned.
+//
+//   StreamHeader (64 bytes)
+//   FrameRecord, followed by FrameRecord.NumDetections x PackedDetection
+//   FrameRecord, ...
+//
+// In a ring buffer, a record never wraps around the end of the buffer. Instead, the writer fills
+// the remainder with a padding record, and continues at the start.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "nms.h"
+
+namespace detstream {
+
+const uint32_t StreamMagic  = 0x54454459; // "YDET"
+const uint32_t FrameMagic   = 0x454d5246; // "FRME"
+const uint32_t PaddingMagic = 0x20444150; // "PAD "
+const uint16_t Version      = 1;
+
+struct StreamHeader {
+	uint32_t              Magic;
+	uint16_t              Version;
+	uint16_t              HeaderSize;    // sizeof(StreamHeader), so that we can add fields later
+	uint32_t              FrameSize;     // sizeof(FrameRecord)
+	uint32_t              DetectionSize; // sizeof(PackedDetection)
+	uint64_t              Capacity;      // Size of the ring buffer that follows this header, or 0 for a file
+	std::atomic<uint64_t> WritePos;      // Ring buffer only: total bytes ever written, including padding
+	std::atomic<uint64_t> ReserveEnd;    // Ring buffer only: end of the record that is being written
+	uint8_t               Reserved[24];
+};
+
+struct FrameRecord {
+	uint32_t Magic;
+	uint32_t Size; // Total size of this record, including the detections
+	uint64_t FrameIndex;
+	uint64_t TimestampNs;
+	uint32_t NumDetections;
+	uint16_t Width; // Image size, which the normalized box coordinates are relative to
+	uint16_t Height;
+};
+
+struct PackedDetection {
+	float    XMin; // Normalized to [0..1]
+	float    YMin;
+	float    XMax;
+	float    YMax;
+	float    Confidence;
+	uint16_t ClassID;
+	uint16_t Reserved;
+};
+
+static_assert(sizeof(StreamHeader) == 64, "StreamHeader layout changed");
+static_assert(sizeof(FrameRecord) == 32, "FrameRecord layout changed");
+static_assert(sizeof(PackedDetection) == 24, "PackedDetection layout changed");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "WritePos must be lock free to be shared between processes");
+
+inline const PackedDetection* Detections(const FrameRecord* r) {
+	return (const PackedDetection*) (r + 1);
+}
+
+inline uint32_t RecordSize(size_t numDetections) {
+	return (uint32_t) (sizeof(FrameRecord) + numDetections * sizeof(PackedDetection));
+}
+
+} // namespace detstream
+
+// The producer side of a detection stream. Not thread safe.
+class DetectionStreamWriter {
+public:
+	~DetectionStreamWriter() {
+		Close();
+	}
+
+	// Append to a file. If the file is new, write the stream header first.
+	bool OpenFile(const std::string& filename) {
+		using namespace detstream;
+		Close();
+		F = fopen(filename.c_str(), "ab");
+		if (!F)
+			return false;
+		if (ftell(F) == 0) {
+			StreamHeader h;
+			InitHeader(h, 0);
+			if (fwrite(&h, sizeof(h), 1, F) != 1) {
+				Close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Create (or replace) a ring buffer holding 'capacity' bytes of records.
+	bool OpenRing(const std::string& filename, size_t capacity) {
+		using namespace detstream;
+		Close();
+		capacity = capacity & ~(size_t) 7;
+		if (capacity < 4096)
+			return false;
+		int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1)
+			return false;
+		MapSize = sizeof(StreamHeader) + capacity;
+		if (ftruncate(fd, MapSize) != 0) {
+			close(fd);
+			return false;
+		}
+		void* p = mmap(nullptr, MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		Ring = (uint8_t*) p;
+		InitHeader(*Header(), capacity);
+		return true;
+	}
+
+	bool Write(uint64_t frameIndex, uint64_t timestampNs, int width, int height, const std::vector<Detection>& dets) {
+		using namespace detstream;
+		uint32_t size = RecordSize(dets.size());
+		if (Ring) {
+			StreamHeader* h = Header();
+			if (size > h->Capacity)
+				return false;
+			uint64_t pos     = h->WritePos.load(std::memory_order_relaxed);
+			uint64_t offset  = pos % h->Capacity;
+			uint64_t padding = offset + size > h->Capacity ? h->Capacity - offset : 0;
+
+			// Like a seqlock: announce the range that we're about to overwrite, before touching it,
+			// so that readers can tell if a record changed underneath them.
+			h->ReserveEnd.store(pos + padding + size, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			if (padding != 0) {
+				// Pad to the end of the buffer, so that the record is contiguous
+				FrameRecord pad = {};
+				pad.Magic       = PaddingMagic;
+				pad.Size        = (uint32_t) padding;
+				if (padding >= sizeof(pad))
+					memcpy(RingData() + offset, &pad, sizeof(pad));
+				offset = 0;
+			}
+			Fill(RingData() + offset, frameIndex, timestampNs, width, height, dets, size);
+			// Readers may see the record as soon as WritePos moves past it
+			h->WritePos.store(pos + padding + size, std::memory_order_release);
+			return true;
+		}
+		if (!F)
+			return false;
+		Scratch.resize(size);
+		Fill(Scratch.data(), frameIndex, timestampNs, width, height, dets, size);
+		return fwrite(Scratch.data(), size, 1, F) == 1;
+	}
+
+	bool Close() {
+		bool ok = true;
+		if (F)
+			ok = fclose(F) == 0;
+		if (Ring)
+			munmap(Ring, MapSize);
+		F    = nullptr;
+		Ring = nullptr;
+		return ok;
+	}
+
+private:
+	FILE*                F       = nullptr;
+	uint8_t*             Ring    = nullptr; // Header, followed by the ring buffer
+	size_t               MapSize = 0;
+	std::vector<uint8_t> Scratch;
+
+	detstream::StreamHeader* Header() { return (detstream::StreamHeader*) Ring; }
+	uint8_t*                 RingData() { return Ring + sizeof(detstream::StreamHeader); }
+
+	static void InitHeader(detstream::StreamHeader& h, uint64_t capacity) {
+		using namespace detstream;
+		memset((void*) &h, 0, sizeof(h));
+		h.Magic         = StreamMagic;
+		h.Version       = Version;
+		h.HeaderSize    = sizeof(StreamHeader);
+		h.FrameSize     = sizeof(FrameRecord);
+		h.DetectionSize = sizeof(PackedDetection);
+		h.Capacity      = capacity;
+		h.WritePos.store(0, std::memory_order_relaxed);
+		h.ReserveEnd.store(0, std::memory_order_relaxed);
+	}
+
+	static void Fill(uint8_t* dst, uint64_t frameIndex, uint64_t timestampNs, int width, int height, const std::vector<Detection>& dets, uint32_t size) {
+		using namespace detstream;
+		FrameRecord r   = {};
+		r.Magic         = FrameMagic;
+		r.Size          = size;
+		r.FrameIndex    = frameIndex;
+		r.TimestampNs   = timestampNs;
+		r.NumDetections = (uint32_t) dets.size();
+		r.Width         = (uint16_t) width;
+		r.Height        = (uint16_t) height;
+		memcpy(dst, &r, sizeof(r));
+		PackedDetection* out = (PackedDetection*) (dst + sizeof(r));
+		for (size_t i = 0; i < dets.size(); i++) {
+			out[i].XMin       = dets[i].XMin;
+			out[i].YMin       = dets[i].YMin;
+			out[i].XMax       = dets[i].XMax;
+			out[i].YMax       = dets[i].YMax;
+			out[i].Confidence = dets[i].Confidence;
+			out[i].ClassID    = (uint16_t) dets[i].ClassID;
+			out[i].Reserved   = 0;
+		}
+	}
+};
+
+// The consumer side of a detection stream. Records are returned as pointers into the mapping.
+//
+// For a file, Next() walks through the records that were in the file when it was opened.
+// For a ring buffer, Next() returns each new record as the writer publishes it, or nullptr if
+// there is nothing new. Because the writer never waits for readers, a record can be overwritten
+// while you're reading it: use CopyLast(), or copy out what you need and then call StillValid(). If the reader falls
+// more than a whole buffer behind, it skips ahead to the newest data, and counts the frames in Lost.
+class DetectionStreamReader {
+public:
+	uint64_t Lost = 0; // Ring buffer only: number of times that we fell behind and skipped ahead
+
+	~DetectionStreamReader() {
+		Close();
+	}
+
+	bool Open(const std::string& filename) {
+		using namespace detstream;
+		Close();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(StreamHeader)) {
+			close(fd);
+			return false;
+		}
+		MapSize = (size_t) st.st_size;
+		void* p = mmap(nullptr, MapSize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		Map = (const uint8_t*) p;
+		const StreamHeader* h = Header();
+		if (h->Magic != StreamMagic || h->Version != Version || h->HeaderSize < sizeof(StreamHeader) ||
+		    h->FrameSize != sizeof(FrameRecord) || h->DetectionSize != sizeof(PackedDetection) ||
+		    (h->Capacity != 0 && h->HeaderSize + h->Capacity > MapSize)) {
+			Close();
+			return false;
+		}
+		if (IsRing()) {
+			madvise((void*) Map, MapSize, MADV_WILLNEED);
+			ReadPos = h->WritePos.load(std::memory_order_acquire); // Start with the next frame
+		} else {
+			madvise((void*) Map, MapSize, MADV_SEQUENTIAL);
+			ReadPos = h->HeaderSize;
+		}
+		return true;
+	}
+
+	// Ring buffer only: start from the oldest frame that we can find in the buffer, instead of the next new one
+	void Rewind() {
+		if (!IsRing())
+			return;
+		uint64_t w = Header()->WritePos.load(std::memory_order_acquire);
+		// Records never straddle the end of the buffer, so the start of each lap is also the start of
+		// a record. Before the write position within this lap, that's the oldest place we can find one.
+		if (w != 0)
+			ReadPos = (w - 1) / Header()->Capacity * Header()->Capacity;
+	}
+
+	const detstream::FrameRecord* Next() {
+		using namespace detstream;
+		const StreamHeader* h = Header();
+		if (!IsRing()) {
+			if (ReadPos + sizeof(FrameRecord) > MapSize)
+				return nullptr;
+			const FrameRecord* r = (const FrameRecord*) (Map + ReadPos);
+			if (r->Magic != FrameMagic || r->Size < RecordSize(r->NumDetections) || r->Size > MapSize - ReadPos)
+				return nullptr; // A truncated or corrupt record
+			LastRecord = r;
+			LastLimit  = r->Size;
+			ReadPos += r->Size;
+			return r;
+		}
+
+		while (true) {
+			uint64_t w = h->WritePos.load(std::memory_order_acquire);
+			if (ReadPos == w)
+				return nullptr;
+			if (w - ReadPos > h->Capacity) {
+				Lost++;
+				ReadPos = w;
+				return nullptr;
+			}
+			uint64_t           offset = ReadPos % h->Capacity;
+			const FrameRecord* r      = (const FrameRecord*) (Map + h->HeaderSize + offset);
+			uint64_t           remain = h->Capacity - offset;
+			uint32_t           magic  = r->Magic;
+			uint32_t           size   = r->Size;
+			if (remain < sizeof(FrameRecord) || magic == PaddingMagic) {
+				// Padding, or a gap at the end that is too small to hold a padding record
+				ReadPos += remain;
+				continue;
+			}
+			if (magic != FrameMagic || size < sizeof(FrameRecord) || size > remain || !StillValidAt(ReadPos)) {
+				// Overwritten while we were looking at it
+				Lost++;
+				ReadPos = h->WritePos.load(std::memory_order_acquire);
+				return nullptr;
+			}
+			LastPos    = ReadPos;
+			LastRecord = r;
+			LastLimit  = remain;
+			ReadPos += size;
+			return r;
+		}
+	}
+
+	// Ring buffer only: true if the record most recently returned by Next() has not been overwritten.
+	// Call this after you've copied what you need out of the record.
+	bool StillValid() const {
+		return !IsRing() || StillValidAt(LastPos);
+	}
+
+	// Copy the record most recently returned by Next(). Returns false if it was overwritten while
+	// we were copying it, in which case the copy is garbage.
+	bool CopyLast(detstream::FrameRecord& header, std::vector<detstream::PackedDetection>& dets) const {
+		using namespace detstream;
+		if (!LastRecord)
+			return false;
+		header = *LastRecord;
+		// A torn NumDetections must not take us outside the mapping
+		size_t n = std::min<size_t>(header.NumDetections, (LastLimit - sizeof(FrameRecord)) / sizeof(PackedDetection));
+		dets.assign(Detections(LastRecord), Detections(LastRecord) + n);
+		return StillValid() && n == header.NumDetections;
+	}
+
+	bool IsRing() const { return Header()->Capacity != 0; }
+
+	void Close() {
+		if (Map)
+			munmap((void*) Map, MapSize);
+		Map        = nullptr;
+		MapSize    = 0;
+		LastRecord = nullptr;
+	}
+
+private:
+	const uint8_t* Map     = nullptr;
+	size_t         MapSize = 0;
+	uint64_t       ReadPos = 0; // Offset into the file, or total bytes into the ring
+	uint64_t       LastPos = 0;
+
+	const detstream::FrameRecord* LastRecord = nullptr;
+	uint64_t                      LastLimit  = 0; // Bytes that can be read from LastRecord
+
+	const detstream::StreamHeader* Header() const { return (const detstream::StreamHeader*) Map; }
+
+	// The record at pos is intact if the writer has not reserved anything a whole buffer beyond it
+	bool StillValidAt(uint64_t pos) const {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return Header()->ReserveEnd.load(std::memory_order_relaxed) - pos <= Header()->Capacity;
+	}
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+// Debug formatting that doesn't depend on HailoRT
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+std::string DumpShape(std::vector<size_t> shape) {
+	std::string out;
+	for (auto n : shape) {
+		char el[100];
+		sprintf(el, "%d,", (int) n);
+		out += el;
+	}
+	return out;
+}
+
+// dump float32 as a 2d matrix.
+// This is only suitable for printing a small corner of a tensor. To inspect a whole tensor,
+// save it with NpyWrite (npy.h) and load it with numpy.
+// stride is the number of float32 elements between rows.
+// ncols is the number of columns that you want to print per line
+// nrows is the number of rows that you want to print
+std::string DumpFloat32(const float* out, int stride, int ncols, int nrows, float mul) {
+	std::string result;
+	for (int row = 0; row < nrows; row++) {
+		int p = row * stride;
+		for (int col = 0; col < ncols; col++) {
+			char buf[1024];
+			sprintf(buf, "%4.3f ", out[p + col] * mul);
+			result += buf;
+		}
+		result += "\n";
+	}
+	return result;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// Runs the network on only some of the frames, and lets the tracker fill in the rest.
+//
+// A larger model may not keep up with the camera, but most objects move smoothly, so between two
+// inferences the Kalman filters of the tracker (see tracker.h) can predict where they are. The
+// interval between inferences adapts to the scene: it is as long as it can be while the fastest
+// object moves less than MaxDrift of its own size, and drops back to MinInterval whenever tracks
+// appear or disappear, so that new objects are confirmed quickly.
+//
+//   FrameSkipper skipper;
+//   for each frame:
+//       if (skipper.Next()) {
+//           run inference
+//           tracks = tracker.Update(dets);
+//           skipper.Observe(tracks, tracker.NumCreated());
+//       } else {
+//           tracks = tracker.Predict();
+//       }
+//
+// Optionally, a frame that would be skipped is checked with the motion detector (see motion.h)
+// first. If something moved where no track can explain it, such as an object that walked into
+// view, the frame is run through the network after all. See MotionExplained.
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "motion.h"
+#include "tracker.h"
+#include "yuv.h"
+
+class FrameSkipper {
+public:
+	int   MinInterval = 1;     // Run inference at least every MaxInterval frames, and at most every MinInterval frames
+	int   MaxInterval = 8;     //
+	float MaxDrift    = 0.25f; // How far the fastest object may move between inferences, relative to its size
+
+	int Interval = 1; // Run inference every Interval frames. Adapted by Observe().
+
+	// Should the next frame go through the network? Call this once for every frame, in order.
+	bool Next() {
+		if (++SinceInference < Interval)
+			return false;
+		SinceInference = 0;
+		return true;
+	}
+
+	// Run the frame that Next() just said to skip after all, eg because of unexplained motion
+	void Force() { SinceInference = 0; }
+
+	// Adapt the interval to the tracks after an inference. tracksCreated is the number of tracks
+	// that the tracker has ever created, so that we can tell when new ones appear.
+	void Observe(const std::vector<Track>& tracks, uint32_t tracksCreated) {
+		bool churn    = tracksCreated != LastCreated || tracks.size() != LastCount;
+		LastCreated   = tracksCreated;
+		LastCount     = tracks.size();
+		float fastest = 0; // Relative to the size of the object, per frame
+		for (const auto& t : tracks) {
+			float w = std::max(t.XMax - t.XMin, 1e-4f);
+			float h = std::max(t.YMax - t.YMin, 1e-4f);
+			fastest = std::max(fastest, std::max(fabsf(t.VelocityX) / w, fabsf(t.VelocityY) / h));
+		}
+		int target = fastest > 0 ? (int) (MaxDrift / fastest) : MaxInterval;
+		target     = std::min(MaxInterval, std::max(MinInterval, target));
+		// Slow down immediately, but speed up one step at a time, because a new track's velocity is a guess
+		Interval = churn ? MinInterval : std::min(target, Interval + 1);
+	}
+
+private:
+	int      SinceInference = 1 << 30; // So that the first frame goes through the network
+	uint32_t LastCreated    = 0;
+	size_t   LastCount      = 0;
+};
+
+// Can the tracks explain the motion that the detector found in its last Detect()? Every changed
+// block must touch the box of a track, moved by its velocity for framesAhead frames (the frames
+// between the tracks and the frame that was compared), and grown by how far it may have moved in
+// that time. toFrame maps the normalized coordinates of the tracks to the frame that the motion
+// detector saw, or is null if they are the same. width and height are the size of that frame.
+inline bool MotionExplained(const MotionDetector& motion, const std::vector<Track>& tracks, int framesAhead, const Letterbox* toFrame, int width, int height) {
+	const int block = MotionDetector::BlockArea;
+	for (int by = 0; by < motion.BlocksY; by++) {
+		for (int bx = 0; bx < motion.BlocksX; bx++) {
+			if (!motion.Changed[(size_t) by * motion.BlocksX + bx])
+				continue;
+			bool explained = false;
+			for (const auto& t : tracks) {
+				float dx = t.VelocityX * framesAhead, dy = t.VelocityY * framesAhead;
+				float x0 = std::min(t.XMin, t.XMin + dx) - fabsf(dx), x1 = std::max(t.XMax, t.XMax + dx) + fabsf(dx);
+				float y0 = std::min(t.YMin, t.YMin + dy) - fabsf(dy), y1 = std::max(t.YMax, t.YMax + dy) + fabsf(dy);
+				if (toFrame) {
+					x0 = toFrame->SourceX(x0);
+					x1 = toFrame->SourceX(x1);
+					y0 = toFrame->SourceY(y0);
+					y1 = toFrame->SourceY(y1);
+				}
+				if (x0 * width < (bx + 1) * block && x1 * width > bx * block && y0 * height < (by + 1) * block && y1 * height > by * block) {
+					explained = true;
+					break;
+				}
+			}
+			if (!explained)
+				return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Keeps a HEF in memory, and the InferModel that was parsed from it, so that reconfiguring the
+// model (eg for a different batch size) doesn't read and parse the HEF all over again.
+//
+// InferModel::configure() can be called any number of times, as long as the previous
+// ConfiguredInferModel has been released first. Settings such as the batch size and NMS
+// thresholds are sticky, so set all of them before every configure().
+//
+// The HEF bytes can be read before the VDevice exists, eg on another thread while
+// VDevice::create() is busy opening the device:
+//
+//   ModelCache cache;
+//   auto hefRead = std::async(std::launch::async, [&] { return cache.Preload("yolov8s.hef"); });
+//   auto vdevice = VDevice::create();
+//   hefRead.get();
+//   std::shared_ptr<InferModel> model;
+//   cache.Get(*vdevice.value(), "yolov8s.hef", model);
+
+#include <hailo/hailort.h>
+#include <hailo/vdevice.hpp>
+#include <hailo/infer_model.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read a whole file into memory. Returns false if it can't be read.
+inline bool ReadFileBytes(const std::string& filename, std::vector<uint8_t>& data) {
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+	bool ok   = fseek(f, 0, SEEK_END) == 0;
+	long size = ok ? ftell(f) : -1;
+	ok        = ok && size >= 0 && fseek(f, 0, SEEK_SET) == 0;
+	if (ok) {
+		data.resize((size_t) size);
+		ok = size == 0 || fread(data.data(), 1, data.size(), f) == data.size();
+	}
+	fclose(f);
+	return ok;
+}
+
+class ModelCache {
+public:
+	// Read the HEF into memory, if it isn't already. This does not need a VDevice.
+	bool Preload(const std::string& hefFile) {
+		if (HefFile == hefFile && !HefBytes.empty())
+			return true;
+		Model.reset();
+		HefFile = hefFile;
+		if (!ReadFileBytes(hefFile, HefBytes)) {
+			HefBytes.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// The InferModel for hefFile on this VDevice, which is created the first time, and reused after that
+	hailo_status Get(hailort::VDevice& vdevice, const std::string& hefFile, std::shared_ptr<hailort::InferModel>& model) {
+		using namespace hailort;
+		if (!(Model && ModelDevice == &vdevice && HefFile == hefFile)) {
+			if (!Preload(hefFile))
+				return HAILO_OPEN_FILE_FAILURE;
+			Expected<std::shared_ptr<InferModel>> infer_model_exp = vdevice.create_infer_model(MemoryView(HefBytes.data(), HefBytes.size()));
+			if (!infer_model_exp)
+				return infer_model_exp.status();
+			Model       = infer_model_exp.release();
+			ModelDevice = &vdevice;
+		}
+		model = Model;
+		return HAILO_SUCCESS;
+	}
+
+	// Forget the model, eg before the VDevice that it belongs to is destroyed. The HEF bytes are kept.
+	void ReleaseModel() {
+		Model.reset();
+		ModelDevice = nullptr;
+	}
+
+	size_t HefSize() const { return HefBytes.size(); }
+
+private:
+	std::string                          HefFile;
+	std::vector<uint8_t>                 HefBytes;
+	std::shared_ptr<hailort::InferModel> Model;
+	hailort::VDevice*                    ModelDevice = nullptr;
+};
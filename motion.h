@@ -0,0 +1,206 @@
+#pragma once
+
+// Cheap motion detection, to skip inference on frames (or tiles) where nothing has changed.
+//
+// Most frames from a fixed surveillance camera are the same as the one before, apart from sensor
+// noise. The luma plane is averaged down 8x in both directions, which removes most of the noise
+// and leaves 1/64 of the pixels, and is then compared with a reference in blocks of 8x8 downscaled
+// pixels (64x64 pixels of the frame), by the sum of absolute differences (SAD). A block has
+// changed if its mean absolute difference is above Threshold.
+//
+// The reference is the frame that was last run through the network, not the previous frame, so
+// that a slow change (eg someone walking very slowly, or the light at dusk) adds up until it is
+// noticed.
+//
+//   MotionDetector motion;
+//   if (motion.Detect(yPlane, width, height, stride) != 0) {
+//       run inference, and remember the detections
+//       motion.Accept();
+//   } else {
+//       reuse the previous detections
+//   }
+//
+// Both the downscale and the SAD use NEON on ARM and SSE2 on x86 (psadbw does a whole row of a
+// block in one instruction), and plain C++ elsewhere. All of them give identical results.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Average every 8x8 block of src into one pixel of dst, which is width / 8 pixels wide and
+// height / 8 high. The last width % 8 columns and height % 8 rows are ignored. pixelStride is 1
+// for a plane, or eg 3 to read one channel of packed RGB. Rows are averaged in pairs, with
+// rounding, like the SIMD instructions do, so the result can be up to 1 level above the true mean.
+inline void Downscale8(const uint8_t* src, int width, int height, int stride, int pixelStride, uint8_t* dst) {
+	int dstWidth  = width / 8;
+	int dstHeight = height / 8;
+	for (int y = 0; y < dstHeight; y++) {
+		const uint8_t* r[8];
+		for (int k = 0; k < 8; k++)
+			r[k] = src + (size_t) (y * 8 + k) * stride;
+		uint8_t* out = dst + (size_t) y * dstWidth;
+		int      x   = 0;
+		if (pixelStride == 1) {
+#if defined(__ARM_NEON)
+			for (; x + 2 <= dstWidth; x += 2) {
+				int        i = x * 8;
+				uint8x16_t a = vrhaddq_u8(vrhaddq_u8(vld1q_u8(r[0] + i), vld1q_u8(r[1] + i)), vrhaddq_u8(vld1q_u8(r[2] + i), vld1q_u8(r[3] + i)));
+				uint8x16_t b = vrhaddq_u8(vrhaddq_u8(vld1q_u8(r[4] + i), vld1q_u8(r[5] + i)), vrhaddq_u8(vld1q_u8(r[6] + i), vld1q_u8(r[7] + i)));
+				uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vrhaddq_u8(a, b))));
+				out[x]       = (uint8_t) ((vgetq_lane_u64(s, 0) + 4) >> 3);
+				out[x + 1]   = (uint8_t) ((vgetq_lane_u64(s, 1) + 4) >> 3);
+			}
+#elif defined(__SSE2__)
+			const __m128i zero = _mm_setzero_si128();
+			for (; x + 2 <= dstWidth; x += 2) {
+				int     i = x * 8;
+				__m128i a = _mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((const __m128i*) (r[0] + i)), _mm_loadu_si128((const __m128i*) (r[1] + i))),
+				                         _mm_avg_epu8(_mm_loadu_si128((const __m128i*) (r[2] + i)), _mm_loadu_si128((const __m128i*) (r[3] + i))));
+				__m128i b = _mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((const __m128i*) (r[4] + i)), _mm_loadu_si128((const __m128i*) (r[5] + i))),
+				                         _mm_avg_epu8(_mm_loadu_si128((const __m128i*) (r[6] + i)), _mm_loadu_si128((const __m128i*) (r[7] + i))));
+				__m128i s = _mm_sad_epu8(_mm_avg_epu8(a, b), zero); // Sum of each half
+				out[x]     = (uint8_t) ((_mm_cvtsi128_si32(s) + 4) >> 3);
+				out[x + 1] = (uint8_t) ((_mm_extract_epi16(s, 4) + 4) >> 3);
+			}
+#endif
+		}
+		for (; x < dstWidth; x++) {
+			unsigned sum = 0;
+			for (int i = 0; i < 8; i++) {
+				size_t   p = (size_t) (x * 8 + i) * pixelStride;
+				unsigned a = (((r[0][p] + r[1][p] + 1) >> 1) + ((r[2][p] + r[3][p] + 1) >> 1) + 1) >> 1;
+				unsigned b = (((r[4][p] + r[5][p] + 1) >> 1) + ((r[6][p] + r[7][p] + 1) >> 1) + 1) >> 1;
+				sum += (a + b + 1) >> 1;
+			}
+			out[x] = (uint8_t) ((sum + 4) >> 3);
+		}
+	}
+}
+
+// Add the sum of absolute differences of a and b (both width x height, packed) to the block
+// that each pixel is in. Blocks are 8x8 pixels, and there are blocksX of them across. The blocks
+// on the right and bottom edges may be smaller.
+inline void AddBlockSAD(const uint8_t* a, const uint8_t* b, int width, int height, int blocksX, uint32_t* sad) {
+	for (int y = 0; y < height; y++) {
+		const uint8_t* ra  = a + (size_t) y * width;
+		const uint8_t* rb  = b + (size_t) y * width;
+		uint32_t*      row = sad + (size_t) (y / 8) * blocksX;
+		int            x   = 0;
+#if defined(__ARM_NEON)
+		for (; x + 16 <= width; x += 16) {
+			uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(vld1q_u8(ra + x), vld1q_u8(rb + x)))));
+			row[x / 8] += (uint32_t) vgetq_lane_u64(s, 0);
+			row[x / 8 + 1] += (uint32_t) vgetq_lane_u64(s, 1);
+		}
+#elif defined(__SSE2__)
+		for (; x + 16 <= width; x += 16) {
+			__m128i s = _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (ra + x)), _mm_loadu_si128((const __m128i*) (rb + x)));
+			row[x / 8] += (uint32_t) _mm_cvtsi128_si32(s);
+			row[x / 8 + 1] += (uint32_t) _mm_extract_epi16(s, 4);
+		}
+#endif
+		for (; x < width; x++)
+			row[x / 8] += (uint32_t) abs(ra[x] - rb[x]);
+	}
+}
+
+class MotionDetector {
+public:
+	static constexpr int Scale     = 8;                 // Downscale factor
+	static constexpr int BlockSize = 8;                 // In downscaled pixels
+	static constexpr int BlockArea = Scale * BlockSize; // Size of a block in the frame, in pixels
+
+	int Threshold = 6; // Mean absolute difference of a block, in luma levels, above which it has changed
+
+	int                   BlocksX = 0;
+	int                   BlocksY = 0;
+	std::vector<uint32_t> SAD;     // Of each block, row by row, from the last Detect()
+	std::vector<uint8_t>  Changed; // 1 for each block that has changed
+
+	// Compare a frame with the reference, and return the number of blocks that have changed. If
+	// there is no reference yet (or the frame size has changed), every block has changed. For
+	// packed RGB, pass a pointer to the green channel, and a pixelStride of 3.
+	int Detect(const uint8_t* luma, int width, int height, int stride, int pixelStride = 1) {
+		if (width != FrameWidth || height != FrameHeight) {
+			FrameWidth   = width;
+			FrameHeight  = height;
+			SmallWidth   = width / Scale;
+			SmallHeight  = height / Scale;
+			BlocksX      = std::max(1, (SmallWidth + BlockSize - 1) / BlockSize);
+			BlocksY      = std::max(1, (SmallHeight + BlockSize - 1) / BlockSize);
+			HasReference = false;
+			Current.resize((size_t) SmallWidth * SmallHeight);
+			Reference.resize(Current.size());
+			SAD.resize((size_t) BlocksX * BlocksY);
+			Changed.resize(SAD.size());
+		}
+		Downscale8(luma, width, height, stride, pixelStride, Current.data());
+		if (!HasReference || Current.empty()) {
+			std::fill(SAD.begin(), SAD.end(), UINT32_MAX);
+			std::fill(Changed.begin(), Changed.end(), 1);
+			return (int) Changed.size();
+		}
+		std::fill(SAD.begin(), SAD.end(), 0);
+		AddBlockSAD(Current.data(), Reference.data(), SmallWidth, SmallHeight, BlocksX, SAD.data());
+		int nChanged = 0;
+		for (int by = 0; by < BlocksY; by++) {
+			int h = std::min(BlockSize, SmallHeight - by * BlockSize);
+			for (int bx = 0; bx < BlocksX; bx++) {
+				int    w   = std::min(BlockSize, SmallWidth - bx * BlockSize);
+				size_t i   = (size_t) by * BlocksX + bx;
+				Changed[i] = SAD[i] > (uint32_t) (Threshold * w * h);
+				nChanged += Changed[i];
+			}
+		}
+		return nChanged;
+	}
+
+	// True if any block that overlaps this rectangle of the frame changed in the last Detect()
+	bool AnyChanged(int x, int y, int width, int height) const {
+		int bx0 = std::min(BlocksX - 1, x / BlockArea), bx1 = std::min(BlocksX - 1, (x + width - 1) / BlockArea);
+		int by0 = std::min(BlocksY - 1, y / BlockArea), by1 = std::min(BlocksY - 1, (y + height - 1) / BlockArea);
+		for (int by = by0; by <= by1; by++) {
+			for (int bx = bx0; bx <= bx1; bx++) {
+				if (Changed[(size_t) by * BlocksX + bx])
+					return true;
+			}
+		}
+		return false;
+	}
+
+	// Make the frame of the last Detect() the reference, because it went through the network
+	void Accept() {
+		Reference    = Current;
+		HasReference = true;
+	}
+
+	// Like Accept(), but only for a rectangle of the frame, such as a tile that went through the
+	// network. Parts of the frame that have never been accepted compare as changed.
+	void Accept(int x, int y, int width, int height) {
+		int x0 = x / Scale, x1 = std::min(SmallWidth, (x + width) / Scale);
+		int y0 = y / Scale, y1 = std::min(SmallHeight, (y + height) / Scale);
+		for (int sy = y0; sy < y1; sy++)
+			memcpy(&Reference[(size_t) sy * SmallWidth + x0], &Current[(size_t) sy * SmallWidth + x0], std::max(0, x1 - x0));
+		HasReference = true;
+	}
+
+	// Forget the reference, so that the next frame counts as changed everywhere
+	void Reset() { HasReference = false; }
+
+private:
+	int                  FrameWidth   = 0;
+	int                  FrameHeight  = 0;
+	int                  SmallWidth   = 0;
+	int                  SmallHeight  = 0;
+	bool                 HasReference = false;
+	std::vector<uint8_t> Current;
+	std::vector<uint8_t> Reference;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// A box produced by the NMS stage. Coordinates are normalized to [0..1].
+struct Detection {
+	int   ClassID;
+	float Confidence;
+	float XMin;
+	float YMin;
+	float XMax;
+	float YMax;
+};
+
+// Parse a FLOAT32 output tensor in HAILO NMS order, appending the boxes with confidence >= minConfidence to 'out'.
+// The format is:
+// For each class: Number of boxes in that class (N), followed by the 5 box parameters
+// (ymin, xmin, ymax, xmax, confidence), repeated N times.
+// numClasses is the height of the output tensor shape, and numFloats is the size of the buffer.
+// Parsing stops at a box count that doesn't fit in the rest of the buffer, such as in a truncated
+// or corrupt recording.
+// Returns the number of floats that were consumed.
+inline size_t ParseHailoNMS(const float* raw, size_t numClasses, size_t numFloats, float minConfidence, std::vector<Detection>& out) {
+	size_t idx = 0;
+	for (size_t classIdx = 0; classIdx < numClasses && idx < numFloats; classIdx++) {
+		float count = raw[idx++];
+		if (!(count >= 0 && count <= (float) ((numFloats - idx) / 5)))
+			break;
+		size_t numBoxes = (size_t) count;
+		for (size_t i = 0; i < numBoxes; i++) {
+			float confidence = raw[idx + 4];
+			if (confidence >= minConfidence) {
+				Detection d;
+				d.ClassID    = (int) classIdx;
+				d.Confidence = confidence;
+				d.YMin       = raw[idx];
+				d.XMin       = raw[idx + 1];
+				d.YMax       = raw[idx + 2];
+				d.XMax       = raw[idx + 3];
+				out.push_back(d);
+			}
+			idx += 5;
+		}
+	}
+	return idx;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+// Read and write tensors as .npy files (https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html),
+// which you can load with numpy.load(), or memory-map with numpy.load(mmap_mode='r').
+//
+// Writing is a single writev() of the header and the raw tensor bytes, so it's limited only by
+// the speed of the filesystem. Reading memory-maps the file, and points directly at the data.
+//
+// Quantization parameters don't have a place in the .npy header, so we append them as a Python
+// comment (eg "# qp_zp: 0, qp_scale: 0.0039"), which numpy ignores, and NpyFile reads back.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+struct NpyQuant {
+	float QpZp    = 0;
+	float QpScale = 1;
+};
+
+// Writes data as a .npy file. descr is a numpy dtype, such as "<f4", "|u1" or "<u2".
+// size must equal the product of shape, times the size of the dtype.
+inline bool NpyWrite(const std::string& filename, const char* descr, const std::vector<size_t>& shape, const void* data, size_t size, const NpyQuant* quant = nullptr) {
+	// Version 1.0 header: magic, version, uint16 header length, then a Python dict literal
+	// padded with spaces and a newline, so that the data starts on a 64 byte boundary.
+	char  header[512];
+	char* p   = header + 10;
+	char* end = header + sizeof(header) - 1;
+	p += snprintf(p, end - p, "{'descr': '%s', 'fortran_order': False, 'shape': (", descr);
+	for (size_t i = 0; i < shape.size() && p < end; i++)
+		p += snprintf(p, end - p, shape.size() == 1 ? "%zu," : (i == 0 ? "%zu" : ", %zu"), shape[i]);
+	if (p < end)
+		p += snprintf(p, end - p, "), }");
+	if (quant && p < end)
+		p += snprintf(p, end - p, " # qp_zp: %.9g, qp_scale: %.9g", quant->QpZp, quant->QpScale);
+	if (p >= end - 64)
+		return false;
+	size_t total = ((p - header) + 1 + 63) & ~(size_t) 63;
+	memset(p, ' ', header + total - 1 - p);
+	header[total - 1] = '\n';
+
+	memcpy(header, "\x93NUMPY\x01\x00", 8);
+	uint16_t headerLen = (uint16_t) (total - 10);
+	header[8]          = (char) (headerLen & 0xff);
+	header[9]          = (char) (headerLen >> 8);
+
+	int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+	struct iovec iov[2] = {{header, total}, {(void*) data, size}};
+	size_t       want   = total + size;
+	ssize_t      n      = writev(fd, iov, 2);
+	// writev may write less than asked for, so finish off the data with plain write().
+	// The header is tiny, so we don't bother handling a short write inside it.
+	size_t done = n < (ssize_t) total ? 0 : (size_t) n;
+	while (done >= total && done < want) {
+		n = write(fd, (const uint8_t*) data + (done - total), want - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	return close(fd) == 0 && done == want;
+}
+
+// A memory-mapped .npy file. Only C order (not Fortran order) arrays are supported.
+class NpyFile {
+public:
+	std::string         Descr; // eg "<f4"
+	std::vector<size_t> Shape;
+	const void*         Data     = nullptr;
+	size_t              DataSize = 0;
+	bool                HasQuant = false;
+	NpyQuant            Quant;
+
+	~NpyFile() {
+		Close();
+	}
+
+	bool Open(const std::string& filename) {
+		Close();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < 12) {
+			close(fd);
+			return false;
+		}
+		MapSize = (size_t) st.st_size;
+		Map     = (const uint8_t*) mmap(nullptr, MapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (Map == MAP_FAILED) {
+			Map = nullptr;
+			return false;
+		}
+		if (!ParseHeader()) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close() {
+		if (Map)
+			munmap((void*) Map, MapSize);
+		Map      = nullptr;
+		MapSize  = 0;
+		Data     = nullptr;
+		DataSize = 0;
+		HasQuant = false;
+		Quant    = NpyQuant();
+		Descr.clear();
+		Shape.clear();
+	}
+
+	// Size of one element, from the dtype
+	size_t ElementSize() const {
+		return Descr.size() >= 3 ? (size_t) atoi(Descr.c_str() + 2) : 0;
+	}
+
+	size_t NumElements() const {
+		size_t n = 1;
+		for (auto s : Shape)
+			n *= s;
+		return n;
+	}
+
+private:
+	const uint8_t* Map     = nullptr;
+	size_t         MapSize = 0;
+
+	bool ParseHeader() {
+		if (memcmp(Map, "\x93NUMPY", 6) != 0)
+			return false;
+		int    major = Map[6];
+		size_t headerLen, headerStart;
+		if (major == 1) {
+			headerLen   = Map[8] | (Map[9] << 8);
+			headerStart = 10;
+		} else if (major == 2 || major == 3) {
+			headerLen   = Map[8] | (Map[9] << 8) | (Map[10] << 16) | ((size_t) Map[11] << 24);
+			headerStart = 12;
+		} else {
+			return false;
+		}
+		if (headerStart + headerLen > MapSize)
+			return false;
+		std::string h((const char*) Map + headerStart, headerLen);
+
+		// We only need to understand the headers that numpy (and NpyWrite) produce
+		size_t d = h.find("'descr':");
+		if (d == std::string::npos)
+			return false;
+		size_t q1 = h.find('\'', d + 8);
+		size_t q2 = q1 == std::string::npos ? q1 : h.find('\'', q1 + 1);
+		if (q2 == std::string::npos)
+			return false;
+		Descr = h.substr(q1 + 1, q2 - q1 - 1);
+
+		if (h.find("'fortran_order': True") != std::string::npos)
+			return false;
+
+		size_t s = h.find("'shape':");
+		size_t o = s == std::string::npos ? s : h.find('(', s);
+		size_t c = o == std::string::npos ? o : h.find(')', o);
+		if (c == std::string::npos)
+			return false;
+		const char* dims = h.c_str() + o + 1;
+		while (true) {
+			char* next;
+			long  v = strtol(dims, &next, 10);
+			if (next == dims)
+				break;
+			Shape.push_back((size_t) v);
+			dims = next;
+			while (*dims == ',' || *dims == ' ')
+				dims++;
+		}
+
+		size_t comment = h.find("# qp_zp:");
+		if (comment != std::string::npos) {
+			HasQuant = sscanf(h.c_str() + comment, "# qp_zp: %f, qp_scale: %f", &Quant.QpZp, &Quant.QpScale) == 2;
+		}
+
+		Data     = Map + headerStart + headerLen;
+		DataSize = MapSize - headerStart - headerLen;
+		return ElementSize() != 0 && NumElements() * ElementSize() <= DataSize;
+	}
+};
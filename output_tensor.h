@@ -3,6 +3,8 @@
 #include <memory>
 #include <string>
 
+#include "npy.h"
+
 class OutTensor {
 public:
 	uint8_t*               data;
@@ -19,4 +21,34 @@ public:
 	static bool SortFunction(const OutTensor& l, const OutTensor& r) {
 		return l.shape.width < r.shape.width;
 	}
+
+	// Write the raw tensor as a .npy file, with its quantization parameters.
+	// HAILO NMS output is variable length per class, so it is saved as a flat float32 array of
+	// classes * (1 + 5 * max boxes per class) floats. For each class, in order: the number of
+	// boxes N, then N boxes of (ymin, xmin, ymax, xmax, confidence). The rest of the buffer is
+	// unused. Walk it the way ParseHailoNMS does. Don't reshape it to (classes, ...), because the
+	// rows only line up with the classes when every class is full.
+	bool SaveNpy(const std::string& filename) const {
+		const char* descr    = "|u1";
+		size_t      elemSize = 1;
+		if (format.type == HAILO_FORMAT_TYPE_UINT16) {
+			descr    = "<u2";
+			elemSize = 2;
+		} else if (format.type == HAILO_FORMAT_TYPE_FLOAT32) {
+			descr    = "<f4";
+			elemSize = 4;
+		}
+		std::vector<size_t> npyShape;
+		if (format.order == HAILO_FORMAT_ORDER_HAILO_NMS)
+			npyShape = {shape.height * (1 + 5 * (size_t) shape.width)};
+		else
+			npyShape = {shape.height, shape.width, shape.features};
+		size_t size = elemSize;
+		for (auto n : npyShape)
+			size *= n;
+		NpyQuant quant;
+		quant.QpZp    = quant_info.qp_zp;
+		quant.QpScale = quant_info.qp_scale;
+		return NpyWrite(filename, descr, npyShape, data, size, &quant);
+	}
 };
@@ -0,0 +1,260 @@
+#pragma once
+
+// Instance segmentation masks for YOLOv8-seg.
+//
+// Besides its box, YOLOv8-seg outputs 32 mask coefficients for each object, and one tensor of 32
+// prototype masks for the whole frame, at a quarter of the input resolution (160x160x32 for a
+// 640x640 model). The mask of an object is the sigmoid of its coefficients times the prototypes,
+// cropped to its box:
+//
+//   mask(x, y) = sigmoid(sum over c of coeffs[c] * proto(x, y, c)) > threshold, for (x, y) in the box
+//
+// That is a matrix-vector product (GEMV) of the 25600 x 32 prototype matrix with the coefficients,
+// but only the rows inside the box are needed, so a box that covers 5% of the frame costs 5% of
+// the whole product. The prototypes stay quantized: the coefficients are scaled to int16 once per
+// box, and each cell is a dot product of 32 byte/int16 pairs. Cells are done in blocks of 4, with
+// the coefficients held in registers, using pmaddwd on SSE2 and vmlal on NEON. All paths give
+// identical results.
+//
+// The sigmoid is monotonic, so for a bitmask, sigmoid(v) > threshold is just v > logit(threshold),
+// and it is never computed. Soft masks (probabilities) get it from a lookup table.
+//
+//   MaskDecoder    decoder;
+//   MaskPrototypes protos = {tensor, 160, 160, zeroPoint, scale};
+//   SegMask        mask;
+//   for each detection:
+//       decoder.Decode(det, coeffs, protos, mask);
+//       EncodeMaskRLE(mask, counts);
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "nms.h"
+
+// The prototype tensor, as the network outputs it: uint8, NHWC, with the 32 channels of each
+// cell next to each other. The value of a channel is Scale * (q - ZeroPoint).
+struct MaskPrototypes {
+	const uint8_t* Data      = nullptr;
+	int            Width     = 0;
+	int            Height    = 0;
+	float          ZeroPoint = 0;
+	float          Scale     = 1;
+};
+
+// The mask of one object, cropped to its box. Coordinates are in prototype cells (4x4 pixels of
+// the network input).
+struct SegMask {
+	int                  X      = 0;
+	int                  Y      = 0;
+	int                  Width  = 0;
+	int                  Height = 0;
+	int                  Stride = 0; // Bytes per row of Bits
+	std::vector<uint8_t> Bits;       // Row by row, one bit per cell, least significant bit first
+
+	// x and y are relative to the crop
+	bool Get(int x, int y) const { return (Bits[(size_t) y * Stride + x / 8] >> (x & 7)) & 1; }
+
+	// Number of cells that are set
+	int Area() const {
+		int n = 0;
+		for (uint8_t b : Bits)
+			n += __builtin_popcount(b);
+		return n;
+	}
+};
+
+// Dot products of the coefficients with n cells of prototypes, which are packed, 32 bytes per
+// cell. out[i] = sum over c of coeffs[c] * protos[i * 32 + c].
+inline void MaskDotRow(const uint8_t* protos, int n, const int16_t* coeffs, int32_t* out) {
+	int x = 0;
+#if defined(__ARM_NEON)
+	int16x8_t c0 = vld1q_s16(coeffs), c1 = vld1q_s16(coeffs + 8), c2 = vld1q_s16(coeffs + 16), c3 = vld1q_s16(coeffs + 24);
+	for (; x + 4 <= n; x += 4) {
+		int32x4_t sum[4];
+		for (int k = 0; k < 4; k++) {
+			const uint8_t* p  = protos + (size_t) (x + k) * 32;
+			uint8x16_t     a  = vld1q_u8(p);
+			uint8x16_t     b  = vld1q_u8(p + 16);
+			int16x8_t      a0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(a)));
+			int16x8_t      a1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(a)));
+			int16x8_t      b0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b)));
+			int16x8_t      b1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b)));
+			int32x4_t      s  = vmull_s16(vget_low_s16(a0), vget_low_s16(c0));
+			s                 = vmlal_s16(s, vget_high_s16(a0), vget_high_s16(c0));
+			s                 = vmlal_s16(s, vget_low_s16(a1), vget_low_s16(c1));
+			s                 = vmlal_s16(s, vget_high_s16(a1), vget_high_s16(c1));
+			s                 = vmlal_s16(s, vget_low_s16(b0), vget_low_s16(c2));
+			s                 = vmlal_s16(s, vget_high_s16(b0), vget_high_s16(c2));
+			s                 = vmlal_s16(s, vget_low_s16(b1), vget_low_s16(c3));
+			sum[k]            = vmlal_s16(s, vget_high_s16(b1), vget_high_s16(c3));
+		}
+		// Add up the lanes of each cell
+		int32x2_t s01 = vpadd_s32(vpadd_s32(vget_low_s32(sum[0]), vget_high_s32(sum[0])), vpadd_s32(vget_low_s32(sum[1]), vget_high_s32(sum[1])));
+		int32x2_t s23 = vpadd_s32(vpadd_s32(vget_low_s32(sum[2]), vget_high_s32(sum[2])), vpadd_s32(vget_low_s32(sum[3]), vget_high_s32(sum[3])));
+		vst1q_s32(out + x, vcombine_s32(s01, s23));
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i       c0   = _mm_loadu_si128((const __m128i*) coeffs);
+	__m128i       c1   = _mm_loadu_si128((const __m128i*) (coeffs + 8));
+	__m128i       c2   = _mm_loadu_si128((const __m128i*) (coeffs + 16));
+	__m128i       c3   = _mm_loadu_si128((const __m128i*) (coeffs + 24));
+	for (; x + 4 <= n; x += 4) {
+		__m128i sum[4];
+		for (int k = 0; k < 4; k++) {
+			const uint8_t* p = protos + (size_t) (x + k) * 32;
+			__m128i        a = _mm_loadu_si128((const __m128i*) p);
+			__m128i        b = _mm_loadu_si128((const __m128i*) (p + 16));
+			sum[k]           = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(a, zero), c0), _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), c1)),
+			                                 _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(b, zero), c2), _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), c3)));
+		}
+		// Add up the lanes of each cell, by transposing the 4x4 block
+		__m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(sum[0], sum[1]), _mm_unpackhi_epi32(sum[0], sum[1]));
+		__m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(sum[2], sum[3]), _mm_unpackhi_epi32(sum[2], sum[3]));
+		_mm_storeu_si128((__m128i*) (out + x), _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23)));
+	}
+#endif
+	for (; x < n; x++) {
+		const uint8_t* p = protos + (size_t) x * 32;
+		int32_t        s = 0;
+		for (int c = 0; c < 32; c++)
+			s += coeffs[c] * p[c];
+		out[x] = s;
+	}
+}
+
+class MaskDecoder {
+public:
+	static constexpr int NumCoefficients = 32;
+
+	float Threshold = 0.5f; // Probability above which a cell is part of the mask
+
+	MaskDecoder() {
+		for (int i = 0; i < LUTSize; i++) {
+			float v       = (i + 0.5f) / LUTScale - LUTRange;
+			SigmoidLUT[i] = (uint8_t) lrintf(255 / (1 + expf(-v)));
+		}
+	}
+
+	// Decode the bitmask of one object. box is normalized to the network input, which the
+	// prototypes cover. Cells that are only partly inside the box are included.
+	void Decode(const Detection& box, const float* coeffs, const MaskPrototypes& protos, SegMask& mask) {
+		Prepare(box, coeffs, protos, mask);
+		mask.Stride = (mask.Width + 7) / 8;
+		mask.Bits.assign((size_t) mask.Stride * mask.Height, 0);
+		// sigmoid(v) > Threshold is v > logit(Threshold), and v = (dot - Offset) * Scale
+		float   t      = std::min(0.9999f, std::max(0.0001f, Threshold));
+		double  limit  = Offset + log(t / (1 - t)) / Scale;
+		int32_t minDot = (int32_t) std::min<double>(INT32_MAX, std::max<double>(INT32_MIN, floor(limit)));
+		for (int y = 0; y < mask.Height; y++) {
+			DotRow(protos, mask, y);
+			uint8_t* bits = &mask.Bits[(size_t) y * mask.Stride];
+			for (int x = 0; x < mask.Width; x += 8) {
+				int     n    = std::min(8, mask.Width - x);
+				uint8_t byte = 0;
+				for (int i = 0; i < n; i++)
+					byte |= (uint8_t) ((Dots[x + i] > minDot) << i);
+				bits[x / 8] = byte;
+			}
+		}
+	}
+
+	// Decode the probabilities of one object, 0..255 for each cell of its crop, row by row. The
+	// crop is written to mask, but its Bits are left alone.
+	void DecodeSoft(const Detection& box, const float* coeffs, const MaskPrototypes& protos, SegMask& mask, std::vector<uint8_t>& probs) {
+		Prepare(box, coeffs, protos, mask);
+		probs.resize((size_t) mask.Width * mask.Height);
+		float scale = Scale * LUTScale;
+		float bias  = (float) (LUTRange * LUTScale - Offset * scale);
+		for (int y = 0; y < mask.Height; y++) {
+			DotRow(protos, mask, y);
+			uint8_t* out = &probs[(size_t) y * mask.Width];
+			for (int x = 0; x < mask.Width; x++) {
+				float i = std::min((float) (LUTSize - 1), std::max(0.0f, Dots[x] * scale + bias));
+				out[x]  = SigmoidLUT[(int) i];
+			}
+		}
+	}
+
+private:
+	static constexpr int LUTRange = 8;  // The table covers sigmoid(-8) to sigmoid(8). Beyond that, it is 0 or 255.
+	static constexpr int LUTScale = 64; // Entries per unit
+	static constexpr int LUTSize  = 2 * LUTRange * LUTScale;
+
+	int16_t              Coeffs[NumCoefficients];
+	double               Offset = 0; // v = (dot - Offset) * Scale, where dot is the integer dot product
+	double               Scale  = 1;
+	std::vector<int32_t> Dots;       // Of one row of the crop
+	uint8_t              SigmoidLUT[LUTSize];
+
+	// Find the crop, and scale the coefficients to int16. The largest becomes +-32767, so a dot
+	// product is at most 32 * 32767 * 255, which fits in int32.
+	void Prepare(const Detection& box, const float* coeffs, const MaskPrototypes& protos, SegMask& mask) {
+		int x0      = std::max(0, (int) floorf(box.XMin * protos.Width));
+		int y0      = std::max(0, (int) floorf(box.YMin * protos.Height));
+		int x1      = std::min(protos.Width, (int) ceilf(box.XMax * protos.Width));
+		int y1      = std::min(protos.Height, (int) ceilf(box.YMax * protos.Height));
+		mask.X      = std::min(x0, protos.Width);
+		mask.Y      = std::min(y0, protos.Height);
+		mask.Width  = std::max(0, x1 - mask.X);
+		mask.Height = std::max(0, y1 - mask.Y);
+
+		float maxAbs = 0;
+		for (int c = 0; c < NumCoefficients; c++)
+			maxAbs = std::max(maxAbs, fabsf(coeffs[c]));
+		float   k   = maxAbs > 0 ? 32767 / maxAbs : 1;
+		int32_t sum = 0;
+		for (int c = 0; c < NumCoefficients; c++) {
+			Coeffs[c] = (int16_t) lrintf(coeffs[c] * k);
+			sum += Coeffs[c];
+		}
+		// The prototypes are Scale * (q - ZeroPoint), so the zero point comes out of the sum
+		Offset = (double) protos.ZeroPoint * sum;
+		Scale  = (double) protos.Scale / k;
+		Dots.resize(mask.Width);
+	}
+
+	void DotRow(const MaskPrototypes& protos, const SegMask& mask, int y) {
+		const uint8_t* row = protos.Data + ((size_t) (mask.Y + y) * protos.Width + mask.X) * NumCoefficients;
+		MaskDotRow(row, mask.Width, Coeffs, Dots.data());
+	}
+};
+
+// Run-length encode a mask, row by row over its crop: the lengths of alternating runs of 0 and 1,
+// starting with 0 (which may be an empty run). This is the COCO RLE, except that COCO goes column
+// by column over the whole image. Up to 64 cells are scanned at once, so the cost is in the runs.
+inline void EncodeMaskRLE(const SegMask& mask, std::vector<uint32_t>& counts) {
+	counts.clear();
+	uint32_t run = 0;
+	int      bit = 0;
+	for (int y = 0; y < mask.Height; y++) {
+		const uint8_t* bits = &mask.Bits[(size_t) y * mask.Stride];
+		for (int x = 0; x < mask.Width; x += 64) {
+			int      n    = std::min(64, mask.Width - x);
+			uint64_t word = 0;
+			memcpy(&word, bits + x / 8, (n + 7) / 8); // Little endian
+			for (int i = 0; i < n;) {
+				// The number of cells from i on that have the value of the current run
+				uint64_t same = (bit ? ~word : word) >> i;
+				int      len  = same == 0 ? n - i : std::min(n - i, __builtin_ctzll(same));
+				run += len;
+				i += len;
+				if (i < n) {
+					counts.push_back(run);
+					run = 0;
+					bit ^= 1;
+				}
+			}
+		}
+	}
+	counts.push_back(run);
+}
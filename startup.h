@@ -0,0 +1,80 @@
+#pragma once
+
+// Measures each phase of startup, including phases that run in parallel on other threads, and
+// prints a breakdown:
+//
+//   Startup phase           start  duration
+//     VDevice::create      +0.0ms   180.3ms
+//     read HEF             +0.1ms     4.2ms  (background)
+//     decode image         +0.1ms    11.8ms  (background)
+//     create infer model +180.4ms    25.1ms
+//     ...
+//     total                         402.7ms  (411.0ms if run one after the other)
+//
+//   StartupTimer startup;
+//   auto vdevice_exp = startup.Time("VDevice::create", [&] { return VDevice::create(); });
+//
+// Every phase is also recorded with the Tracer, so that it shows up in a Chrome trace.
+// Phase names must be string literals.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+class StartupTimer {
+public:
+	StartupTimer() : StartNs(Tracer::NowNs()), MainThread(std::this_thread::get_id()) {}
+
+	// Run fn(), and record how long it took, as a phase called name. Thread safe.
+	template <typename F>
+	auto Time(const char* name, F&& fn) -> decltype(fn()) {
+		Scope scope(*this, name);
+		return fn();
+	}
+
+	void Print() {
+		std::lock_guard<std::mutex> lock(Lock);
+		uint64_t                    end    = Tracer::NowNs();
+		uint64_t                    serial = 0;
+		std::vector<Phase>          sorted = Phases;
+		std::sort(sorted.begin(), sorted.end(), [](const Phase& a, const Phase& b) { return a.StartNs < b.StartNs; });
+		printf("%-22s %8s %9s\n", "Startup phase", "start", "duration");
+		for (const auto& p : sorted) {
+			printf("  %-20s %+7.1fms %7.1fms%s\n", p.Name, (p.StartNs - StartNs) / 1e6, (p.EndNs - p.StartNs) / 1e6, p.Background ? "  (background)" : "");
+			serial += p.EndNs - p.StartNs;
+		}
+		printf("  %-20s %9s %7.1fms  (%.1fms if run one after the other)\n", "total", "", (end - StartNs) / 1e6, serial / 1e6);
+	}
+
+private:
+	struct Phase {
+		const char* Name;
+		uint64_t    StartNs;
+		uint64_t    EndNs;
+		bool        Background;
+	};
+
+	struct Scope {
+		StartupTimer& Timer;
+		const char*   Name;
+		uint64_t      Start;
+
+		Scope(StartupTimer& timer, const char* name) : Timer(timer), Name(name), Start(Tracer::NowNs()) {}
+		~Scope() {
+			uint64_t end = Tracer::NowNs();
+			Tracer::Record(Name, Start, end);
+			std::lock_guard<std::mutex> lock(Timer.Lock);
+			Timer.Phases.push_back({Name, Start, end, std::this_thread::get_id() != Timer.MainThread});
+		}
+	};
+
+	uint64_t           StartNs;
+	std::thread::id    MainThread;
+	std::mutex         Lock;
+	std::vector<Phase> Phases;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+// Fast text output, for logging thousands of detections per second.
+//
+// TextWriter formats into a fixed, reusable buffer with std::to_chars (no locale, no format
+// string parsing, no allocations), and hands the buffer to the kernel with a single write(2)
+// when it fills up, or when you call Flush(). Compared to printf, there is no stdio lock, and
+// one syscall for many lines instead of one (or more) per line.
+//
+//   TextWriter out(STDOUT_FILENO);
+//   for (const auto& d : detections)
+//       WriteDetection(out, DetectionFormat::JSONL, frame, d, width, height);
+//   out.Flush();
+//
+// If you mix this with printf on the same file descriptor, fflush(stdout) first.
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include "nms.h"
+
+class TextWriter {
+public:
+	// fd may be -1, in which case output is only kept in memory (see Data() and Clear())
+	explicit TextWriter(int fd, size_t capacity = 64 * 1024) : FD(fd), Buf(capacity < 256 ? 256 : capacity) {}
+
+	~TextWriter() {
+		Flush();
+	}
+
+	TextWriter& Char(char c) {
+		Reserve(1);
+		Buf[Len++] = c;
+		return *this;
+	}
+
+	TextWriter& Str(const char* s, size_t n) {
+		if (n > Buf.size() - Len) {
+			Flush();
+			if (n > Buf.size() - Len) {
+				// Too big for the buffer, so write it directly (or grow, if we're writing to memory)
+				if (FD == -1) {
+					Buf.resize(Len + n);
+				} else {
+					WriteAll(s, n);
+					return *this;
+				}
+			}
+		}
+		memcpy(Buf.data() + Len, s, n);
+		Len += n;
+		return *this;
+	}
+
+	TextWriter& Str(const char* s) { return Str(s, strlen(s)); }
+	TextWriter& Str(const std::string& s) { return Str(s.data(), s.size()); }
+
+	TextWriter& Int(int64_t v) {
+		Reserve(24);
+		Len = std::to_chars(Buf.data() + Len, Buf.data() + Buf.size(), v).ptr - Buf.data();
+		return *this;
+	}
+
+	// Fixed notation with the given number of digits after the decimal point, like printf("%.2f")
+	TextWriter& Float(double v, int precision) {
+		Reserve(64);
+		auto r = std::to_chars(Buf.data() + Len, Buf.data() + Buf.size(), v, std::chars_format::fixed, precision);
+		if (r.ec == std::errc())
+			Len = r.ptr - Buf.data();
+		else
+			Str("nan"); // Only huge values don't fit in 64 characters
+		return *this;
+	}
+
+	// Write everything that's buffered. Returns false if the write failed.
+	bool Flush() {
+		if (FD == -1 || Len == 0)
+			return !Failed;
+		WriteAll(Buf.data(), Len);
+		Len = 0;
+		return !Failed;
+	}
+
+	// The buffered text, which is everything since the last Flush() or Clear()
+	const char* Data() const { return Buf.data(); }
+	size_t      Size() const { return Len; }
+	void        Clear() { Len = 0; }
+
+private:
+	int               FD;
+	std::vector<char> Buf;
+	size_t            Len    = 0;
+	bool              Failed = false;
+
+	void Reserve(size_t n) {
+		if (Buf.size() - Len < n) {
+			if (FD == -1)
+				Buf.resize(Buf.size() * 2 + n);
+			else
+				Flush();
+		}
+	}
+
+	void WriteAll(const char* p, size_t n) {
+		while (n != 0 && !Failed) {
+			ssize_t w = write(FD, p, n);
+			if (w < 0) {
+				Failed = errno != EINTR;
+				continue;
+			}
+			p += w;
+			n -= w;
+		}
+	}
+};
+
+enum class DetectionFormat {
+	Text,  // class: 0, confidence: 0.93, 98,87 - 244,520
+	CSV,   // frame,class,confidence,x1,y1,x2,y2
+	JSONL, // {"frame":0,"class":0,"confidence":0.93,"box":[98,87,244,520]}
+};
+
+// Returns false if the name is not recognized
+inline bool ParseDetectionFormat(const std::string& name, DetectionFormat& format) {
+	if (name == "text")
+		format = DetectionFormat::Text;
+	else if (name == "csv")
+		format = DetectionFormat::CSV;
+	else if (name == "jsonl")
+		format = DetectionFormat::JSONL;
+	else
+		return false;
+	return true;
+}
+
+// Writes the CSV header. Does nothing for the other formats.
+inline void WriteDetectionHeader(TextWriter& out, DetectionFormat format) {
+	if (format == DetectionFormat::CSV)
+		out.Str("frame,class,confidence,x1,y1,x2,y2\n");
+}
+
+// Writes one detection as a line of text, with the box in pixels of a width x height image
+inline void WriteDetection(TextWriter& out, DetectionFormat format, uint64_t frame, const Detection& d, int width, int height) {
+	int x1 = (int) (d.XMin * width + 0.5f);
+	int y1 = (int) (d.YMin * height + 0.5f);
+	int x2 = (int) (d.XMax * width + 0.5f);
+	int y2 = (int) (d.YMax * height + 0.5f);
+	switch (format) {
+	case DetectionFormat::Text:
+		out.Str("class: ").Int(d.ClassID).Str(", confidence: ").Float(d.Confidence, 2);
+		out.Str(", ").Int(x1).Char(',').Int(y1).Str(" - ").Int(x2).Char(',').Int(y2).Char('\n');
+		break;
+	case DetectionFormat::CSV:
+		out.Int(frame).Char(',').Int(d.ClassID).Char(',').Float(d.Confidence, 3);
+		out.Char(',').Int(x1).Char(',').Int(y1).Char(',').Int(x2).Char(',').Int(y2).Char('\n');
+		break;
+	case DetectionFormat::JSONL:
+		out.Str("{\"frame\":").Int(frame).Str(",\"class\":").Int(d.ClassID).Str(",\"confidence\":").Float(d.Confidence, 3);
+		out.Str(",\"box\":[").Int(x1).Char(',').Int(y1).Char(',').Int(x2).Char(',').Int(y2).Str("]}\n");
+		break;
+	}
+}
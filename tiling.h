@@ -0,0 +1,130 @@
+#pragma once
+
+// Tiled (sliced) inference, for frames that are much larger than the network input.
+//
+// Scaling a 4K frame down to 640x640 shrinks a person at 50 m to a few pixels, which the network
+// can't see. Instead, the frame is cut into overlapping tiles at (or near) the network's
+// resolution, all the tiles of a frame are run as one batch, and the detections of each tile are
+// mapped back to the frame, where the duplicates from overlapping tiles are merged.
+//
+//   std::vector<Tile> tiles = MakeTiles(3840, 2160, 640, 640, config);
+//   for each tile: conv.Convert(crop of the frame, inputBuffer[i], 640, 640) -> boxes[i]
+//   for each tile: ParseHailoNMS(...) and TileToFrame(tiles[i], boxes[i], 3840, 2160, ...)
+//   MergeTileDetections(dets, 0.5f);
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "nms.h"
+#include "yuv.h"
+
+// A region of the frame, in pixels. X and Y are even, so that a tile of a YUV 4:2:0 frame
+// starts on a chroma sample.
+struct Tile {
+	int X      = 0;
+	int Y      = 0;
+	int Width  = 0;
+	int Height = 0;
+};
+
+struct TileConfig {
+	int   Cols    = 0;     // Tiles across. 0 = as many as needed to cover the frame at the network's resolution.
+	int   Rows    = 0;     // Tiles down. 0 = as many as needed.
+	float Overlap = 0.2f;  // Minimum overlap of neighbouring tiles, as a fraction of the tile size
+	bool  Global  = false; // Add the whole frame as a final tile, to catch objects that are larger than a tile
+};
+
+// Lay out count tiles along one dimension of the frame, or if count is 0, as many tiles of minSize
+// as it takes to cover it. Returns the tile size.
+inline int LayoutTiles1D(int frameSize, int minSize, int count, float overlap, std::vector<int>& starts) {
+	minSize  = std::min(minSize, frameSize);
+	int size = minSize;
+	if (count <= 0) {
+		float step = std::max(1.0f, size * (1 - overlap));
+		count      = frameSize <= size ? 1 : 1 + (int) ceilf((frameSize - size) / step);
+	} else if (count == 1) {
+		size = frameSize;
+	} else {
+		// count tiles of this size cover the frame with exactly the requested overlap. They may be
+		// smaller than the network input, in which case they are scaled up, which helps with tiny objects.
+		size = std::min(frameSize, (int) ceilf(frameSize / (count - (count - 1) * overlap)));
+	}
+	starts.resize(count);
+	for (int i = 0; i < count; i++) {
+		// Spread evenly, so that the first tile starts at 0 and the last one ends at the edge
+		int start = count == 1 ? 0 : (int) ((int64_t) i * (frameSize - size) / (count - 1));
+		starts[i] = start & ~1;
+	}
+	return size;
+}
+
+// The tiles of a frame, row by row. Tiles that have a different aspect ratio than the network
+// input are letterboxed into it.
+inline std::vector<Tile> MakeTiles(int frameWidth, int frameHeight, int nnWidth, int nnHeight, const TileConfig& config) {
+	std::vector<int>  xs, ys;
+	int               width  = LayoutTiles1D(frameWidth, nnWidth, config.Cols, config.Overlap, xs);
+	int               height = LayoutTiles1D(frameHeight, nnHeight, config.Rows, config.Overlap, ys);
+	std::vector<Tile> tiles;
+	for (int y : ys) {
+		for (int x : xs)
+			tiles.push_back({x, y, width, height});
+	}
+	if (config.Global && tiles.size() > 1)
+		tiles.push_back({0, 0, frameWidth, frameHeight});
+	return tiles;
+}
+
+// Convert n detections from the network's coordinates for one tile (which was letterboxed into
+// the network input as box) to normalized coordinates in the whole frame.
+inline void TileToFrame(const Tile& tile, const Letterbox& box, int frameWidth, int frameHeight, Detection* dets, size_t n) {
+	float sx = (float) tile.Width / frameWidth;
+	float sy = (float) tile.Height / frameHeight;
+	float ox = (float) tile.X / frameWidth;
+	float oy = (float) tile.Y / frameHeight;
+	for (size_t i = 0; i < n; i++) {
+		Detection& d = dets[i];
+		d.XMin       = ox + sx * std::min(1.0f, std::max(0.0f, box.SourceX(d.XMin)));
+		d.XMax       = ox + sx * std::min(1.0f, std::max(0.0f, box.SourceX(d.XMax)));
+		d.YMin       = oy + sy * std::min(1.0f, std::max(0.0f, box.SourceY(d.YMin)));
+		d.YMax       = oy + sy * std::min(1.0f, std::max(0.0f, box.SourceY(d.YMax)));
+	}
+}
+
+// Intersection over the area of the smaller box. Unlike IoU, this is high when one tile saw the
+// whole object, and its neighbour only saw the part of it that was inside its border.
+inline float IntersectionOverSmaller(const Detection& a, const Detection& b) {
+	float w = std::min(a.XMax, b.XMax) - std::max(a.XMin, b.XMin);
+	float h = std::min(a.YMax, b.YMax) - std::max(a.YMin, b.YMin);
+	if (w <= 0 || h <= 0)
+		return 0;
+	float areaA = (a.XMax - a.XMin) * (a.YMax - a.YMin);
+	float areaB = (b.XMax - b.XMin) * (b.YMax - b.YMin);
+	return w * h / std::max(1e-12f, std::min(areaA, areaB));
+}
+
+// Merge the detections of overlapping tiles, in place. Going from the most confident box down,
+// every less confident box of the same class that overlaps it by more than minOverlap (see
+// IntersectionOverSmaller) is absorbed into it: the merged box is the union of the two, with the
+// higher confidence. The result is sorted by class, and then by confidence. Doesn't allocate.
+inline void MergeTileDetections(std::vector<Detection>& dets, float minOverlap) {
+	std::sort(dets.begin(), dets.end(), [](const Detection& a, const Detection& b) {
+		return a.ClassID != b.ClassID ? a.ClassID < b.ClassID : a.Confidence > b.Confidence;
+	});
+	for (size_t i = 0; i < dets.size(); i++) {
+		Detection& keep = dets[i];
+		if (keep.Confidence < 0)
+			continue;
+		for (size_t j = i + 1; j < dets.size() && dets[j].ClassID == keep.ClassID; j++) {
+			Detection& d = dets[j];
+			if (d.Confidence < 0 || IntersectionOverSmaller(keep, d) <= minOverlap)
+				continue;
+			keep.XMin    = std::min(keep.XMin, d.XMin);
+			keep.YMin    = std::min(keep.YMin, d.YMin);
+			keep.XMax    = std::max(keep.XMax, d.XMax);
+			keep.YMax    = std::max(keep.YMax, d.YMax);
+			d.Confidence = -1; // Absorbed
+		}
+	}
+	dets.erase(std::remove_if(dets.begin(), dets.end(), [](const Detection& d) { return d.Confidence < 0; }), dets.end());
+}
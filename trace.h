@@ -0,0 +1,134 @@
+#pragma once
+
+// Low overhead per-stage tracing, which can be written out as Chrome trace JSON.
+// Open the resulting file in https://ui.perfetto.dev or chrome://tracing.
+//
+//   Tracer::Enabled = true;
+//   {
+//       TRACE_SCOPE("stbi_load");
+//       img = stbi_load(...);
+//   }
+//   Tracer::WriteChromeJSON("trace.json");
+//
+// Every thread records into its own fixed-size ring buffer, so recording an event takes no locks
+// and does not allocate. When a ring buffer is full, the oldest events are overwritten.
+// The only lock is taken the first time a thread records an event, to register its buffer.
+// Event names must be string literals (or otherwise outlive the tracer).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Tracer {
+public:
+	struct Event {
+		const char* Name;
+		uint64_t    StartNs;
+		uint64_t    DurationNs;
+	};
+
+	static const uint32_t BufferSize = 16384; // Events per thread. Must be a power of 2.
+
+	struct ThreadBuffer {
+		int                   ThreadID;
+		std::atomic<uint64_t> Next{0}; // Total number of events ever recorded by this thread
+		Event                 Events[BufferSize];
+	};
+
+	// When false, recording does nothing except check this flag
+	static inline bool Enabled = false;
+
+	static uint64_t NowNs() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Record an event with an explicit start and end time, such as the time between submitting
+	// a job and its completion callback.
+	static void Record(const char* name, uint64_t startNs, uint64_t endNs) {
+		if (!Enabled)
+			return;
+		ThreadBuffer* b = ThisThread();
+		uint64_t      n = b->Next.load(std::memory_order_relaxed);
+		Event&        e = b->Events[n & (BufferSize - 1)];
+		e.Name          = name;
+		e.StartNs       = startNs;
+		e.DurationNs    = endNs > startNs ? endNs - startNs : 0;
+		b->Next.store(n + 1, std::memory_order_release);
+	}
+
+	// Write all recorded events as Chrome trace JSON.
+	// Call this when the traced threads are idle, otherwise you may see a few torn events.
+	static bool WriteChromeJSON(const std::string& filename) {
+		FILE* f = fopen(filename.c_str(), "w");
+		if (!f)
+			return false;
+		fprintf(f, "{\"traceEvents\":[\n");
+		bool                        first = true;
+		std::lock_guard<std::mutex> lock(RegistryLock());
+		for (const auto& b : Registry()) {
+			uint64_t end   = b->Next.load(std::memory_order_acquire);
+			uint64_t begin = end > BufferSize ? end - BufferSize : 0;
+			for (uint64_t i = begin; i < end; i++) {
+				const Event& e = b->Events[i & (BufferSize - 1)];
+				fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}", first ? "" : ",\n", e.Name, e.StartNs / 1000.0, e.DurationNs / 1000.0, b->ThreadID);
+				first = false;
+			}
+		}
+		fprintf(f, "\n]}\n");
+		return fclose(f) == 0;
+	}
+
+	// Discard all recorded events
+	static void Clear() {
+		std::lock_guard<std::mutex> lock(RegistryLock());
+		for (const auto& b : Registry())
+			b->Next.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	// Buffers are owned by the registry rather than by their threads, so that the events of
+	// threads which have exited (such as HailoRT's callback threads) can still be written out.
+	static std::vector<std::unique_ptr<ThreadBuffer>>& Registry() {
+		static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+		return registry;
+	}
+
+	static std::mutex& RegistryLock() {
+		static std::mutex lock;
+		return lock;
+	}
+
+	static ThreadBuffer* ThisThread() {
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer) {
+			std::lock_guard<std::mutex> lock(RegistryLock());
+			Registry().push_back(std::make_unique<ThreadBuffer>());
+			buffer           = Registry().back().get();
+			buffer->ThreadID = (int) Registry().size();
+		}
+		return buffer;
+	}
+};
+
+// Records the lifetime of this object as a trace event
+class TraceScope {
+public:
+	explicit TraceScope(const char* name) : Name(name), StartNs(Tracer::Enabled ? Tracer::NowNs() : 0) {}
+	~TraceScope() {
+		if (StartNs != 0)
+			Tracer::Record(Name, StartNs, Tracer::NowNs());
+	}
+
+private:
+	const char* Name;
+	uint64_t    StartNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
@@ -0,0 +1,591 @@
+#pragma once
+
+// Multi-object tracking on top of the NMS output, in the style of ByteTrack (Zhang et al, 2022).
+//
+// Every frame, the tracks are moved forward by a constant velocity Kalman filter, and matched to
+// the new detections by the IoU of the predicted box with each detection. The confident
+// detections are matched first. Then the tracks that are left are matched to the low confidence
+// detections, which are usually the same objects, partly occluded or blurred. A track that isn't
+// matched is kept for MaxLostFrames, so that it keeps its ID if the object comes back.
+//
+//   ByteTracker tracker;
+//   for each frame:
+//       ParseHailoNMS(..., tracker.LowThreshold, dets);
+//       for (const Track& t : tracker.Update(dets))
+//           printf("%u: %f,%f\n", t.ID, t.XMin, t.YMin);
+//
+// The cost is kept low enough for hundreds of objects per frame on one core:
+//   - The Kalman filters of all tracks are stored as a structure of arrays, and predicted in one
+//     loop, which the compiler vectorizes. See KalmanBoxes.
+//   - The cost matrix is computed one row at a time, over arrays of detection coordinates, which
+//     also vectorizes.
+//   - Most tracks can only match one or two detections. The assignment problem is split into the
+//     independent groups of tracks and detections that overlap each other, and only those groups
+//     are solved, each with a small dense solver. See AssignmentSolver.
+
+#include <stdint.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "nms.h"
+
+// Constant velocity Kalman filters for a batch of boxes, one per track. The state of each filter
+// is the center, width and height of the box, and the velocity of each of them.
+//
+// With the noise model of ByteTrack (standard deviations proportional to the size of the box, and
+// independent for each coordinate), each coordinate and its velocity are independent of the
+// others, so the 8x8 covariance matrix is made of four symmetric 2x2 blocks. We store just those
+// 12 numbers, and an update is four scalar Kalman updates, without any matrix inversion. The
+// result is the same as with the full matrices.
+class KalmanBoxes {
+public:
+	float StdPosition = 1.0f / 20;  // Of the position, relative to the size of the box
+	float StdVelocity = 1.0f / 160; // Of the velocity, per frame
+
+	size_t Size() const { return Pos[0].size(); }
+
+	// Start a filter at this box (center x, center y, width, height), standing still. Returns its index.
+	size_t Add(const float z[4]) {
+		for (int k = 0; k < 4; k++) {
+			float s = Scale(z, k);
+			Pos[k].push_back(z[k]);
+			Vel[k].push_back(0);
+			Cpp[k].push_back(Square(2 * StdPosition * s));
+			Cpv[k].push_back(0);
+			Cvv[k].push_back(Square(10 * StdVelocity * s));
+		}
+		return Size() - 1;
+	}
+
+	// Move every filter forward by one frame
+	void Predict() {
+		size_t n   = Size();
+		float  sp2 = StdPosition * StdPosition;
+		float  sv2 = StdVelocity * StdVelocity;
+		for (int k = 0; k < 4; k++) {
+			// The noise of x and width is proportional to the width, and of y and height to the height
+			const float* s   = Pos[k & 1 ? 3 : 2].data();
+			float*       p   = Pos[k].data();
+			float*       v   = Vel[k].data();
+			float*       cpp = Cpp[k].data();
+			float*       cpv = Cpv[k].data();
+			float*       cvv = Cvv[k].data();
+			for (size_t i = 0; i < n; i++) {
+				float s2 = s[i] * s[i];
+				p[i] += v[i];
+				cpp[i] += 2 * cpv[i] + cvv[i] + sp2 * s2;
+				cpv[i] += cvv[i];
+				cvv[i] += sv2 * s2;
+			}
+		}
+	}
+
+	// Correct filter i with a measured box
+	void Update(size_t i, const float z[4]) {
+		float box[4];
+		Get(i, box);
+		for (int k = 0; k < 4; k++) {
+			float r  = Square(StdPosition * Scale(box, k));
+			float s  = Cpp[k][i] + r;
+			float kp = Cpp[k][i] / s;
+			float kv = Cpv[k][i] / s;
+			float y  = z[k] - Pos[k][i];
+			Pos[k][i] += kp * y;
+			Vel[k][i] += kv * y;
+			Cvv[k][i] -= kv * Cpv[k][i];
+			Cpv[k][i] *= 1 - kp;
+			Cpp[k][i] *= 1 - kp;
+		}
+	}
+
+	// Center x, center y, width, height
+	void Get(size_t i, float z[4]) const {
+		for (int k = 0; k < 4; k++)
+			z[k] = Pos[k][i];
+	}
+
+	// Velocity of the center x and y, per frame
+	float VelocityX(size_t i) const { return Vel[0][i]; }
+	float VelocityY(size_t i) const { return Vel[1][i]; }
+
+	// Stop the growth or shrinking of the box, eg while its object is out of sight
+	void StopResizing(size_t i) {
+		Vel[2][i] = 0;
+		Vel[3][i] = 0;
+	}
+
+	// Remove the filters where keep is false, keeping the order of the rest
+	void Compact(const std::vector<char>& keep) {
+		for (std::vector<float>* a : {Pos, Vel, Cpp, Cpv, Cvv}) {
+			for (int k = 0; k < 4; k++) {
+				size_t j = 0;
+				for (size_t i = 0; i < a[k].size(); i++) {
+					if (keep[i])
+						a[k][j++] = a[k][i];
+				}
+				a[k].resize(j);
+			}
+		}
+	}
+
+	void Clear() {
+		for (std::vector<float>* a : {Pos, Vel, Cpp, Cpv, Cvv}) {
+			for (int k = 0; k < 4; k++)
+				a[k].clear();
+		}
+	}
+
+private:
+	// Per coordinate (center x, center y, width, height): position, velocity, and the 2x2 covariance
+	std::vector<float> Pos[4];
+	std::vector<float> Vel[4];
+	std::vector<float> Cpp[4];
+	std::vector<float> Cpv[4];
+	std::vector<float> Cvv[4];
+
+	static float Square(float x) { return x * x; }
+	static float Scale(const float z[4], int k) { return k & 1 ? z[3] : z[2]; }
+};
+
+// Boxes as a structure of arrays, so that the IoU of one box with all of them vectorizes
+struct BoxArrays {
+	std::vector<float> X1, Y1, X2, Y2, Area, Score;
+	std::vector<int>   Class;
+
+	size_t Size() const { return X1.size(); }
+
+	void Clear() {
+		for (auto* a : {&X1, &Y1, &X2, &Y2, &Area, &Score})
+			a->clear();
+		Class.clear();
+	}
+
+	void Add(float x1, float y1, float x2, float y2, float score, int classID) {
+		X1.push_back(x1);
+		Y1.push_back(y1);
+		X2.push_back(x2);
+		Y2.push_back(y2);
+		Area.push_back((x2 - x1) * (y2 - y1));
+		Score.push_back(score);
+		Class.push_back(classID);
+	}
+};
+
+// One row of a cost matrix: 1 - IoU of box i of a with every box of b, or with fuseScore,
+// 1 - IoU x the score of the box in b. Boxes of a different class cost 2 more, which is more
+// than any real match.
+inline void IoUCostRow(const BoxArrays& a, size_t i, const BoxArrays& b, bool fuseScore, float* cost) {
+	float        ax1 = a.X1[i], ay1 = a.Y1[i], ax2 = a.X2[i], ay2 = a.Y2[i], aArea = a.Area[i];
+	int          aClass = a.Class[i];
+	float        fuse   = fuseScore ? 1.0f : 0.0f; // Without a branch in the loop, so that it vectorizes
+	const float *bx1 = b.X1.data(), *by1 = b.Y1.data(), *bx2 = b.X2.data(), *by2 = b.Y2.data();
+	const float *bArea = b.Area.data(), *bScore = b.Score.data();
+	const int*   bClass = b.Class.data();
+	size_t       n      = b.Size();
+	for (size_t j = 0; j < n; j++) {
+		float w     = std::max(0.0f, std::min(ax2, bx2[j]) - std::max(ax1, bx1[j]));
+		float h     = std::max(0.0f, std::min(ay2, by2[j]) - std::max(ay1, by1[j]));
+		float inter = w * h;
+		float iou   = inter / (aArea + bArea[j] - inter + 1e-9f);
+		float c     = 1 - iou * (1 + fuse * (bScore[j] - 1));
+		cost[j]     = c + 2.0f * (float) (aClass != bClass[j]);
+	}
+}
+
+// Solves the linear assignment problem with a cost limit: match rows to columns so that the
+// sum of the costs of the matches is minimal, where a pair can only match if its cost is below
+// maxCost, and leaving a row or column unmatched costs maxCost / 2 (which is what lap.lapjv
+// does with cost_limit, as used by ByteTrack).
+//
+// Pairs at or above maxCost can never match, so rows and columns fall apart into groups that
+// have no cheap pairs between them, and each group can be solved on its own. For tracking, most
+// groups are a single track and a single detection. The rest are solved with shortest
+// augmenting paths (the augmentation step of Jonker-Volgenant), on a small dense matrix.
+class AssignmentSolver {
+public:
+	// cost is rows x cols, row by row. On return, rowMatch[i] is the column of row i, and
+	// colMatch[j] is the row of column j, or -1 if they are unmatched.
+	void Solve(const float* cost, int rows, int cols, float maxCost, std::vector<int>& rowMatch, std::vector<int>& colMatch) {
+		rowMatch.assign(rows, -1);
+		colMatch.assign(cols, -1);
+
+		// Group rows and columns by union-find. Columns are numbered after the rows.
+		Parent.resize(rows + cols);
+		std::iota(Parent.begin(), Parent.end(), 0);
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				if (cost[(size_t) i * cols + j] < maxCost)
+					Union(i, rows + j);
+			}
+		}
+
+		// List the members of each group, in order, by counting sort on the root of the group
+		int n = rows + cols;
+		Start.assign(n + 1, 0);
+		for (int i = 0; i < n; i++) {
+			Parent[i] = Find(i);
+			Start[Parent[i] + 1]++;
+		}
+		for (int i = 0; i < n; i++)
+			Start[i + 1] += Start[i];
+		Order.resize(n);
+		for (int i = 0; i < n; i++)
+			Order[Start[Parent[i]]++] = i;
+
+		for (size_t g = 0; g < Order.size();) {
+			size_t end = g;
+			GroupRows.clear();
+			GroupCols.clear();
+			for (; end < Order.size() && Parent[Order[end]] == Parent[Order[g]]; end++) {
+				if (Order[end] < rows)
+					GroupRows.push_back(Order[end]);
+				else
+					GroupCols.push_back(Order[end] - rows);
+			}
+			g = end;
+			if (GroupRows.empty() || GroupCols.empty())
+				continue;
+			if (GroupRows.size() == 1 || GroupCols.size() == 1) {
+				// The cheapest pair is the answer
+				int   bestRow = -1, bestCol = -1;
+				float best    = maxCost;
+				for (int r : GroupRows) {
+					for (int c : GroupCols) {
+						if (cost[(size_t) r * cols + c] < best) {
+							best    = cost[(size_t) r * cols + c];
+							bestRow = r;
+							bestCol = c;
+						}
+					}
+				}
+				rowMatch[bestRow] = bestCol;
+				colMatch[bestCol] = bestRow;
+				continue;
+			}
+			SolveGroup(cost, cols, maxCost, rowMatch, colMatch);
+		}
+	}
+
+private:
+	std::vector<int>    Parent;
+	std::vector<int>    Order;
+	std::vector<int>    Start;
+	std::vector<int>    GroupRows;
+	std::vector<int>    GroupCols;
+	std::vector<double> Dense, U, V, MinV;
+	std::vector<int>    P, Way;
+	std::vector<char>   Used;
+
+	int Find(int x) {
+		while (Parent[x] != x) {
+			Parent[x] = Parent[Parent[x]];
+			x         = Parent[x];
+		}
+		return x;
+	}
+
+	void Union(int a, int b) {
+		a = Find(a);
+		b = Find(b);
+		if (a != b)
+			Parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	// Solve one group. Every row gets a column of its own where it can stay unmatched, at no cost,
+	// and a real match costs cost - maxCost, which is below zero. Minimizing that is the same as
+	// minimizing the sum of the matches plus maxCost / 2 for every unmatched row and column.
+	void SolveGroup(const float* cost, int cols, float maxCost, std::vector<int>& rowMatch, std::vector<int>& colMatch) {
+		const double inf = 1e18;
+		int          n   = (int) GroupRows.size();
+		int          m   = (int) GroupCols.size() + n;
+		Dense.assign((size_t) n * m, 0);
+		for (int r = 0; r < n; r++) {
+			for (int c = 0; c < (int) GroupCols.size(); c++) {
+				float x                   = cost[(size_t) GroupRows[r] * cols + GroupCols[c]];
+				Dense[(size_t) r * m + c] = x < maxCost ? x - maxCost : inf;
+			}
+		}
+
+		// Shortest augmenting paths with potentials, 1-based, with column 0 as the root
+		U.assign(n + 1, 0);
+		V.assign(m + 1, 0);
+		P.assign(m + 1, 0);
+		Way.assign(m + 1, 0);
+		for (int i = 1; i <= n; i++) {
+			P[0]    = i;
+			int j0  = 0;
+			MinV.assign(m + 1, inf);
+			Used.assign(m + 1, 0);
+			do {
+				Used[j0]     = 1;
+				int    i0    = P[j0];
+				double delta = inf;
+				int    j1    = 0;
+				for (int j = 1; j <= m; j++) {
+					if (Used[j])
+						continue;
+					double cur = Dense[(size_t) (i0 - 1) * m + (j - 1)] - U[i0] - V[j];
+					if (cur < MinV[j]) {
+						MinV[j] = cur;
+						Way[j]  = j0;
+					}
+					if (MinV[j] < delta) {
+						delta = MinV[j];
+						j1    = j;
+					}
+				}
+				for (int j = 0; j <= m; j++) {
+					if (Used[j]) {
+						U[P[j]] += delta;
+						V[j] -= delta;
+					} else {
+						MinV[j] -= delta;
+					}
+				}
+				j0 = j1;
+			} while (P[j0] != 0);
+			do {
+				int j1 = Way[j0];
+				P[j0]  = P[j1];
+				j0     = j1;
+			} while (j0 != 0);
+		}
+
+		for (int j = 1; j <= (int) GroupCols.size(); j++) {
+			if (P[j] == 0)
+				continue;
+			int r = GroupRows[P[j] - 1];
+			int c = GroupCols[j - 1];
+			if (cost[(size_t) r * cols + c] < maxCost) {
+				rowMatch[r] = c;
+				colMatch[c] = r;
+			}
+		}
+	}
+};
+
+enum class TrackState {
+	Tracked, // Matched to a detection in this frame
+	Lost,    // Not matched in the last few frames, but may come back
+};
+
+struct Track {
+	uint32_t   ID         = 0;
+	int        ClassID    = 0;
+	float      Confidence = 0; // Of the last detection that matched
+	float      XMin       = 0; // Normalized, like Detection. The Kalman filter's estimate, not the raw detection.
+	float      YMin       = 0;
+	float      XMax       = 0;
+	float      YMax       = 0;
+	float      VelocityX  = 0; // Of the center, in normalized units per frame
+	float      VelocityY  = 0;
+	TrackState State      = TrackState::Tracked;
+	bool       Confirmed  = false; // False until it has been matched in two frames in a row (except in the first frame)
+	uint64_t   StartFrame = 0;
+	uint64_t   LastFrame  = 0; // When it was last matched
+};
+
+class ByteTracker {
+public:
+	float HighThreshold        = 0.5f;  // Detections at least this confident are matched first
+	float LowThreshold         = 0.1f;  // Detections below this are ignored
+	float NewTrackThreshold    = 0.6f;  // An unmatched detection must be at least this confident to start a track
+	float MatchCost            = 0.8f;  // Maximum 1 - IoU x confidence, to match a confident detection
+	float LowMatchCost         = 0.5f;  // Maximum 1 - IoU, to match a low confidence detection
+	float UnconfirmedMatchCost = 0.7f;  // Maximum 1 - IoU x confidence, to confirm a new track
+	int   MaxLostFrames        = 30;    // How long to keep a track that isn't matched
+	bool  MatchClass           = true;  // Only match tracks and detections of the same class
+
+	// Feed the detections of the next frame, and get the confirmed tracks that were matched in this
+	// frame. The result is valid until the next call.
+	const std::vector<Track>& Update(const std::vector<Detection>& dets) {
+		FrameID++;
+		Kalman.Predict();
+		for (size_t i = 0; i < All.size(); i++) {
+			if (All[i].State != TrackState::Tracked)
+				Kalman.StopResizing(i);
+		}
+		UpdateTrackBoxes();
+
+		High.clear();
+		Low.clear();
+		for (size_t i = 0; i < dets.size(); i++) {
+			if (dets[i].Confidence >= HighThreshold)
+				High.push_back((int) i);
+			else if (dets[i].Confidence >= LowThreshold)
+				Low.push_back((int) i);
+		}
+
+		// 1. Confirmed tracks, including lost ones, with the confident detections
+		Pool.clear();
+		Unconfirmed.clear();
+		for (size_t i = 0; i < All.size(); i++) {
+			if (All[i].Confirmed)
+				Pool.push_back((int) i);
+			else
+				Unconfirmed.push_back((int) i);
+		}
+		Match(Pool, High, dets, true, MatchCost);
+
+		// 2. The tracks that were visible in the last frame, and are still unmatched, with the low
+		// confidence detections. If they don't match those either, they are lost.
+		Pool.erase(std::remove_if(Pool.begin(), Pool.end(), [&](int t) { return All[t].State != TrackState::Tracked || All[t].LastFrame == FrameID; }), Pool.end());
+		Match(Pool, Low, dets, false, LowMatchCost);
+		for (int t : Pool) {
+			if (All[t].LastFrame != FrameID)
+				All[t].State = TrackState::Lost;
+		}
+
+		// 3. New tracks from the last frame, with the confident detections that are left. New tracks
+		// that don't match are dropped.
+		Match(Unconfirmed, High, dets, true, UnconfirmedMatchCost);
+		Keep.assign(All.size(), 1);
+		for (int t : Unconfirmed) {
+			if (All[t].LastFrame == FrameID)
+				All[t].Confirmed = true;
+			else
+				Keep[t] = 0;
+		}
+		for (size_t i = 0; i < All.size(); i++) {
+			if (All[i].State == TrackState::Lost && FrameID - All[i].LastFrame > (uint64_t) MaxLostFrames)
+				Keep[i] = 0;
+		}
+		Compact();
+
+		// 4. Start new tracks from the confident detections that are still unmatched
+		for (int d : High) {
+			const Detection& det = dets[d];
+			if (det.Confidence < NewTrackThreshold)
+				continue;
+			float z[4] = {(det.XMin + det.XMax) / 2, (det.YMin + det.YMax) / 2, det.XMax - det.XMin, det.YMax - det.YMin};
+			Kalman.Add(z);
+			Track t;
+			t.ID         = ++LastID;
+			t.ClassID    = det.ClassID;
+			t.Confidence = det.Confidence;
+			t.Confirmed  = FrameID == 1;
+			t.StartFrame = FrameID;
+			t.LastFrame  = FrameID;
+			All.push_back(t);
+		}
+
+		Output.clear();
+		for (size_t i = 0; i < All.size(); i++) {
+			SetBox(i);
+			if (All[i].Confirmed && All[i].State == TrackState::Tracked)
+				Output.push_back(All[i]);
+		}
+		return Output;
+	}
+
+	// Move the tracks forward by one frame without any detections, eg for a frame that didn't go
+	// through the network. Returns the confirmed tracks, where they are predicted to be.
+	const std::vector<Track>& Predict() {
+		FrameID++;
+		Kalman.Predict();
+		Output.clear();
+		for (size_t i = 0; i < All.size(); i++) {
+			if (All[i].State != TrackState::Tracked)
+				Kalman.StopResizing(i);
+			SetBox(i);
+			if (All[i].Confirmed && All[i].State == TrackState::Tracked)
+				Output.push_back(All[i]);
+		}
+		return Output;
+	}
+
+	// Every track, including the lost and unconfirmed ones
+	const std::vector<Track>& Tracks() const { return All; }
+
+	uint32_t NumCreated() const { return LastID; }
+
+	void Reset() {
+		All.clear();
+		Kalman.Clear();
+		FrameID = 0;
+		LastID  = 0;
+	}
+
+private:
+	std::vector<Track> All; // Parallel to the filters in Kalman
+	KalmanBoxes        Kalman;
+	AssignmentSolver   Solver;
+	uint64_t           FrameID = 0;
+	uint32_t           LastID  = 0;
+	std::vector<Track> Output;
+
+	// Scratch space, which is kept to avoid allocations
+	std::vector<int>   High, Low, Pool, Unconfirmed;
+	std::vector<char>  Keep;
+	BoxArrays          TrackBoxes, DetBoxes;
+	std::vector<float> Cost;
+	std::vector<int>   RowMatch, ColMatch;
+
+	// The box of every track, as predicted for this frame
+	void UpdateTrackBoxes() {
+		TrackBoxes.Clear();
+		for (size_t i = 0; i < All.size(); i++) {
+			float z[4];
+			Kalman.Get(i, z);
+			TrackBoxes.Add(z[0] - z[2] / 2, z[1] - z[3] / 2, z[0] + z[2] / 2, z[1] + z[3] / 2, All[i].Confidence, MatchClass ? All[i].ClassID : 0);
+		}
+	}
+
+	void SetBox(size_t i) {
+		float z[4];
+		Kalman.Get(i, z);
+		Track& t    = All[i];
+		t.XMin      = z[0] - z[2] / 2;
+		t.YMin      = z[1] - z[3] / 2;
+		t.XMax      = z[0] + z[2] / 2;
+		t.YMax      = z[1] + z[3] / 2;
+		t.VelocityX = Kalman.VelocityX(i);
+		t.VelocityY = Kalman.VelocityY(i);
+	}
+
+	// Match the tracks in pool to the detections in detIdx, and update the tracks that matched.
+	// Removes the matched detections from detIdx.
+	void Match(const std::vector<int>& pool, std::vector<int>& detIdx, const std::vector<Detection>& dets, bool fuseScore, float maxCost) {
+		if (pool.empty() || detIdx.empty())
+			return;
+		DetBoxes.Clear();
+		for (int d : detIdx) {
+			const Detection& det = dets[d];
+			DetBoxes.Add(det.XMin, det.YMin, det.XMax, det.YMax, det.Confidence, MatchClass ? det.ClassID : 0);
+		}
+		size_t cols = detIdx.size();
+		Cost.resize(pool.size() * cols);
+		for (size_t r = 0; r < pool.size(); r++)
+			IoUCostRow(TrackBoxes, pool[r], DetBoxes, fuseScore, &Cost[r * cols]);
+		Solver.Solve(Cost.data(), (int) pool.size(), (int) cols, maxCost, RowMatch, ColMatch);
+		for (size_t r = 0; r < pool.size(); r++) {
+			if (RowMatch[r] < 0)
+				continue;
+			const Detection& det  = dets[detIdx[RowMatch[r]]];
+			float            z[4] = {(det.XMin + det.XMax) / 2, (det.YMin + det.YMax) / 2, det.XMax - det.XMin, det.YMax - det.YMin};
+			Track&           t    = All[pool[r]];
+			Kalman.Update(pool[r], z);
+			t.Confidence = det.Confidence;
+			t.State      = TrackState::Tracked;
+			t.LastFrame  = FrameID;
+		}
+		size_t j = 0;
+		for (size_t c = 0; c < cols; c++) {
+			if (ColMatch[c] < 0)
+				detIdx[j++] = detIdx[c];
+		}
+		detIdx.resize(j);
+	}
+
+	// Remove the tracks where Keep is false
+	void Compact() {
+		Kalman.Compact(Keep);
+		size_t j = 0;
+		for (size_t i = 0; i < All.size(); i++) {
+			if (Keep[i])
+				All[j++] = All[i];
+		}
+		All.resize(j);
+	}
+};
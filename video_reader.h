@@ -0,0 +1,306 @@
+#pragma once
+
+// Reads recorded video one frame at a time, for offline processing of archived footage.
+//
+// Two container formats are supported, both of which are trivial to split into frames:
+//
+//   MJPEG  A sequence of JPEG images, as written by eg 'ffmpeg -i in.mp4 -c:v mjpeg -f mjpeg out.mjpeg',
+//          or by saving an HTTP multipart MJPEG stream to a file. Anything between the images,
+//          such as multipart boundaries, is skipped.
+//   Y4M    Raw YUV 4:2:0 frames with a small text header ('ffmpeg -i in.mp4 -pix_fmt yuv420p out.y4m').
+//
+// The file is memory-mapped, and Next() returns a pointer to the frame inside the mapping, so
+// nothing is copied until the frame is decoded. The kernel is told that we read sequentially,
+// and the pages ahead of the current frame are requested before we get to them, so that decode
+// doesn't stall on disk reads. Pages well behind the current frame are dropped from our mapping,
+// so that memory use stays flat for files of any size. That is only a hint: a frame that is
+// still in use stays valid, and its pages are faulted back in from the page cache if needed.
+//
+//   VideoReader video;
+//   if (!video.Open("cam1.mjpeg")) ...
+//   VideoFrame frame;
+//   while (video.Next(frame))
+//       stbi_load_from_memory(frame.Data, (int) frame.Size, ...);
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+
+enum class VideoFormat {
+	Unknown,
+	MJPEG, // Each frame is a complete JPEG file
+	Y4M,   // Each frame is planar YUV 4:2:0 (I420): Width x Height of Y, then two half-resolution planes U and V
+};
+
+// A frame inside the mapped file. Valid until the VideoReader is closed.
+struct VideoFrame {
+	const uint8_t* Data   = nullptr;
+	size_t         Size   = 0;
+	uint64_t       Index  = 0; // Frame number in the file, starting at 0
+	uint64_t       Offset = 0; // Byte offset of Data in the file
+};
+
+class VideoReader {
+public:
+	size_t ReadAheadBytes = 16 << 20; // How far ahead of the current frame to prefetch
+
+	// Only known up front for Y4M. For MJPEG, the size of each frame is in its JPEG header.
+	int    Width     = 0;
+	int    Height    = 0;
+	double FrameRate = 0;     // Frames per second, or 0 if the file doesn't say
+	bool   FullRange = false; // Y4M only. True if the YUV values use the full 0..255 range, instead of 16..235.
+
+	size_t SkippedBytes = 0; // MJPEG only. Bytes between frames that were not part of any JPEG.
+
+	~VideoReader() {
+		Close();
+	}
+
+	bool Open(const std::string& filename) {
+		Close();
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < 4) {
+			close(fd);
+			return false;
+		}
+		Size = (size_t) st.st_size;
+		Data = (const uint8_t*) mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (Data == MAP_FAILED) {
+			Data = nullptr;
+			return false;
+		}
+		madvise((void*) Data, Size, MADV_SEQUENTIAL);
+
+		if (Size >= 10 && memcmp(Data, "YUV4MPEG2 ", 10) == 0) {
+			Format = VideoFormat::Y4M;
+			if (!ParseY4MHeader()) {
+				Close();
+				return false;
+			}
+		} else if (Data[0] == 0xFF && Data[1] == 0xD8) {
+			Format = VideoFormat::MJPEG;
+		} else {
+			Close();
+			return false;
+		}
+		Rewind();
+		return true;
+	}
+
+	void Close() {
+		if (Data)
+			munmap((void*) Data, Size);
+		Data         = nullptr;
+		Size         = 0;
+		Pos          = 0;
+		Start        = 0;
+		Format       = VideoFormat::Unknown;
+		Width        = 0;
+		Height       = 0;
+		FrameRate    = 0;
+		FullRange    = false;
+		Y4MFrameSize = 0;
+		SkippedBytes = 0;
+	}
+
+	// Go back to the first frame
+	void Rewind() {
+		Pos            = Start;
+		NextIndex      = 0;
+		PrefetchedUpTo = Start;
+		DroppedUpTo    = 0;
+		Prefetch();
+	}
+
+	// Get the next frame. Returns false at the end of the file, or if the rest of the file is
+	// not a complete frame.
+	bool Next(VideoFrame& frame) {
+		const uint8_t* p   = nullptr;
+		size_t         len = 0;
+		if (Format == VideoFormat::Y4M ? !NextY4M(p, len) : !NextMJPEG(p, len))
+			return false;
+		frame.Data   = p;
+		frame.Size   = len;
+		frame.Index  = NextIndex++;
+		frame.Offset = (uint64_t) (p - Data);
+		Prefetch();
+		return true;
+	}
+
+	VideoFormat GetFormat() const { return Format; }
+	size_t      FileSize() const { return Size; }
+	size_t      Position() const { return Pos; }
+
+private:
+	const uint8_t* Data           = nullptr;
+	size_t         Size           = 0;
+	size_t         Pos            = 0; // Start of the next frame (or of the junk before it)
+	size_t         Start          = 0; // Start of the first frame
+	uint64_t       NextIndex      = 0;
+	size_t         PrefetchedUpTo = 0;
+	size_t         DroppedUpTo    = 0;
+	VideoFormat    Format         = VideoFormat::Unknown;
+	size_t         Y4MFrameSize   = 0;
+
+	// Ask for the pages ahead of us in big chunks, rather than one page fault at a time, and give
+	// back the pages that are far behind us.
+	void Prefetch() {
+		const size_t page = 4096;
+		if (PrefetchedUpTo < Size && PrefetchedUpTo < Pos + ReadAheadBytes / 2) {
+			size_t from    = PrefetchedUpTo & ~(page - 1);
+			PrefetchedUpTo = std::min(Size, Pos + ReadAheadBytes);
+			madvise((void*) (Data + from), PrefetchedUpTo - from, MADV_WILLNEED);
+		}
+		if (Pos > DroppedUpTo + 2 * ReadAheadBytes) {
+			size_t to = (Pos - ReadAheadBytes) & ~(page - 1);
+			madvise((void*) (Data + DroppedUpTo), to - DroppedUpTo, MADV_DONTNEED);
+			DroppedUpTo = to;
+		}
+	}
+
+	// eg "YUV4MPEG2 W640 H480 F30000:1001 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n"
+	bool ParseY4MHeader() {
+		const uint8_t* eol = (const uint8_t*) memchr(Data, '\n', std::min(Size, (size_t) 1024));
+		if (!eol)
+			return false;
+		std::string header((const char*) Data + 10, eol - Data - 10);
+		std::string colorspace = "420jpeg";
+		for (size_t i = 0; i < header.size();) {
+			size_t      end   = header.find(' ', i);
+			std::string param = header.substr(i, end == std::string::npos ? std::string::npos : end - i);
+			i                 = end == std::string::npos ? header.size() : end + 1;
+			if (param.empty())
+				continue;
+			const char* v = param.c_str() + 1;
+			switch (param[0]) {
+			case 'W': Width = atoi(v); break;
+			case 'H': Height = atoi(v); break;
+			case 'C': colorspace = v; break;
+			case 'F': {
+				int num = 0, den = 0;
+				if (sscanf(v, "%d:%d", &num, &den) == 2 && den > 0)
+					FrameRate = (double) num / den;
+				break;
+			}
+			case 'X':
+				if (param == "XCOLORRANGE=FULL")
+					FullRange = true;
+				break;
+			}
+		}
+		// 420jpeg, 420paldv and 420mpeg2 only differ in where the chroma samples are sited,
+		// which we ignore. We don't support 4:2:2, 4:4:4, or more than 8 bits per sample.
+		bool is420 = colorspace == "420" || colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2";
+		if (Width <= 0 || Height <= 0 || !is420)
+			return false;
+		Y4MFrameSize = (size_t) Width * Height + 2 * (size_t) ((Width + 1) / 2) * ((Height + 1) / 2);
+		Start        = eol + 1 - Data;
+		return true;
+	}
+
+	// Each frame is "FRAME", optional parameters, a newline, and then the raw planes
+	bool NextY4M(const uint8_t*& p, size_t& len) {
+		if (Pos + 6 > Size || memcmp(Data + Pos, "FRAME", 5) != 0)
+			return false;
+		const uint8_t* eol = (const uint8_t*) memchr(Data + Pos + 5, '\n', std::min(Size - Pos - 5, (size_t) 256));
+		if (!eol || Y4MFrameSize > Size - (eol + 1 - Data))
+			return false;
+		p   = eol + 1;
+		len = Y4MFrameSize;
+		Pos = p + len - Data;
+		return true;
+	}
+
+	bool NextMJPEG(const uint8_t*& p, size_t& len) {
+		// Skip anything that isn't the start of a JPEG: SOI followed by another marker
+		static const uint8_t soi[3] = {0xFF, 0xD8, 0xFF};
+		const uint8_t*       start  = (const uint8_t*) memmem(Data + Pos, Size - Pos, soi, 3);
+		if (!start) {
+			SkippedBytes += Size - Pos;
+			Pos = Size;
+			return false;
+		}
+		SkippedBytes += start - (Data + Pos);
+		size_t scanned = 0;
+		size_t end     = JPEGEnd(start - Data, scanned);
+		if (end == 0) {
+			// No EOI. If there is another JPEG after this one, this one is corrupt, but we
+			// return it anyway, and let the decoder decide what to do with it. The search starts
+			// where the marker walk stopped, so that it doesn't find an embedded thumbnail.
+			const uint8_t* next = (const uint8_t*) memmem(Data + scanned, Size - scanned, soi, 3);
+			if (!next) {
+				SkippedBytes += Data + Size - start;
+				Pos = Size;
+				return false;
+			}
+			end = next - Data;
+		}
+		p   = start;
+		len = Data + end - start;
+		Pos = end;
+		return true;
+	}
+
+	// Walk the JPEG markers from SOI to EOI, and return the offset just past EOI, or 0 if the
+	// JPEG is truncated or corrupt, in which case scanned is how far we got. We can't just
+	// search for FF D9, because it may appear inside an embedded thumbnail (eg in an EXIF APP1
+	// segment).
+	size_t JPEGEnd(size_t pos, size_t& scanned) const {
+		pos += 2;
+		scanned = Size;
+		while (pos + 2 <= Size) {
+			if (Data[pos] != 0xFF) {
+				scanned = pos;
+				return 0;
+			}
+			uint8_t marker = Data[pos + 1];
+			if (marker == 0xFF) { // Fill byte
+				pos++;
+				continue;
+			}
+			if (marker == 0xD9) // EOI
+				return pos + 2;
+			if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) { // Markers without a length
+				pos += 2;
+				continue;
+			}
+			if (pos + 4 > Size) // Truncated segment length
+				return 0;
+			size_t segLen = ((size_t) Data[pos + 2] << 8) | Data[pos + 3];
+			if (segLen < 2) {
+				scanned = pos + 2;
+				return 0;
+			}
+			pos += 2 + segLen;
+			if (marker != 0xDA) // SOS is followed by entropy-coded data
+				continue;
+			// In the entropy-coded data, FF is always followed by 00 (a stuffed FF byte), or a
+			// restart marker. Anything else is the next marker.
+			while (pos < Size) {
+				const uint8_t* ff = (const uint8_t*) memchr(Data + pos, 0xFF, Size - pos);
+				if (!ff || ff + 1 >= Data + Size)
+					return 0;
+				uint8_t next = ff[1];
+				pos          = ff - Data;
+				if (next == 0x00 || (next >= 0xD0 && next <= 0xD7))
+					pos += 2;
+				else if (next == 0xFF)
+					pos += 1;
+				else
+					break;
+			}
+		}
+		return 0;
+	}
+};
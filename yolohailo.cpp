@@ -0,0 +1,306 @@
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "yolohailo.h"
+#include "nms.h"
+#include "advanced/allocator.h"
+#include "advanced/backend.h"
+#include "advanced/sim_backend.h"
+
+#ifndef NO_HAILORT
+#include "advanced/hailo_backend.h"
+#endif
+
+// The implementation of libyolohailo (see yolohailo.h), on top of InferBackend.
+//
+// Each submitted frame takes a Slot, which owns the output buffers that the device writes into.
+// When the frame completes, its slot goes on the Completed queue, and yh_poll() parses the NMS
+// output straight from the slot into the caller's array, and returns the slot to the free list.
+// So the NMS parsing happens on the caller's thread, and the HailoRT callback thread only does
+// bookkeeping.
+
+// Build with 'make lib', or:
+// g++ -O2 -fPIC -fvisibility=hidden -shared -o libyolohailo.so yolohailo.cpp -lhailort
+
+static_assert(sizeof(yh_detection) == sizeof(Detection), "yh_detection must have the same layout as Detection");
+static_assert(offsetof(yh_detection, y_max) == offsetof(Detection, YMax), "yh_detection must have the same layout as Detection");
+
+struct yh_detector {
+	struct Slot {
+		std::vector<void*> Outputs;
+		const void*        Frame       = nullptr;
+		uint64_t           FrameID     = 0;
+		uint64_t           SubmittedAt = 0;
+		uint64_t           CompletedAt = 0;
+		int                Status      = 0;
+	};
+
+	yh_config   Config;
+	std::string HefPath;
+#ifndef NO_HAILORT
+	std::unique_ptr<hailort::VDevice> VDevice; // Before Backend, so that it outlives the model that Backend configures on it
+#endif
+	std::unique_ptr<InferBackend> Backend;
+	std::vector<std::unique_ptr<Slot>> Slots;
+	PageAlignedAllocator               OutputAllocator;
+	std::mutex                         FrameLock; // Protects FrameAllocator
+	PageAlignedAllocator               FrameAllocator;
+
+	mutable std::mutex      Lock; // Protects everything below
+	std::condition_variable CV;
+	std::vector<Slot*>      Free;
+	std::deque<Slot*>       Completed;
+	int                     Pending = 0;
+
+	~yh_detector() {
+		if (Backend)
+			Backend->WaitIdle();
+		// Release the configured model while the VDevice is still there
+		Backend.reset();
+	}
+};
+
+namespace {
+
+uint64_t NowNs() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Convert a backend status into a yh status
+int BackendStatus(const yh_detector* d, int status) {
+	if (status == 0)
+		return YH_OK;
+	if (d->Config.simulate)
+		return status == SimBackend::ErrTimeout ? YH_ERR_TIMEOUT : YH_ERR_INVALID_ARGUMENT;
+	return YH_ERR_HAILO_BASE - status;
+}
+
+} // namespace
+
+extern "C" {
+
+void yh_version(int* major, int* minor) {
+	if (major)
+		*major = YH_VERSION_MAJOR;
+	if (minor)
+		*minor = YH_VERSION_MINOR;
+}
+
+const char* yh_status_string(int status) {
+	switch (status) {
+	case YH_OK: return "ok";
+	case YH_ERR_INVALID_ARGUMENT: return "invalid argument";
+	case YH_ERR_TIMEOUT: return "timeout";
+	case YH_ERR_DEVICE: return "failed to create or configure the device";
+	case YH_ERR_TOO_SMALL: return "frame is smaller than the network input";
+	case YH_ERR_NO_MEMORY: return "out of memory";
+	case YH_ERR_NOT_AVAILABLE: return "built without HailoRT";
+	}
+	return status <= YH_ERR_HAILO_BASE ? "HailoRT error" : "unknown error";
+}
+
+void yh_default_config(yh_config* config) {
+	if (!config)
+		return;
+	memset(config, 0, sizeof(*config));
+	config->hef_path             = "yolov8s.hef";
+	config->batch_size           = 1;
+	config->confidence_threshold = 0.5f;
+	config->nms_iou_threshold    = 0.45f;
+	config->max_pending          = 0;
+	config->simulate             = 0;
+	config->simulate_frame_ms    = 3.0f;
+}
+
+int yh_create(const yh_config* config, yh_detector** detector) {
+	if (!config || !detector || config->batch_size < 1 || config->max_pending < 0)
+		return YH_ERR_INVALID_ARGUMENT;
+	*detector = nullptr;
+	try {
+		std::unique_ptr<yh_detector> d(new yh_detector());
+		d->Config          = *config;
+		d->HefPath         = config->hef_path ? config->hef_path : "";
+		d->Config.hef_path = d->HefPath.c_str();
+
+		if (config->simulate) {
+			auto sim        = std::make_unique<SimBackend>();
+			sim->FixedMs    = 0;
+			sim->PerFrameMs = config->simulate_frame_ms;
+			d->Backend      = std::move(sim);
+		} else {
+#ifdef NO_HAILORT
+			return YH_ERR_NOT_AVAILABLE;
+#else
+			hailort::Expected<std::unique_ptr<hailort::VDevice>> vdevice_exp = hailort::VDevice::create();
+			if (!vdevice_exp)
+				return YH_ERR_DEVICE;
+			d->VDevice = vdevice_exp.release();
+			d->Backend = std::make_unique<HailoBackend>(d->VDevice.get(), d->HefPath, config->confidence_threshold, config->nms_iou_threshold);
+#endif
+		}
+		if (d->Backend->Configure(config->batch_size) != 0)
+			return YH_ERR_DEVICE;
+
+		int nSlots = config->max_pending ? config->max_pending : 2 * (int) d->Backend->QueueSize();
+		for (int i = 0; i < nSlots; i++) {
+			auto slot = std::make_unique<yh_detector::Slot>();
+			for (const auto& out : d->Backend->Outputs()) {
+				void* p = d->OutputAllocator.Alloc(out.FrameSize);
+				if (p == MAP_FAILED)
+					return YH_ERR_NO_MEMORY;
+				slot->Outputs.push_back(p);
+			}
+			d->Free.push_back(slot.get());
+			d->Slots.push_back(std::move(slot));
+		}
+		*detector = d.release();
+		return YH_OK;
+	} catch (const std::bad_alloc&) {
+		return YH_ERR_NO_MEMORY;
+	}
+}
+
+void yh_destroy(yh_detector* detector) {
+	delete detector;
+}
+
+void yh_input_shape(const yh_detector* detector, int* width, int* height, int* channels) {
+	const TensorInfo& input = detector->Backend->Input();
+	if (width)
+		*width = (int) input.Width;
+	if (height)
+		*height = (int) input.Height;
+	if (channels)
+		*channels = (int) input.Features;
+}
+
+size_t yh_input_size(const yh_detector* detector) {
+	return detector->Backend->Input().FrameSize;
+}
+
+void* yh_alloc_frame(yh_detector* detector) {
+	std::lock_guard<std::mutex> lock(detector->FrameLock);
+	try {
+		void* p = detector->FrameAllocator.Alloc(detector->Backend->Input().FrameSize);
+		return p == MAP_FAILED ? nullptr : p;
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void yh_free_frame(yh_detector* detector, void* frame) {
+	std::lock_guard<std::mutex> lock(detector->FrameLock);
+	detector->FrameAllocator.Free(frame);
+}
+
+int yh_submit(yh_detector* detector, const void* frame, size_t size, uint64_t frame_id, int timeout_ms, yh_callback callback, void* user_data) {
+	if (!detector || !frame || timeout_ms < 0)
+		return YH_ERR_INVALID_ARGUMENT;
+	if (size < detector->Backend->Input().FrameSize)
+		return YH_ERR_TOO_SMALL;
+	auto timeout = std::chrono::milliseconds(timeout_ms);
+
+	// Wait for a free slot. If there isn't one, the caller isn't polling fast enough.
+	yh_detector::Slot* slot;
+	{
+		std::unique_lock<std::mutex> lock(detector->Lock);
+		if (!detector->CV.wait_for(lock, timeout, [&] { return !detector->Free.empty(); }))
+			return YH_ERR_TIMEOUT;
+		slot = detector->Free.back();
+		detector->Free.pop_back();
+		detector->Pending++;
+	}
+	auto release = [&](int status) {
+		std::lock_guard<std::mutex> lock(detector->Lock);
+		detector->Free.push_back(slot);
+		detector->Pending--;
+		detector->CV.notify_all();
+		return status;
+	};
+
+	int status = detector->Backend->WaitForAsyncReady(timeout, 1);
+	if (status != 0)
+		return release(BackendStatus(detector, status));
+
+	slot->Frame       = frame;
+	slot->FrameID     = frame_id;
+	slot->SubmittedAt = NowNs();
+	try {
+		BackendFrame bf;
+		bf.Input   = frame;
+		bf.Outputs = slot->Outputs;
+		status     = detector->Backend->RunAsync({bf}, [detector, slot, callback, user_data, frame_id](int s) {
+			slot->CompletedAt = NowNs();
+			slot->Status      = s;
+			{
+				// After this, the slot can be polled and reused at any moment
+				std::lock_guard<std::mutex> lock(detector->Lock);
+				detector->Completed.push_back(slot);
+				detector->CV.notify_all();
+			}
+			if (callback)
+				callback(user_data, frame_id, BackendStatus(detector, s));
+		});
+	} catch (const std::bad_alloc&) {
+		return release(YH_ERR_NO_MEMORY);
+	}
+	if (status != 0)
+		return release(BackendStatus(detector, status));
+	return YH_OK;
+}
+
+int yh_poll(yh_detector* detector, int timeout_ms, yh_result* result, yh_detection* detections, int max_detections) {
+	if (!detector || !result || timeout_ms < 0 || max_detections < 0 || (max_detections > 0 && !detections))
+		return YH_ERR_INVALID_ARGUMENT;
+
+	yh_detector::Slot* slot;
+	{
+		std::unique_lock<std::mutex> lock(detector->Lock);
+		if (!detector->CV.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return !detector->Completed.empty(); }))
+			return YH_ERR_TIMEOUT;
+		slot = detector->Completed.front();
+		detector->Completed.pop_front();
+	}
+
+	result->frame_id         = slot->FrameID;
+	result->frame            = slot->Frame;
+	result->status           = BackendStatus(detector, slot->Status);
+	result->num_detections   = 0;
+	result->total_detections = 0;
+	result->latency_ns       = slot->CompletedAt - slot->SubmittedAt;
+	if (slot->Status == 0) {
+		// Reused between calls, so that polling doesn't allocate
+		thread_local std::vector<Detection> dets;
+		dets.clear();
+		const std::vector<TensorInfo>& outputs = detector->Backend->Outputs();
+		for (size_t i = 0; i < outputs.size(); i++) {
+			if (outputs[i].IsNMS && outputs[i].Type == TensorType::Float32)
+				ParseHailoNMS((const float*) slot->Outputs[i], outputs[i].Height, outputs[i].FrameSize / sizeof(float), detector->Config.confidence_threshold, dets);
+		}
+		int n                    = (int) std::min(dets.size(), (size_t) max_detections);
+		result->num_detections   = n;
+		result->total_detections = (int) dets.size();
+		if (n != 0)
+			memcpy(detections, dets.data(), n * sizeof(yh_detection));
+	}
+
+	std::lock_guard<std::mutex> lock(detector->Lock);
+	detector->Free.push_back(slot);
+	detector->Pending--;
+	detector->CV.notify_all();
+	return YH_OK;
+}
+
+int yh_pending(const yh_detector* detector) {
+	std::lock_guard<std::mutex> lock(detector->Lock);
+	return detector->Pending;
+}
+
+} // extern "C"
@@ -0,0 +1,122 @@
+#pragma once
+
+// libyolohailo: a YOLOv8 object detector on a Hailo accelerator, with a C API, so that it can be
+// called from C, Go (cgo), Python (ctypes/cffi) or anything else with a C FFI.
+//
+//   yh_config config;
+//   yh_default_config(&config);
+//   config.hef_path = "yolov8s.hef";
+//   yh_detector* det;
+//   if (yh_create(&config, &det) != YH_OK) ...
+//
+//   yh_submit(det, rgb, size, frame_id, 1000, NULL, NULL); // rgb must stay valid until polled
+//   yh_detection boxes[100];
+//   yh_result    result;
+//   yh_poll(det, 1000, &result, boxes, 100);
+//
+//   yh_destroy(det);
+//
+// Input frames are never copied. The device reads them straight out of the caller's buffer,
+// so a frame must not be modified or freed until its result has been returned by yh_poll().
+// yh_alloc_frame() returns page-aligned memory, which is the fastest kind for the device to read.
+//
+// Results come back in completion order, and are written into caller-owned arrays, so there is
+// nothing for the caller to free, and no per-frame allocation on either side.
+//
+// One thread may submit while another polls. Don't call yh_submit, or yh_poll, from more than one
+// thread at a time.
+//
+// ABI stability: functions are only ever added, structs only ever grow at the end, and
+// yh_config is always initialized by yh_default_config(), so that new fields get defaults.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define YH_API __attribute__((visibility("default")))
+#else
+#define YH_API
+#endif
+
+#define YH_VERSION_MAJOR 1
+#define YH_VERSION_MINOR 0
+
+// Status codes. A HailoRT error (hailo_status) s is returned as YH_ERR_HAILO_BASE - s.
+#define YH_OK 0
+#define YH_ERR_INVALID_ARGUMENT -1
+#define YH_ERR_TIMEOUT -2       // Nothing completed, or no space in the queue, within the timeout
+#define YH_ERR_DEVICE -3        // Failed to create or configure the device
+#define YH_ERR_TOO_SMALL -4     // The frame is smaller than the network input
+#define YH_ERR_NO_MEMORY -5
+#define YH_ERR_NOT_AVAILABLE -6 // Built without HailoRT, and config.simulate is 0
+#define YH_ERR_HAILO_BASE -1000
+
+typedef struct yh_detector yh_detector;
+
+typedef struct yh_config {
+	const char* hef_path;             // Default "yolov8s.hef"
+	int         batch_size;           // Default 1
+	float       confidence_threshold; // Default 0.5
+	float       nms_iou_threshold;    // Default 0.45
+	int         max_pending;          // Frames submitted but not yet polled. 0 = twice the device's queue size.
+	int         simulate;             // Use a simulated device, which returns synthetic boxes. Default 0.
+	float       simulate_frame_ms;    // Simulated time per frame. Default 3.
+} yh_config;
+
+// Same layout as Detection in nms.h. Coordinates are normalized to [0..1].
+typedef struct yh_detection {
+	int   class_id;
+	float confidence;
+	float x_min;
+	float y_min;
+	float x_max;
+	float y_max;
+} yh_detection;
+
+typedef struct yh_result {
+	uint64_t    frame_id;         // As passed to yh_submit
+	const void* frame;            // The input buffer, which the caller may now reuse
+	int         status;           // YH_OK, or the error that the frame failed with
+	int         num_detections;   // Number of detections written to the caller's array
+	int         total_detections; // Number of detections found, which may be more than fit
+	uint64_t    latency_ns;       // From yh_submit() to completion on the device
+} yh_result;
+
+// Called on a HailoRT thread when a frame completes. It must return quickly, and must not call
+// back into the library. Typically it just wakes up the thread that calls yh_poll().
+typedef void (*yh_callback)(void* user_data, uint64_t frame_id, int status);
+
+YH_API void        yh_version(int* major, int* minor);
+YH_API const char* yh_status_string(int status);
+YH_API void        yh_default_config(yh_config* config);
+
+YH_API int  yh_create(const yh_config* config, yh_detector** detector);
+YH_API void yh_destroy(yh_detector* detector); // Waits for frames in flight to complete
+
+// The network input: width x height x channels bytes of RGB
+YH_API void   yh_input_shape(const yh_detector* detector, int* width, int* height, int* channels);
+YH_API size_t yh_input_size(const yh_detector* detector);
+
+// Page-aligned memory for input frames
+YH_API void* yh_alloc_frame(yh_detector* detector);
+YH_API void  yh_free_frame(yh_detector* detector, void* frame);
+
+// Queue a frame for inference. Blocks for up to timeout_ms if the device queue is full, or
+// max_pending results are waiting to be polled. callback may be NULL.
+YH_API int yh_submit(yh_detector* detector, const void* frame, size_t size, uint64_t frame_id, int timeout_ms, yh_callback callback, void* user_data);
+
+// Wait up to timeout_ms for a frame to complete, and write its detections (up to max_detections
+// of them) into the caller's array. Returns YH_OK if a result was returned, YH_ERR_TIMEOUT if
+// nothing completed in time. timeout_ms = 0 polls without waiting.
+YH_API int yh_poll(yh_detector* detector, int timeout_ms, yh_result* result, yh_detection* detections, int max_detections);
+
+// Number of frames submitted but not yet polled
+YH_API int yh_pending(const yh_detector* detector);
+
+#ifdef __cplusplus
+}
+#endif
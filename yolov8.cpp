@@ -2,10 +2,17 @@
 #include <hailo/hailort_common.hpp>
 #include <hailo/vdevice.hpp>
 #include <hailo/infer_model.hpp>
+#include <algorithm>
 #include <chrono>
+#include <future>
 
 #include "output_tensor.h"
 #include "debug.h"
+#include "model_cache.h"
+#include "nms.h"
+#include "startup.h"
+#include "text_writer.h"
+#include "trace.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -22,29 +29,56 @@ std::string hefFile             = "yolov8s.hef";
 std::string imgFilename         = "test-image-640x640.jpg";
 float       confidenceThreshold = 0.5f;  // Lower number = accept more boxes
 float       nmsIoUThreshold     = 0.45f; // Lower number = merge more boxes (I think!)
+std::string traceFilename       = "";    // If not empty, write a Chrome trace here (open it in https://ui.perfetto.dev)
+std::string npyPrefix           = "";    // If not empty, save every output tensor as <npyPrefix><tensor name>.npy
+std::string detectionFormat     = "text"; // How to print detections: "text", "csv" or "jsonl"
 
 int run() {
 	using namespace hailort;
 	using namespace std::literals::chrono_literals;
 
+	DetectionFormat format;
+	if (!ParseDetectionFormat(detectionFormat, format)) {
+		printf("Unknown detection format '%s'\n", detectionFormat.c_str());
+		return 1;
+	}
+
+	Tracer::Enabled = traceFilename != "";
+
 	////////////////////////////////////////////////////////////////////////////////////////////
 	// Load/Init
 	////////////////////////////////////////////////////////////////////////////////////////////
 
-	Expected<std::unique_ptr<VDevice>> vdevice_exp = VDevice::create();
+	// Opening the device takes the longest, and nothing else needs it, so read the HEF and
+	// decode the image on other threads in the meantime.
+	StartupTimer startup;
+	ModelCache   modelCache;
+	auto         hefRead = std::async(std::launch::async, [&] { return startup.Time("read HEF", [&] { return modelCache.Preload(hefFile); }); });
+
+	int  imgWidth = 0, imgHeight = 0, imgChan = 0;
+	auto imgDecode = std::async(std::launch::async, [&] {
+		return startup.Time("stbi_load", [&] { return stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3); });
+	});
+
+	Expected<std::unique_ptr<VDevice>> vdevice_exp = startup.Time("VDevice::create", [] { return VDevice::create(); });
 	if (!vdevice_exp) {
 		printf("Failed to create vdevice\n");
 		return vdevice_exp.status();
 	}
 	std::unique_ptr<hailort::VDevice> vdevice = vdevice_exp.release();
 
-	// Create infer model from HEF file.
-	Expected<std::shared_ptr<InferModel>> infer_model_exp = vdevice->create_infer_model(hefFile);
-	if (!infer_model_exp) {
+	if (!hefRead.get()) {
+		printf("Failed to read %s\n", hefFile.c_str());
+		return 1;
+	}
+
+	// Create infer model from the HEF in memory.
+	std::shared_ptr<hailort::InferModel> infer_model;
+	auto                                 status = startup.Time("create infer model", [&] { return modelCache.Get(*vdevice, hefFile, infer_model); });
+	if (status != HAILO_SUCCESS) {
 		printf("Failed to create infer model\n");
-		return infer_model_exp.status();
+		return status;
 	}
-	std::shared_ptr<hailort::InferModel> infer_model = infer_model_exp.release();
 	infer_model->set_hw_latency_measurement_flags(HAILO_LATENCY_MEASURE);
 	infer_model->output()->set_nms_score_threshold(confidenceThreshold);
 	infer_model->output()->set_nms_iou_threshold(nmsIoUThreshold);
@@ -65,7 +99,7 @@ int run() {
 
 	// Configure the infer model
 	// infer_model->output()->set_format_type(HAILO_FORMAT_TYPE_FLOAT32);
-	Expected<ConfiguredInferModel> configured_infer_model_exp = infer_model->configure();
+	Expected<ConfiguredInferModel> configured_infer_model_exp = startup.Time("configure", [&] { return infer_model->configure(); });
 	if (!configured_infer_model_exp) {
 		printf("Failed to get configured infer model\n");
 		return configured_infer_model_exp.status();
@@ -73,7 +107,7 @@ int run() {
 	std::shared_ptr<hailort::ConfiguredInferModel> configured_infer_model = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
 
 	// Create infer bindings
-	Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model->create_bindings();
+	Expected<ConfiguredInferModel::Bindings> bindings_exp = startup.Time("create bindings", [&] { return configured_infer_model->create_bindings(); });
 	if (!bindings_exp) {
 		printf("Failed to get infer model bindings\n");
 		return bindings_exp.status();
@@ -89,8 +123,7 @@ int run() {
 	printf("input_name: %s\n", input_name.c_str());
 	printf("input_frame_size: %d\n", (int) input_frame_size); // eg 640x640x3 = 1228800
 
-	int            imgWidth = 0, imgHeight = 0, imgChan = 0;
-	unsigned char* img_rgb_8 = stbi_load(imgFilename.c_str(), &imgWidth, &imgHeight, &imgChan, 3);
+	unsigned char* img_rgb_8 = imgDecode.get();
 	if (!img_rgb_8) {
 		printf("Failed to load image %s\n", imgFilename.c_str());
 		return 1;
@@ -102,7 +135,9 @@ int run() {
 		printf("Input image resolution %d x %d not equal to NN input resolution %d x %d\n", imgWidth, imgHeight, nnWidth, nnHeight);
 	}
 
-	auto status = bindings.input(input_name)->set_buffer(MemoryView((void*) (img_rgb_8), input_frame_size));
+	uint64_t traceStart = Tracer::NowNs();
+	status              = bindings.input(input_name)->set_buffer(MemoryView((void*) (img_rgb_8), input_frame_size));
+	Tracer::Record("set_buffer input", traceStart, Tracer::NowNs());
 	if (status != HAILO_SUCCESS) {
 		printf("Failed to set memory buffer: %d\n", (int) status);
 		return status;
@@ -120,7 +155,9 @@ int run() {
 			return status;
 		}
 
-		status = bindings.output(output_name)->set_buffer(MemoryView(output_buffer, output_size));
+		traceStart = Tracer::NowNs();
+		status     = bindings.output(output_name)->set_buffer(MemoryView(output_buffer, output_size));
+		Tracer::Record("set_buffer output", traceStart, Tracer::NowNs());
 		if (status != HAILO_SUCCESS) {
 			printf("Failed to set infer output buffer, status = %d", (int) status);
 			return status;
@@ -138,6 +175,8 @@ int run() {
 		}
 	}
 
+	startup.Print();
+
 	// Waiting for available requests in the pipeline.
 	status = configured_infer_model->wait_for_async_ready(1s);
 	if (status != HAILO_SUCCESS) {
@@ -146,7 +185,13 @@ int run() {
 	}
 
 	// Dispatch the job.
-	Expected<AsyncInferJob> job_exp = configured_infer_model->run_async(bindings);
+	auto                    submitTime = std::chrono::steady_clock::now();
+	uint64_t                submitNs   = Tracer::NowNs();
+	Expected<AsyncInferJob> job_exp    = configured_infer_model->run_async(bindings, [submitNs](const AsyncInferCompletionInfo& completion_info) {
+		// This runs on a HailoRT thread
+		Tracer::Record("device", submitNs, Tracer::NowNs());
+	});
+	Tracer::Record("run_async", submitNs, Tracer::NowNs());
 	if (!job_exp) {
 		printf("Failed to start async infer job, status = %d\n", (int) job_exp.status());
 		return status;
@@ -164,11 +209,37 @@ int run() {
 	std::sort(output_tensors.begin(), output_tensors.end(), OutTensor::SortFunction);
 
 	// Wait for job completion.
-	status = job.wait(1s);
+	traceStart = Tracer::NowNs();
+	status     = job.wait(1s);
+	Tracer::Record("job.wait", traceStart, Tracer::NowNs());
 	if (status != HAILO_SUCCESS) {
 		printf("Failed to wait for inference to finish, status = %d\n", (int) status);
 		return status;
 	}
+	double hostLatencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+
+	// This is available because of set_hw_latency_measurement_flags(HAILO_LATENCY_MEASURE).
+	// The difference between the two is transfer, driver and HailoRT overhead.
+	Expected<LatencyMeasurementResult> hw_latency_exp = configured_infer_model->get_hw_latency_measurement();
+	if (hw_latency_exp) {
+		double deviceLatencyMs = std::chrono::duration<double, std::milli>(hw_latency_exp->avg_hw_latency).count();
+		printf("Latency: host wall-clock %.2fms, device %.2fms\n", hostLatencyMs, deviceLatencyMs);
+	} else {
+		printf("Latency: host wall-clock %.2fms, device latency not available (status %d)\n", hostLatencyMs, (int) hw_latency_exp.status());
+	}
+
+	// Load these in Python with numpy.load()
+	if (npyPrefix != "") {
+		for (const auto& out : output_tensors) {
+			std::string filename = npyPrefix + out.name + ".npy";
+			std::replace(filename.begin() + npyPrefix.size(), filename.end(), '/', '_');
+			if (!out.SaveNpy(filename)) {
+				printf("Failed to write %s\n", filename.c_str());
+				return 1;
+			}
+			printf("Saved %s\n", filename.c_str());
+		}
+	}
 
 	bool nmsOnHailo = infer_model->outputs().size() == 1 && infer_model->outputs()[0].is_nms();
 
@@ -179,31 +250,28 @@ int run() {
 
 		printf("Output shape: %d, %d\n", (int) out->shape.height, (int) out->shape.width);
 
-		// The format is:
-		// Number of boxes in that class (N), followed by the 5 box parameters, repeated N times
-		size_t numClasses = (size_t) out->shape.height;
-		size_t classIdx   = 0;
-		size_t idx        = 0;
-		while (classIdx < numClasses) {
-			size_t numBoxes = (size_t) raw[idx++];
-			for (size_t i = 0; i < numBoxes; i++) {
-				float ymin       = raw[idx];
-				float xmin       = raw[idx + 1];
-				float ymax       = raw[idx + 2];
-				float xmax       = raw[idx + 3];
-				float confidence = raw[idx + 4];
-				if (confidence >= 0.5f) {
-					printf("class: %d, confidence: %.2f, %.0f,%.0f - %.0f,%.0f\n", classIdx, confidence, xmin * nnWidth, ymin * nnHeight, xmax * nnWidth, ymax * nnHeight);
-				}
-				idx += 5;
-			}
-			classIdx++;
+		std::vector<Detection> detections;
+		{
+			TRACE_SCOPE("parse NMS");
+			ParseHailoNMS(raw, (size_t) out->shape.height, infer_model->output(out->name)->get_frame_size() / sizeof(float), 0.5f, detections);
 		}
+		// Everything that we've printf'ed must come out before the detections
+		fflush(stdout);
+		TextWriter textOut(STDOUT_FILENO);
+		WriteDetectionHeader(textOut, format);
+		for (const auto& d : detections)
+			WriteDetection(textOut, format, 0, d, nnWidth, nnHeight);
+		textOut.Flush();
 	} else {
 		printf("No support in this example for NMS on CPU. See othe Hailo examples\n");
 		return 1;
 	}
 
+	if (Tracer::Enabled && !Tracer::WriteChromeJSON(traceFilename)) {
+		printf("Failed to write trace file %s\n", traceFilename.c_str());
+		return 1;
+	}
+
 	return 123456789;
 }
 
@@ -0,0 +1,383 @@
+#pragma once
+
+// Converts the frames that cameras and video decoders deliver (YUV 4:2:0, as I420 or NV12) into
+// the packed RGB that the network takes as input. Scaling and letterboxing are fused into the
+// conversion, so a frame goes straight from the camera's buffer into the device's input buffer,
+// without a full-size RGB copy in between.
+//
+//   InputConverter conv;
+//   Letterbox      box = conv.Convert(YUVImage::NV12(camera, 1920, 1080, 1920), (uint8_t*) inputBuffer, 640, 640);
+//   ...
+//   float x = box.SourceX(det.XMin); // Back to a normalized coordinate in the camera frame
+//
+// The image is scaled to fit without changing its aspect ratio, and centered, with PadValue in
+// the borders. Scaling samples the nearest source pixel, which costs nothing extra per pixel.
+//
+// The color conversion works on one row at a time, with NEON on ARM, SSE2 on x86, and plain C++
+// elsewhere. All of them use the same 16-bit fixed point arithmetic, and give identical results.
+// BT.601 coefficients, which is what JPEG and most SD/HD video use.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#endif
+
+enum class YUVLayout {
+	I420, // Y plane, then a U plane and a V plane at half the resolution in both directions
+	NV12, // Y plane, then one plane of interleaved U,V pairs, at half the resolution
+};
+
+struct YUVImage {
+	YUVLayout      Layout    = YUVLayout::I420;
+	const uint8_t* Y         = nullptr;
+	const uint8_t* U         = nullptr; // For NV12, the interleaved UV plane
+	const uint8_t* V         = nullptr; // Unused for NV12
+	int            StrideY   = 0;       // Bytes per row
+	int            StrideUV  = 0;
+	int            Width     = 0;
+	int            Height    = 0;
+	bool           FullRange = false; // Y and UV in 0..255, as in JPEG. Otherwise Y is in 16..235, and UV in 16..240.
+
+	// Contiguous planes, with no padding at the end of each row, as in a Y4M frame
+	static YUVImage I420(const uint8_t* data, int width, int height, bool fullRange = false) {
+		YUVImage img;
+		img.Layout    = YUVLayout::I420;
+		img.Y         = data;
+		img.U         = data + (size_t) width * height;
+		img.V         = img.U + (size_t) ((width + 1) / 2) * ((height + 1) / 2);
+		img.StrideY   = width;
+		img.StrideUV  = (width + 1) / 2;
+		img.Width     = width;
+		img.Height    = height;
+		img.FullRange = fullRange;
+		return img;
+	}
+
+	// The UV plane follows the Y plane, and both have the same stride, as from V4L2 and libcamera
+	static YUVImage NV12(const uint8_t* data, int width, int height, int stride, bool fullRange = false) {
+		YUVImage img;
+		img.Layout    = YUVLayout::NV12;
+		img.Y         = data;
+		img.U         = data + (size_t) stride * height;
+		img.StrideY   = stride;
+		img.StrideUV  = stride;
+		img.Width     = width;
+		img.Height    = height;
+		img.FullRange = fullRange;
+		return img;
+	}
+
+	// A region of the image, without copying. x and y must be even.
+	YUVImage Crop(int x, int y, int width, int height) const {
+		YUVImage img = *this;
+		img.Y += (size_t) y * StrideY + x;
+		img.U += (size_t) (y / 2) * StrideUV + (Layout == YUVLayout::NV12 ? x : x / 2);
+		if (Layout == YUVLayout::I420)
+			img.V += (size_t) (y / 2) * StrideUV + x / 2;
+		img.Width  = width;
+		img.Height = height;
+		return img;
+	}
+};
+
+// Fixed point coefficients (x4096) for one YUV range
+struct YUVCoeffs {
+	uint8_t  YOffset; // 16 for limited range, 0 for full range
+	uint16_t Y;       // Scale applied to (Y - YOffset)
+	int16_t  RV;
+	int16_t  GU;
+	int16_t  GV;
+	int16_t  BU;
+};
+
+inline const YUVCoeffs& BT601(bool fullRange) {
+	static const YUVCoeffs limited = {16, 4769, 6537, 1605, 3330, 8263};
+	static const YUVCoeffs full    = {0, 4096, 5743, 1410, 2925, 7258};
+	return fullRange ? full : limited;
+}
+
+// Where the source image ended up in the destination
+struct Letterbox {
+	int X         = 0; // Top-left corner of the scaled image
+	int Y         = 0;
+	int Width     = 0; // Size of the scaled image
+	int Height    = 0;
+	int DstWidth  = 0;
+	int DstHeight = 0;
+
+	// Convert a normalized coordinate in the destination (such as a Detection) to a normalized
+	// coordinate in the source image
+	float SourceX(float x) const { return (x * DstWidth - X) / Width; }
+	float SourceY(float y) const { return (y * DstHeight - Y) / Height; }
+};
+
+// Scale srcWidth x srcHeight to fit inside dstWidth x dstHeight, and center it
+inline Letterbox FitLetterbox(int srcWidth, int srcHeight, int dstWidth, int dstHeight) {
+	Letterbox box;
+	double    scale = std::min((double) dstWidth / srcWidth, (double) dstHeight / srcHeight);
+	box.Width       = std::max(1, std::min(dstWidth, (int) (srcWidth * scale + 0.5)));
+	box.Height      = std::max(1, std::min(dstHeight, (int) (srcHeight * scale + 0.5)));
+	box.X           = (dstWidth - box.Width) / 2;
+	box.Y           = (dstHeight - box.Height) / 2;
+	box.DstWidth    = dstWidth;
+	box.DstHeight   = dstHeight;
+	return box;
+}
+
+inline uint8_t ClampU8(int v) {
+	return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// Convert one row of width pixels to packed RGB. u and v have one sample per pixel.
+// The arithmetic is what the SIMD versions do: (a * b) >> 16 on 16 bit lanes, with the result
+// in 1/16ths, and rounded at the end.
+inline void YUVRowToRGBScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgb, int width, const YUVCoeffs& c) {
+	for (int i = 0; i < width; i++) {
+		int yy = (std::max(y[i] - c.YOffset, 0) * 256 * c.Y) >> 16;
+		int uu = (u[i] - 128) * 256;
+		int vv = (v[i] - 128) * 256;
+		rgb[0] = ClampU8((yy + ((vv * c.RV) >> 16) + 8) >> 4);
+		rgb[1] = ClampU8((yy - ((uu * c.GU) >> 16) - ((vv * c.GV) >> 16) + 8) >> 4);
+		rgb[2] = ClampU8((yy + ((uu * c.BU) >> 16) + 8) >> 4);
+		rgb += 3;
+	}
+}
+
+#if defined(__ARM_NEON)
+
+inline int16x8_t YUVMulHi(int16x8_t a, int16x8_t b) {
+	int32x4_t lo = vmull_s16(vget_low_s16(a), vget_low_s16(b));
+	int32x4_t hi = vmull_s16(vget_high_s16(a), vget_high_s16(b));
+	return vcombine_s16(vshrn_n_s32(lo, 16), vshrn_n_s32(hi, 16));
+}
+
+inline int16x8_t YUVMulHiU(uint16x8_t a, uint16x8_t b) {
+	uint32x4_t lo = vmull_u16(vget_low_u16(a), vget_low_u16(b));
+	uint32x4_t hi = vmull_u16(vget_high_u16(a), vget_high_u16(b));
+	return vreinterpretq_s16_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+}
+
+// 8 pixels, with y already offset, and u and v already centered on zero, all x256
+inline void YUV8ToRGB(uint16x8_t y, int16x8_t u, int16x8_t v, const YUVCoeffs& c, uint8x8_t& r, uint8x8_t& g, uint8x8_t& b) {
+	int16x8_t yy = YUVMulHiU(y, vdupq_n_u16(c.Y));
+	int16x8_t rr = vaddq_s16(yy, YUVMulHi(v, vdupq_n_s16(c.RV)));
+	int16x8_t gg = vsubq_s16(vsubq_s16(yy, YUVMulHi(u, vdupq_n_s16(c.GU))), YUVMulHi(v, vdupq_n_s16(c.GV)));
+	int16x8_t bb = vaddq_s16(yy, YUVMulHi(u, vdupq_n_s16(c.BU)));
+	r            = vqmovun_s16(vrshrq_n_s16(rr, 4));
+	g            = vqmovun_s16(vrshrq_n_s16(gg, 4));
+	b            = vqmovun_s16(vrshrq_n_s16(bb, 4));
+}
+
+inline int16x8_t YUVCenter(uint8x8_t x) {
+	return vshlq_n_s16(vreinterpretq_s16_u16(vsubl_u8(x, vdup_n_u8(128))), 8);
+}
+
+inline void YUVRowToRGB(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgb, int width, const YUVCoeffs& c) {
+	uint8x16_t offset = vdupq_n_u8(c.YOffset);
+	int        i      = 0;
+	for (; i + 16 <= width; i += 16) {
+		uint8x16_t   yb = vqsubq_u8(vld1q_u8(y + i), offset);
+		uint8x16_t   ub = vld1q_u8(u + i);
+		uint8x16_t   vb = vld1q_u8(v + i);
+		uint8x8_t    r0, g0, b0, r1, g1, b1;
+		uint8x16x3_t out;
+		YUV8ToRGB(vshll_n_u8(vget_low_u8(yb), 8), YUVCenter(vget_low_u8(ub)), YUVCenter(vget_low_u8(vb)), c, r0, g0, b0);
+		YUV8ToRGB(vshll_n_u8(vget_high_u8(yb), 8), YUVCenter(vget_high_u8(ub)), YUVCenter(vget_high_u8(vb)), c, r1, g1, b1);
+		out.val[0] = vcombine_u8(r0, r1);
+		out.val[1] = vcombine_u8(g0, g1);
+		out.val[2] = vcombine_u8(b0, b1);
+		vst3q_u8(rgb + i * 3, out);
+	}
+	YUVRowToRGBScalar(y + i, u + i, v + i, rgb + i * 3, width - i, c);
+}
+
+#elif defined(__SSE2__)
+
+// 8 pixels, with y already offset, and u and v already centered on zero, all x256. Returns r.
+inline __m128i YUV8ToRGB(__m128i y, __m128i u, __m128i v, const YUVCoeffs& c, __m128i& g, __m128i& b) {
+	__m128i yy  = _mm_mulhi_epu16(y, _mm_set1_epi16((short) c.Y));
+	__m128i rr  = _mm_add_epi16(yy, _mm_mulhi_epi16(v, _mm_set1_epi16(c.RV)));
+	__m128i gg  = _mm_sub_epi16(_mm_sub_epi16(yy, _mm_mulhi_epi16(u, _mm_set1_epi16(c.GU))), _mm_mulhi_epi16(v, _mm_set1_epi16(c.GV)));
+	__m128i bb  = _mm_add_epi16(yy, _mm_mulhi_epi16(u, _mm_set1_epi16(c.BU)));
+	__m128i rnd = _mm_set1_epi16(8);
+	g           = _mm_srai_epi16(_mm_add_epi16(gg, rnd), 4);
+	b           = _mm_srai_epi16(_mm_add_epi16(bb, rnd), 4);
+	return _mm_srai_epi16(_mm_add_epi16(rr, rnd), 4);
+}
+
+inline void YUVRowToRGB(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgb, int width, const YUVCoeffs& c) {
+	__m128i zero   = _mm_setzero_si128();
+	__m128i offset = _mm_set1_epi8((char) c.YOffset);
+	__m128i flip   = _mm_set1_epi8((char) 0x80);
+	int     i      = 0;
+	for (; i + 16 <= width; i += 16) {
+		__m128i yb = _mm_subs_epu8(_mm_loadu_si128((const __m128i*) (y + i)), offset);
+		__m128i ub = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (u + i)), flip); // u - 128
+		__m128i vb = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (v + i)), flip);
+		__m128i g0, b0, g1, b1;
+		// Unpacking with zero in the low byte multiplies by 256
+		__m128i r0 = YUV8ToRGB(_mm_unpacklo_epi8(zero, yb), _mm_unpacklo_epi8(zero, ub), _mm_unpacklo_epi8(zero, vb), c, g0, b0);
+		__m128i r1 = YUV8ToRGB(_mm_unpackhi_epi8(zero, yb), _mm_unpackhi_epi8(zero, ub), _mm_unpackhi_epi8(zero, vb), c, g1, b1);
+		__m128i r  = _mm_packus_epi16(r0, r1);
+		__m128i g  = _mm_packus_epi16(g0, g1);
+		__m128i b  = _mm_packus_epi16(b0, b1);
+#if defined(__SSSE3__)
+		// Interleave 16 R, 16 G and 16 B into 48 bytes of RGB
+		const __m128i m0r = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+		const __m128i m0g = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+		const __m128i m0b = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+		const __m128i m1r = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+		const __m128i m1g = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+		const __m128i m1b = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+		const __m128i m2r = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+		const __m128i m2g = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+		const __m128i m2b = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+		__m128i       o0  = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, m0r), _mm_shuffle_epi8(g, m0g)), _mm_shuffle_epi8(b, m0b));
+		__m128i       o1  = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, m1r), _mm_shuffle_epi8(g, m1g)), _mm_shuffle_epi8(b, m1b));
+		__m128i       o2  = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, m2r), _mm_shuffle_epi8(g, m2g)), _mm_shuffle_epi8(b, m2b));
+		_mm_storeu_si128((__m128i*) (rgb + i * 3), o0);
+		_mm_storeu_si128((__m128i*) (rgb + i * 3 + 16), o1);
+		_mm_storeu_si128((__m128i*) (rgb + i * 3 + 32), o2);
+#else
+		// SSE2 has no byte shuffle, so interleave through memory
+		alignas(16) uint8_t planes[3][16];
+		_mm_store_si128((__m128i*) planes[0], r);
+		_mm_store_si128((__m128i*) planes[1], g);
+		_mm_store_si128((__m128i*) planes[2], b);
+		uint8_t* out = rgb + i * 3;
+		for (int j = 0; j < 16; j++) {
+			out[j * 3 + 0] = planes[0][j];
+			out[j * 3 + 1] = planes[1][j];
+			out[j * 3 + 2] = planes[2][j];
+		}
+#endif
+	}
+	YUVRowToRGBScalar(y + i, u + i, v + i, rgb + i * 3, width - i, c);
+}
+
+#else
+
+inline void YUVRowToRGB(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgb, int width, const YUVCoeffs& c) {
+	YUVRowToRGBScalar(y, u, v, rgb, width, c);
+}
+
+#endif
+
+// Converts and letterboxes frames into a network input buffer. The lookup tables for scaling
+// are built for the first frame, and rebuilt only when the source or destination size changes.
+// Not thread safe: use one per thread.
+class InputConverter {
+public:
+	uint8_t PadValue = 114; // Gray, as in the YOLOv8 letterbox
+
+	Letterbox Convert(const YUVImage& src, uint8_t* dst, int dstWidth, int dstHeight) {
+		Prepare(src.Width, src.Height, dstWidth, dstHeight);
+		const YUVCoeffs& c         = BT601(src.FullRange);
+		int              lastUVRow = -1;
+		for (int row = 0; row < dstHeight; row++) {
+			uint8_t* out = dst + (size_t) row * dstWidth * 3;
+			if (!PadRow(out, row))
+				continue;
+			int            sy = SrcRow[row - Box.Y];
+			const uint8_t* y  = src.Y + (size_t) sy * src.StrideY;
+			if (!Identity) {
+				for (int i = 0; i < Box.Width; i++)
+					RowY[i] = y[SrcCol[i]];
+				y = RowY.data();
+			}
+			// In 4:2:0, every pair of rows shares the same chroma row
+			if (sy / 2 != lastUVRow) {
+				lastUVRow = sy / 2;
+				if (src.Layout == YUVLayout::NV12) {
+					const uint8_t* uv = src.U + (size_t) lastUVRow * src.StrideUV;
+					for (int i = 0; i < Box.Width; i++) {
+						RowU[i] = uv[SrcCol[i] & ~1];
+						RowV[i] = uv[SrcCol[i] | 1];
+					}
+				} else {
+					const uint8_t* u = src.U + (size_t) lastUVRow * src.StrideUV;
+					const uint8_t* v = src.V + (size_t) lastUVRow * src.StrideUV;
+					for (int i = 0; i < Box.Width; i++) {
+						RowU[i] = u[SrcCol[i] >> 1];
+						RowV[i] = v[SrcCol[i] >> 1];
+					}
+				}
+			}
+			YUVRowToRGB(y, RowU.data(), RowV.data(), out + Box.X * 3, Box.Width, c);
+		}
+		return Box;
+	}
+
+	// The same, for packed RGB, such as a decoded JPEG. stride is in bytes.
+	Letterbox Convert(const uint8_t* src, int srcWidth, int srcHeight, int stride, uint8_t* dst, int dstWidth, int dstHeight) {
+		Prepare(srcWidth, srcHeight, dstWidth, dstHeight);
+		for (int row = 0; row < dstHeight; row++) {
+			uint8_t* out = dst + (size_t) row * dstWidth * 3;
+			if (!PadRow(out, row))
+				continue;
+			const uint8_t* in = src + (size_t) SrcRow[row - Box.Y] * stride;
+			out += Box.X * 3;
+			if (Identity) {
+				memcpy(out, in, (size_t) Box.Width * 3);
+				continue;
+			}
+			for (int i = 0; i < Box.Width; i++) {
+				const uint8_t* p = in + SrcCol[i] * 3;
+				out[i * 3 + 0]   = p[0];
+				out[i * 3 + 1]   = p[1];
+				out[i * 3 + 2]   = p[2];
+			}
+		}
+		return Box;
+	}
+
+private:
+	int                  SrcWidth  = 0;
+	int                  SrcHeight = 0;
+	Letterbox            Box;
+	bool                 Identity = false; // Source columns map 1:1 to destination columns
+	std::vector<int>     SrcCol;           // Source column of each column of the scaled image
+	std::vector<int>     SrcRow;           // Source row of each row of the scaled image
+	std::vector<uint8_t> RowY;
+	std::vector<uint8_t> RowU;
+	std::vector<uint8_t> RowV;
+
+	void Prepare(int srcWidth, int srcHeight, int dstWidth, int dstHeight) {
+		if (srcWidth == SrcWidth && srcHeight == SrcHeight && dstWidth == Box.DstWidth && dstHeight == Box.DstHeight)
+			return;
+		SrcWidth  = srcWidth;
+		SrcHeight = srcHeight;
+		Box       = FitLetterbox(srcWidth, srcHeight, dstWidth, dstHeight);
+		Identity  = Box.Width == srcWidth;
+		SrcCol.resize(Box.Width);
+		SrcRow.resize(Box.Height);
+		// Sample at the center of each destination pixel
+		for (int i = 0; i < Box.Width; i++)
+			SrcCol[i] = std::min(srcWidth - 1, (int) ((i + 0.5) * srcWidth / Box.Width));
+		for (int i = 0; i < Box.Height; i++)
+			SrcRow[i] = std::min(srcHeight - 1, (int) ((i + 0.5) * srcHeight / Box.Height));
+		RowY.resize(Box.Width);
+		RowU.resize(Box.Width);
+		RowV.resize(Box.Width);
+	}
+
+	// Fill the borders of a destination row. Returns false if the whole row is border.
+	bool PadRow(uint8_t* out, int row) {
+		if (row < Box.Y || row >= Box.Y + Box.Height) {
+			memset(out, PadValue, (size_t) Box.DstWidth * 3);
+			return false;
+		}
+		memset(out, PadValue, (size_t) Box.X * 3);
+		memset(out + (size_t) (Box.X + Box.Width) * 3, PadValue, (size_t) (Box.DstWidth - Box.X - Box.Width) * 3);
+		return true;
+	}
+};